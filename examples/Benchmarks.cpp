@@ -0,0 +1,216 @@
+// ############################################################################
+// MIT License
+//
+// Copyright (c) 2022 Quentin Quadrat
+//
+// Permission is hereby granted, free of charge, to any person obtaining a copy
+// of this software and associated documentation files (the "Software"), to deal
+// in the Software without restriction, including without limitation the rights
+// to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+// copies of the Software, and to permit persons to whom the Software is
+// furnished to do so, subject to the following conditions:
+//
+// The above copyright notice and this permission notice shall be included in all
+// copies or substantial portions of the Software.
+//
+// THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+// IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+// FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+// AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+// LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+// OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+// SOFTWARE.
+// ############################################################################
+
+// Compare the dispatch of the LaneKeeping state machine: generated C++ class
+// (tables of transitions by event, constant tables of the option --data-only,
+// handlers by state of the option --handlers) against the interpreter
+// executing the tables generated by the option --tables, with actions bound to
+// C++ callbacks or run as bytecode. The Ring state machine (generated by the
+// Makefile) checks the generated C++ class and the option --data-only beyond
+// 256 states.
+// Run with: make benchmark
+
+// Hooks of generated classes are not mocked
+#define MOCKABLE
+#include "LaneKeepingController.hpp"
+#include "LaneKeepingData.hpp"
+#include "LaneKeepingHandlers.hpp"
+#include "RingController.hpp"
+#include "RingData.hpp"
+#include "Interpreter.hpp"
+#include <chrono>
+
+//! \brief Number of times the cycle of events is repeated.
+static constexpr size_t CYCLES = 2000000u;
+
+//-----------------------------------------------------------------------------
+//! \brief Member variables of LaneKeepingController used by the callbacks of
+//! the interpreted state machine.
+//-----------------------------------------------------------------------------
+struct LaneKeeping
+{
+    bool LED_LKS = Disable;
+    bool LED_lane = Disable;
+    bool LED_steering = Disable;
+    bool servoing = Disable;
+};
+
+//-----------------------------------------------------------------------------
+//! \brief Callbacks doing the actions of the LaneKeeping diagram.
+//-----------------------------------------------------------------------------
+static void registerCallbacks(MachineRegistry<LaneKeeping>& registry)
+{
+    registry.action("LaneKeepingController::onTransitioning_LKSMODEOFF_LKSMODEON",
+                    [](LaneKeeping& c) { c.LED_LKS = Enable; });
+    registry.action("LaneKeepingController::onTransitioning_LKSMODEON_LKSMODEOFF",
+                    [](LaneKeeping& c) { c.LED_LKS = Disable; });
+    registry.action("LaneKeepingController::onTransitioning_LKSMODEON_DETECTLANE",
+                    [](LaneKeeping& c) { c.LED_lane = Enable; });
+    registry.action("LaneKeepingController::onTransitioning_DETECTLANE_LKSMODEOFF",
+                    [](LaneKeeping& c) { c.LED_LKS = Disable; c.LED_lane = Disable; });
+    registry.action("LaneKeepingController::onTransitioning_DETECTLANE_WAITDETECT",
+                    [](LaneKeeping& c) { c.LED_lane = Disable; });
+    registry.action("LaneKeepingController::onTransitioning_DETECTLANE_FOLLOWLANE",
+                    [](LaneKeeping& c) { c.LED_steering = Enable; c.servoing = Enable; });
+    registry.action("LaneKeepingController::onTransitioning_FOLLOWLANE_WAITDETECT",
+                    [](LaneKeeping& c) { c.LED_lane = c.LED_steering = c.servoing = Disable; });
+    registry.action("LaneKeepingController::onTransitioning_FOLLOWLANE_LKSMODEOFF",
+                    [](LaneKeeping& c) { c.LED_LKS = c.LED_lane = c.LED_steering = c.servoing = Disable; });
+    registry.action("LaneKeepingController::onTransitioning_FOLLOWLANE_DETECTLANE",
+                    [](LaneKeeping& c) { c.LED_steering = c.servoing = Disable; });
+}
+
+//-----------------------------------------------------------------------------
+//! \brief Return the duration in nanoseconds of the given function divided by
+//! the number of events it reacted.
+//-----------------------------------------------------------------------------
+template<class F>
+static double measure(F const& f, size_t const events)
+{
+    auto const start = std::chrono::steady_clock::now();
+    f();
+    auto const stop = std::chrono::steady_clock::now();
+    return double(std::chrono::duration_cast<std::chrono::nanoseconds>(stop - start).count()) /
+           double(events);
+}
+
+//-----------------------------------------------------------------------------
+//! \brief Return the duration in nanoseconds of an event reacted by the given
+//! generated state machine class.
+//-----------------------------------------------------------------------------
+template<class FSM>
+static double measure(FSM& fsm, size_t const events)
+{
+    fsm.enter();
+    return measure([&]() {
+        for (size_t i = 0u; i < CYCLES; ++i)
+        {
+            fsm.btn_lks(); fsm.detect(); fsm.set();
+            fsm.cancel(); fsm.notDetect(); fsm.detect();
+            fsm.set(); fsm.notDetect(); fsm.btn_lks();
+        }
+    }, CYCLES * events);
+}
+
+//-----------------------------------------------------------------------------
+//! \brief Return the duration in nanoseconds of an event reacted by the given
+//! generated Ring state machine class.
+//-----------------------------------------------------------------------------
+template<class FSM>
+static double measureRing(FSM& fsm)
+{
+    fsm.enter();
+    return measure([&]() {
+        for (size_t i = 0u; i < CYCLES; ++i)
+            fsm.next();
+    }, CYCLES);
+}
+
+int main(int argc, char* argv[])
+{
+    if (argc != 2)
+    {
+        printf("Usage: %s LaneKeepingController.table\n", argv[0]);
+        return EXIT_FAILURE;
+    }
+
+    // Cycle of events coming back to the initial state
+    // LKSMODEOFF -> LKSMODEON -> DETECTLANE -> FOLLOWLANE -> DETECTLANE ->
+    // WAITDETECT -> DETECTLANE -> FOLLOWLANE -> WAITDETECT -> LKSMODEOFF
+    static constexpr size_t EVENTS = 9u;
+
+    LaneKeepingController generated;
+    double const ns_generated = measure(generated, EVENTS);
+    LaneKeepingData data;
+    double const ns_data = measure(data, EVENTS);
+    LaneKeepingHandlers handlers;
+    double const ns_handlers = measure(handlers, EVENTS);
+
+    MappedTable table;
+    if (!table.open(argv[1]))
+        return EXIT_FAILURE;
+    MachineRegistry<LaneKeeping> registry;
+    registerCallbacks(registry);
+    MachineProgram<LaneKeeping> program(table, registry);
+    if (!program.isBound())
+        return EXIT_FAILURE;
+    uint16_t const events[EVENTS] = {
+        table.findEvent("btn_lks"), table.findEvent("detect"), table.findEvent("set"),
+        table.findEvent("cancel"), table.findEvent("notDetect"), table.findEvent("detect"),
+        table.findEvent("set"), table.findEvent("notDetect"), table.findEvent("btn_lks"),
+    };
+
+    // A single block holds the slots and the states of both instances
+    size_t const bytes = MachineInterpreter<LaneKeeping>::storage(table);
+    std::vector<MachineValue> memory(2u * bytes / sizeof(MachineValue));
+    LaneKeeping context;
+    MachineInterpreter<LaneKeeping> interpreted(program, context, memory.data(), bytes);
+    interpreted.enter();
+    double const ns_interpreted = measure([&]() {
+        for (size_t i = 0u; i < CYCLES; ++i)
+        {
+            for (size_t e = 0u; e < EVENTS; ++e)
+                interpreted.react(events[e]);
+        }
+    }, CYCLES * EVENTS);
+
+    // Actions of LaneKeeping are compiled into bytecode: no callback needed
+    MachineRegistry<LaneKeeping> empty;
+    MachineProgram<LaneKeeping> bytecode_program(table, empty);
+    if (!bytecode_program.isBound())
+        return EXIT_FAILURE;
+    MachineInterpreter<LaneKeeping> bytecode(bytecode_program, context,
+                                             memory.data() + bytes / sizeof(MachineValue), bytes);
+    bytecode.enter();
+    double const ns_bytecode = measure([&]() {
+        for (size_t i = 0u; i < CYCLES; ++i)
+        {
+            for (size_t e = 0u; e < EVENTS; ++e)
+                bytecode.react(events[e]);
+        }
+    }, CYCLES * EVENTS);
+
+    printf("LaneKeeping %s / %s / %s / %s / %s\n", generated.c_str(), data.c_str(),
+           handlers.c_str(), interpreted.c_str(), bytecode.c_str());
+    printf("  generated:   %6.1f ns/event\n", ns_generated);
+    printf("  data-only:   %6.1f ns/event (x%.2f)\n", ns_data,
+           ns_data / ns_generated);
+    printf("  handlers:    %6.1f ns/event (x%.2f)\n", ns_handlers,
+           ns_handlers / ns_generated);
+    printf("  interpreted: %6.1f ns/event (x%.2f)\n", ns_interpreted,
+           ns_interpreted / ns_generated);
+    printf("  bytecode:    %6.1f ns/event (x%.2f)\n", ns_bytecode,
+           ns_bytecode / ns_generated);
+
+    // 300 states
+    RingController ring;
+    double const ns_ring = measureRing(ring);
+    RingData ring_data;
+    double const ns_ring_data = measureRing(ring_data);
+    printf("Ring %s / %s\n", ring.c_str(), ring_data.c_str());
+    printf("  generated:   %6.1f ns/event\n", ns_ring);
+    printf("  data-only:   %6.1f ns/event (x%.2f)\n", ns_ring_data,
+           ns_ring_data / ns_ring);
+    return EXIT_SUCCESS;
+}
@@ -0,0 +1,187 @@
+// ############################################################################
+// MIT License
+//
+// Copyright (c) 2022 Quentin Quadrat
+//
+// Permission is hereby granted, free of charge, to any person obtaining a copy
+// of this software and associated documentation files (the "Software"), to deal
+// in the Software without restriction, including without limitation the rights
+// to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+// copies of the Software, and to permit persons to whom the Software is
+// furnished to do so, subject to the following conditions:
+//
+// The above copyright notice and this permission notice shall be included in all
+// copies or substantial portions of the Software.
+//
+// THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+// IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+// FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+// AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+// LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+// OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+// SOFTWARE.
+// ############################################################################
+
+
+// Check the filters of noisy events of the Switch state machine (debounce and
+// throttle annotations) with a fake clock. Generated unit tests mock the guards
+// (FSM_MOCKED_GUARDS) and therefore never compile the filters: here guards are
+// not mocked.
+// Run with: make check
+
+// Fake clock read by the filters, in microseconds
+#include <cstdint>
+static uint64_t s_now = 0u;
+#define FSM_CLOCK_US() s_now
+
+// Hooks of generated classes are not mocked
+#define MOCKABLE
+#include "SwitchController.hpp"
+#include <gtest/gtest.h>
+
+using States = SwitchControllerStates;
+
+//! \brief One millisecond and one second in microseconds.
+static constexpr uint64_t MS = 1000u;
+static constexpr uint64_t S = 1000000u;
+
+//-----------------------------------------------------------------------------
+//! \brief Return the level of brightness of the lamp: the number of accepted
+//! dim events modulo 4.
+//-----------------------------------------------------------------------------
+static size_t level(SwitchController const& fsm)
+{
+    switch (fsm.state())
+    {
+    case States::LOW: return 0u;
+    case States::MEDIUM: return 1u;
+    case States::HIGH: return 2u;
+    case States::MAX: return 3u;
+    default: ADD_FAILURE() << "lamp off"; return 4u;
+    }
+}
+
+//-----------------------------------------------------------------------------
+//! \brief Press the button at the given time.
+//-----------------------------------------------------------------------------
+static void press(SwitchController& fsm, uint64_t const now)
+{
+    s_now = now;
+    fsm.press();
+}
+
+//-----------------------------------------------------------------------------
+//! \brief Dim the lamp at the given time.
+//-----------------------------------------------------------------------------
+static void dim(SwitchController& fsm, uint64_t const now)
+{
+    s_now = now;
+    fsm.dim();
+}
+
+//-----------------------------------------------------------------------------
+TEST(Debounce, BounceIsRejected)
+{
+    SwitchController fsm;
+    fsm.enter();
+    ASSERT_EQ(fsm.state(), States::OFF);
+
+    // The first contact is accepted, the bounces following it are rejected
+    press(fsm, 10 * S);
+    ASSERT_EQ(fsm.state(), States::LOW);
+    press(fsm, 10 * S + 1 * MS);
+    ASSERT_EQ(fsm.state(), States::LOW);
+    press(fsm, 10 * S + 3 * MS);
+    ASSERT_EQ(fsm.state(), States::LOW);
+
+    // Each bounce delays the next accepted press: the button is not stable
+    // 50 ms after the first contact
+    press(fsm, 10 * S + 30 * MS);
+    press(fsm, 10 * S + 51 * MS);
+    ASSERT_EQ(fsm.state(), States::LOW);
+
+    // Stable for 50 ms: the next press is accepted
+    press(fsm, 10 * S + 101 * MS);
+    ASSERT_EQ(fsm.state(), States::OFF);
+}
+
+//-----------------------------------------------------------------------------
+TEST(Debounce, WindowBoundary)
+{
+    SwitchController fsm;
+    fsm.enter();
+    press(fsm, 10 * S);
+    ASSERT_EQ(fsm.state(), States::LOW);
+
+    // One microsecond before the end of the window: rejected
+    press(fsm, 10 * S + 50 * MS - 1u);
+    ASSERT_EQ(fsm.state(), States::LOW);
+
+    // Exactly 50 ms after the previous press: accepted
+    press(fsm, 10 * S + 100 * MS - 1u);
+    ASSERT_EQ(fsm.state(), States::OFF);
+    press(fsm, 10 * S + 150 * MS - 1u);
+    ASSERT_EQ(fsm.state(), States::LOW);
+}
+
+//-----------------------------------------------------------------------------
+TEST(Debounce, OtherEventsAreNotFiltered)
+{
+    SwitchController fsm;
+    fsm.enter();
+    press(fsm, 10 * S);
+
+    // The debounce of presses does not apply to dim events
+    dim(fsm, 10 * S + 1u);
+    ASSERT_EQ(level(fsm), 1u);
+}
+
+//-----------------------------------------------------------------------------
+TEST(Throttle, AllowsThreeBySecond)
+{
+    SwitchController fsm;
+    fsm.enter();
+    press(fsm, 0u);
+
+    // Ten dim events by second during five seconds: three are accepted by
+    // second, the other ones are rejected
+    for (uint64_t second = 1u; second <= 5u; ++second)
+    {
+        for (uint64_t i = 0u; i < 10u; ++i)
+            dim(fsm, second * S + i * 100u * MS);
+        ASSERT_EQ(level(fsm), (3u * second) % 4u) << "second " << second;
+    }
+}
+
+//-----------------------------------------------------------------------------
+TEST(Throttle, WindowBoundary)
+{
+    SwitchController fsm;
+    fsm.enter();
+    press(fsm, 0u);
+
+    // The window of one second starts with the first accepted event
+    dim(fsm, 10 * S);
+    dim(fsm, 10 * S + 1u);
+    dim(fsm, 10 * S + 2u);
+    ASSERT_EQ(level(fsm), 3u);
+
+    // One microsecond before the end of the window: rejected
+    dim(fsm, 11 * S - 1u);
+    ASSERT_EQ(level(fsm), 3u);
+
+    // At the end of the window: accepted, starting a new window
+    dim(fsm, 11 * S);
+    ASSERT_EQ(level(fsm), 0u);
+    dim(fsm, 11 * S + 1u);
+    dim(fsm, 11 * S + 2u);
+    dim(fsm, 12 * S - 1u);
+    ASSERT_EQ(level(fsm), 2u);
+}
+
+//-----------------------------------------------------------------------------
+int main(int argc, char *argv[])
+{
+    ::testing::InitGoogleTest(&argc, argv);
+    return RUN_ALL_TESTS();
+}
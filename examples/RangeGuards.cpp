@@ -0,0 +1,177 @@
+// ############################################################################
+// MIT License
+//
+// Copyright (c) 2022 Quentin Quadrat
+//
+// Permission is hereby granted, free of charge, to any person obtaining a copy
+// of this software and associated documentation files (the "Software"), to deal
+// in the Software without restriction, including without limitation the rights
+// to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+// copies of the Software, and to permit persons to whom the Software is
+// furnished to do so, subject to the following conditions:
+//
+// The above copyright notice and this permission notice shall be included in all
+// copies or substantial portions of the Software.
+//
+// THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+// IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+// FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+// AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+// LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+// OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+// SOFTWARE.
+// ############################################################################
+
+// Check the binary search compiled from the range guards of the Thermostat
+// state machine and its batch event. Generated unit tests mock the guards
+// (FSM_MOCKED_GUARDS) and therefore never run them: here guards are not mocked.
+// Run with: make check
+
+// Hooks of generated classes are not mocked
+#define MOCKABLE
+#include "ThermostatController.hpp"
+#include <gtest/gtest.h>
+#include <climits>
+#include <vector>
+
+using States = ThermostatControllerStates;
+
+//-----------------------------------------------------------------------------
+//! \brief Return the state reached by the Thermostat entering the given state
+//! then measuring the given temperature.
+//-----------------------------------------------------------------------------
+static States measure(States const from, TEMPERATURE const temperature)
+{
+    ThermostatController fsm;
+    fsm.enter();
+    if (from == States::HEATING)
+        fsm.measure(0);
+    else if (from == States::COOLING)
+        fsm.measure(30);
+    else if (from == States::BOOSTING)
+        fsm.measure(0), fsm.measure(19);
+    EXPECT_EQ(fsm.state(), from);
+    fsm.measure(temperature);
+    return fsm.state();
+}
+
+//-----------------------------------------------------------------------------
+//! \brief Return the state reached by evaluating the guards of the diagram in
+//! order (the reference of the binary search).
+//-----------------------------------------------------------------------------
+static States reference(States const from, TEMPERATURE const temperature)
+{
+    switch (from)
+    {
+    case States::IDLE:
+        if (temperature < 18) return States::HEATING;
+        if (temperature > 25) return States::COOLING;
+        return from;
+    case States::HEATING:
+        if (temperature >= 20 && temperature <= 22) return States::IDLE;
+        if (temperature >= 22) return States::COOLING;
+        return States::BOOSTING;
+    case States::COOLING:
+        if (temperature < 15) return States::HEATING;
+        if (temperature < 22 || temperature == 30) return States::IDLE;
+        return from;
+    default:
+        return from;
+    }
+}
+
+//-----------------------------------------------------------------------------
+TEST(RangeGuards, InclusiveAndExclusiveBounds)
+{
+    // [ temperature < 18 ] and [ temperature > 25 ]
+    ASSERT_EQ(measure(States::IDLE, 17), States::HEATING);
+    ASSERT_EQ(measure(States::IDLE, 18), States::IDLE);
+    ASSERT_EQ(measure(States::IDLE, 25), States::IDLE);
+    ASSERT_EQ(measure(States::IDLE, 26), States::COOLING);
+
+    // [ temperature >= 20 && temperature <= 22 ]
+    ASSERT_EQ(measure(States::HEATING, 20), States::IDLE);
+    ASSERT_EQ(measure(States::HEATING, 21), States::IDLE);
+    ASSERT_EQ(measure(States::HEATING, 23), States::COOLING);
+
+    // [ temperature < 22 || temperature == 30 ]
+    ASSERT_EQ(measure(States::COOLING, 21), States::IDLE);
+    ASSERT_EQ(measure(States::COOLING, 22), States::COOLING);
+    ASSERT_EQ(measure(States::COOLING, 29), States::COOLING);
+    ASSERT_EQ(measure(States::COOLING, 30), States::IDLE);
+    ASSERT_EQ(measure(States::COOLING, 31), States::COOLING);
+}
+
+//-----------------------------------------------------------------------------
+TEST(RangeGuards, OverlappingRangesTakeTheFirstTransition)
+{
+    // [ temperature <= 22 ] and [ temperature >= 22 ] overlap on 22
+    ASSERT_EQ(measure(States::HEATING, 22), States::IDLE);
+
+    // [ temperature < 15 ] and [ temperature < 22 ] overlap below 15
+    ASSERT_EQ(measure(States::COOLING, 14), States::HEATING);
+    ASSERT_EQ(measure(States::COOLING, 15), States::IDLE);
+    ASSERT_EQ(measure(States::COOLING, INT_MIN), States::HEATING);
+}
+
+//-----------------------------------------------------------------------------
+TEST(RangeGuards, FallthroughToElse)
+{
+    ASSERT_EQ(measure(States::HEATING, 19), States::BOOSTING);
+    ASSERT_EQ(measure(States::HEATING, INT_MIN), States::BOOSTING);
+    ASSERT_EQ(measure(States::HEATING, INT_MAX), States::COOLING);
+
+    // Boosting does not react to measures
+    ASSERT_EQ(measure(States::BOOSTING, 21), States::BOOSTING);
+}
+
+//-----------------------------------------------------------------------------
+TEST(RangeGuards, MatchGuardsEvaluatedInOrder)
+{
+    for (States const from: { States::IDLE, States::HEATING, States::COOLING })
+    {
+        for (TEMPERATURE t = -40; t <= 60; ++t)
+        {
+            ASSERT_EQ(measure(from, t), reference(from, t))
+                << "from state " << int(from) << " at " << t;
+        }
+    }
+}
+
+//-----------------------------------------------------------------------------
+TEST(BatchEvents, MatchSingleCalls)
+{
+    // State machines in all states, Cooling forwarding the measures to its
+    // nested state machine (not batched)
+    constexpr size_t COUNT = 150u;
+    std::vector<ThermostatController> batched(COUNT), single(COUNT);
+    std::vector<ThermostatController*> fsms(COUNT);
+    std::vector<TEMPERATURE> temperatures(COUNT);
+    for (size_t i = 0u; i < COUNT; ++i)
+    {
+        batched[i].enter();
+        single[i].enter();
+        fsms[i] = &batched[i];
+    }
+    for (TEMPERATURE round = 0; round < 40; ++round)
+    {
+        for (size_t i = 0u; i < COUNT; ++i)
+            temperatures[i] = TEMPERATURE((int(i) * 7 + round * 13) % 45);
+        ThermostatController::measure(fsms.data(), temperatures.data(), COUNT);
+        for (size_t i = 0u; i < COUNT; ++i)
+        {
+            single[i].measure(temperatures[i]);
+            ASSERT_EQ(batched[i].state(), single[i].state())
+                << "machine " << i << " round " << round;
+            ASSERT_EQ(batched[i].configuration(), single[i].configuration())
+                << "machine " << i << " round " << round;
+        }
+    }
+}
+
+//-----------------------------------------------------------------------------
+int main(int argc, char *argv[])
+{
+    ::testing::InitGoogleTest(&argc, argv);
+    return RUN_ALL_TESTS();
+}
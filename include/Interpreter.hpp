@@ -0,0 +1,1450 @@
+// ############################################################################
+// MIT License
+//
+// Copyright (c) 2022 Quentin Quadrat
+//
+// Permission is hereby granted, free of charge, to any person obtaining a copy
+// of this software and associated documentation files (the "Software"), to deal
+// in the Software without restriction, including without limitation the rights
+// to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+// copies of the Software, and to permit persons to whom the Software is
+// furnished to do so, subject to the following conditions:
+//
+// The above copyright notice and this permission notice shall be included in all
+// copies or substantial portions of the Software.
+//
+// THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+// IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+// FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+// AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+// LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+// OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+// SOFTWARE.
+// ############################################################################
+
+#ifndef INTERPRETER_HPP
+#  define INTERPRETER_HPP
+
+#  include "StateMachine.hpp"
+#  include <map>
+#  include <string>
+#  include <vector>
+#  include <cstring>
+#  if defined(__unix__) || defined(__APPLE__)
+#    include <fcntl.h>
+#    include <unistd.h>
+#    include <sys/mman.h>
+#    include <sys/stat.h>
+#  endif
+
+#  if defined(__BYTE_ORDER__) && (__BYTE_ORDER__ != __ORDER_LITTLE_ENDIAN__)
+#    error "Binary tables of state machines are stored in little endian"
+#  endif
+
+//-----------------------------------------------------------------------------
+//! \brief Value of a slot (variable of an interpreted state machine instance)
+//! or of a register of the bytecode virtual machine: \c i for int and bool
+//! slots, \c f for real slots.
+//-----------------------------------------------------------------------------
+union MachineValue
+{
+    int64_t i;
+    double f;
+};
+
+// *****************************************************************************
+//! \brief Read-only view on the binary tables of a state machine and of its
+//! nested state machines, generated by the translator with the option --tables.
+//! The view does not copy the tables: they can be mapped in memory (see
+//! \c MappedTable) and shared by all the processes running the state machine.
+//!
+//! The memory holds a \c Header followed by the arrays of constants (\c
+//! MachineValue), \c Slot, \c Machine, \c State, \c Event, \c Transition,
+//! \c Hook and \c Instruction records then by a pool of strings terminated by
+//! '\0'. Records refer to each other by their index in their array and to
+//! strings by their offset inside the pool. The root state
+//! machine is the first one and parent state machines are listed before their
+//! nested state machines. The transitions of a state are contiguous and those
+//! reacting to the same event are in the order their guards are evaluated.
+//!
+//! Hooks whose code is simple enough (i.e. "count < 10", "hours = (hours + 1)
+//! % 24") have been compiled into instructions of a register-based bytecode
+//! over the slots of the instance: they do not need a C++ callback.
+// *****************************************************************************
+class MachineTable
+{
+public:
+
+    //! \brief Index referring to no record (no hook, no parent, eventless ...).
+    static constexpr uint16_t NONE = 0xFFFFu;
+    //! \brief Version of the binary format.
+    static constexpr uint16_t VERSION = 2u;
+    //! \brief Number of registers of the bytecode virtual machine.
+    static constexpr size_t REGISTERS = 16u;
+    //! \brief Kind of hooks: guards return a boolean, actions return nothing.
+    enum Kind : uint16_t { GUARD = 0u, ACTION = 1u };
+    //! \brief State flags.
+    enum Flags : uint16_t { PSEUDO_STATE = 1u };
+    //! \brief Type of slots.
+    enum Type : uint16_t { INT = 0u, REAL = 1u, BOOL = 2u };
+    //! \brief Opcodes of the bytecode (same order than the translator). The
+    //! suffix I works on int registers, F on real registers. Comparisons and
+    //! NOT give 0 or 1. LOAD, STORE and CONST refer to the slot or to the
+    //! constant of index k, JZ and JNZ jump forward to the instruction k when
+    //! the register a is zero (not zero), RET ends a guard returning the
+    //! register a, END ends an action.
+    enum Opcode : uint8_t
+    {
+        LOAD, STORE, CONST, ITOF, FTOI, BOOLI,
+        ADDI, SUBI, MULI, DIVI, MODI, NEGI,
+        ADDF, SUBF, MULF, DIVF, NEGF,
+        EQI, NEI, LTI, LEI, GTI, GEI,
+        EQF, NEF, LTF, LEF, GTF, GEF,
+        NOT, JZ, JNZ, RET, END
+    };
+
+    //! \brief Header of the tables.
+    struct Header
+    {
+        char magic[4]; //!< "FSMT"
+        uint16_t version; //!< VERSION
+        uint16_t machines; //!< Number of Machine records
+        uint16_t states; //!< Number of State records
+        uint16_t events; //!< Number of Event records
+        uint16_t transitions; //!< Number of Transition records
+        uint16_t hooks; //!< Number of Hook records
+        uint32_t strings; //!< Size in bytes of the pool of strings
+        uint32_t size; //!< Size in bytes of the tables
+        uint16_t slots; //!< Number of Slot records
+        uint16_t constants; //!< Number of constants
+        uint16_t instructions; //!< Number of Instruction records
+        uint16_t padding;
+    };
+
+    //! \brief Variable of the instance used by the bytecode.
+    struct Slot
+    {
+        uint32_t name; //!< Name of the member variable or event parameter
+        uint16_t type; //!< INT, REAL or BOOL
+        uint8_t width; //!< Bytes of the C++ integer (1, 2, 4 or 8, 0 for 8)
+        uint8_t sign; //!< 1 if the C++ integer is signed
+        MachineValue initial; //!< Value when the instance is created
+    };
+
+    //! \brief State machine (the root one or a nested one).
+    struct Machine
+    {
+        uint32_t name; //!< Name of the generated C++ class
+        uint16_t initial; //!< Initial pseudo-state
+        uint16_t parent; //!< Parent state machine or NONE for the root
+        uint16_t owner; //!< Composite state of the parent or NONE
+        uint16_t first_state; //!< Index of the first state
+        uint16_t state_count; //!< Number of states
+        uint16_t padding;
+    };
+
+    //! \brief State of a state machine.
+    struct State
+    {
+        uint32_t name; //!< Name of the state
+        uint16_t machine; //!< State machine holding the state
+        uint16_t entering; //!< Action when entering the state or NONE
+        uint16_t leaving; //!< Action when leaving the state or NONE
+        uint16_t first_transition; //!< Index of the first outgoing transition
+        uint16_t transition_count; //!< Number of outgoing transitions
+        uint16_t child; //!< Nested state machine or NONE
+        uint16_t flags; //!< Flags
+        uint16_t padding;
+    };
+
+    //! \brief External event.
+    struct Event
+    {
+        uint32_t name; //!< Name of the event method in generated C++ code
+    };
+
+    //! \brief Transition from a state to a state of the same state machine.
+    struct Transition
+    {
+        uint16_t event; //!< Reacted event or NONE for eventless transitions
+        uint16_t origin; //!< Origin state
+        uint16_t destination; //!< Destination state
+        uint16_t guard; //!< Guard or NONE
+        uint16_t action; //!< Action or NONE
+        uint16_t padding;
+    };
+
+    //! \brief Guard or action bound to a C++ callback by its name.
+    struct Hook
+    {
+        uint32_t name; //!< Name of the method in generated C++ code
+        uint16_t kind; //!< GUARD or ACTION
+        uint16_t code; //!< First instruction of its bytecode or NONE
+    };
+
+    //! \brief Instruction of the bytecode: r[dst] = r[a] op r[b].
+    struct Instruction
+    {
+        uint8_t op; //!< Opcode
+        uint8_t dst; //!< Destination register
+        uint8_t a; //!< First operand register
+        uint8_t b; //!< Second operand register
+        uint32_t k; //!< Slot, constant or jump target
+    };
+
+    static_assert(sizeof(Header) == 32u, "Unexpected padding of Header");
+    static_assert(sizeof(Slot) == 16u, "Unexpected padding of Slot");
+    static_assert(sizeof(Instruction) == 8u, "Unexpected padding of Instruction");
+    static_assert(sizeof(Machine) == 16u, "Unexpected padding of Machine");
+    static_assert(sizeof(State) == 20u, "Unexpected padding of State");
+    static_assert(sizeof(Event) == 4u, "Unexpected padding of Event");
+    static_assert(sizeof(Transition) == 12u, "Unexpected padding of Transition");
+    static_assert(sizeof(Hook) == 8u, "Unexpected padding of Hook");
+
+    //--------------------------------------------------------------------------
+    //! \brief Check and use the tables stored in the given memory. The memory
+    //! is not copied: it shall outlive this instance.
+    //! \param[in] data the tables aligned on 8 bytes.
+    //! \param[in] size the size of the memory in bytes.
+    //! \return true if the tables are well formed.
+    //--------------------------------------------------------------------------
+    bool load(void const* data, size_t const size)
+    {
+        m_header = nullptr;
+        auto const* bytes = static_cast<unsigned char const*>(data);
+        if ((bytes == nullptr) || (reinterpret_cast<uintptr_t>(bytes) % 8u != 0u) ||
+            (size < sizeof(Header)))
+            return invalid("truncated or misaligned memory");
+        Header const* header = reinterpret_cast<Header const*>(bytes);
+        if ((memcmp(header->magic, "FSMT", 4u) != 0) || (header->version != VERSION))
+            return invalid("bad magic number or version");
+        size_t const expected = sizeof(Header) + header->constants * sizeof(MachineValue) +
+            header->slots * sizeof(Slot) + header->machines * sizeof(Machine) +
+            header->states * sizeof(State) + header->events * sizeof(Event) +
+            header->transitions * sizeof(Transition) + header->hooks * sizeof(Hook) +
+            header->instructions * sizeof(Instruction) + header->strings;
+        if ((header->size != expected) || (expected > size) ||
+            (header->machines == 0u) || (header->strings == 0u))
+            return invalid("bad size");
+
+        m_constants = reinterpret_cast<MachineValue const*>(header + 1);
+        m_slots = reinterpret_cast<Slot const*>(m_constants + header->constants);
+        m_machines = reinterpret_cast<Machine const*>(m_slots + header->slots);
+        m_states = reinterpret_cast<State const*>(m_machines + header->machines);
+        m_events = reinterpret_cast<Event const*>(m_states + header->states);
+        m_transitions = reinterpret_cast<Transition const*>(m_events + header->events);
+        m_hooks = reinterpret_cast<Hook const*>(m_transitions + header->transitions);
+        m_instructions = reinterpret_cast<Instruction const*>(m_hooks + header->hooks);
+        m_strings = reinterpret_cast<char const*>(m_instructions + header->instructions);
+        if (m_strings[header->strings - 1u] != '\0')
+            return invalid("unterminated strings");
+
+        // Check indices so the interpreter does not have to.
+        for (uint16_t i = 0u; i < header->machines; ++i)
+        {
+            Machine const& m = m_machines[i];
+            if ((m.name >= header->strings) || (m.initial >= header->states) ||
+                (m.first_state + m.state_count > header->states) ||
+                (m.initial < m.first_state) || (m.initial >= m.first_state + m.state_count))
+                return invalid("bad machine");
+            if ((m.parent == NONE) != (i == 0u))
+                return invalid("bad root machine");
+            if ((i != 0u) && ((m.parent >= i) || (m.owner >= header->states) ||
+                              (m_states[m.owner].machine != m.parent) ||
+                              (m_states[m.owner].child != i)))
+                return invalid("bad nested machine");
+        }
+        for (uint16_t i = 0u; i < header->states; ++i)
+        {
+            State const& s = m_states[i];
+            if ((s.name >= header->strings) || (s.machine >= header->machines) ||
+                (i < m_machines[s.machine].first_state) ||
+                (i >= m_machines[s.machine].first_state + m_machines[s.machine].state_count) ||
+                !isHook(s.entering, ACTION, header->hooks) ||
+                !isHook(s.leaving, ACTION, header->hooks) ||
+                (s.first_transition + s.transition_count > header->transitions) ||
+                ((s.child != NONE) && ((s.child >= header->machines) ||
+                                       (m_machines[s.child].owner != i))))
+                return invalid("bad state");
+            for (uint16_t t = s.first_transition; t < s.first_transition + s.transition_count; ++t)
+            {
+                Transition const& tr = m_transitions[t];
+                if ((tr.origin != i) || (tr.destination >= header->states) ||
+                    (m_states[tr.destination].machine != s.machine) ||
+                    ((tr.event != NONE) && (tr.event >= header->events)) ||
+                    !isHook(tr.guard, GUARD, header->hooks) ||
+                    !isHook(tr.action, ACTION, header->hooks))
+                    return invalid("bad transition");
+            }
+        }
+        for (uint16_t i = 0u; i < header->events; ++i)
+        {
+            if (m_events[i].name >= header->strings)
+                return invalid("bad event");
+        }
+        for (uint16_t i = 0u; i < header->hooks; ++i)
+        {
+            if ((m_hooks[i].name >= header->strings) || (m_hooks[i].kind > ACTION) ||
+                ((m_hooks[i].code != NONE) && (m_hooks[i].code >= header->instructions)))
+                return invalid("bad hook");
+        }
+        for (uint16_t i = 0u; i < header->slots; ++i)
+        {
+            uint8_t const width = m_slots[i].width;
+            if ((m_slots[i].name >= header->strings) || (m_slots[i].type > BOOL) || (m_slots[i].sign > 1u) ||
+                ((width != 0u) && (width != 1u) && (width != 2u) && (width != 4u) && (width != 8u)))
+                return invalid("bad slot");
+        }
+        // Only forward jumps and a last instruction ending the code: the
+        // bytecode always terminates.
+        if ((header->instructions != 0u) &&
+            (m_instructions[header->instructions - 1u].op != RET) &&
+            (m_instructions[header->instructions - 1u].op != END))
+            return invalid("unterminated bytecode");
+        for (uint16_t i = 0u; i < header->instructions; ++i)
+        {
+            Instruction const& in = m_instructions[i];
+            if ((in.op > END) || (in.dst >= REGISTERS) || (in.a >= REGISTERS) || (in.b >= REGISTERS) ||
+                (((in.op == LOAD) || (in.op == STORE)) && (in.k >= header->slots)) ||
+                ((in.op == CONST) && (in.k >= header->constants)) ||
+                (((in.op == JZ) || (in.op == JNZ)) && ((in.k <= i) || (in.k >= header->instructions))))
+                return invalid("bad instruction");
+        }
+
+        // FNV-1a: identifies the version of the tables (see MachineMigration)
+        m_hash = 2166136261u;
+        for (size_t i = 0u; i < expected; ++i)
+        {
+            m_hash = (m_hash ^ bytes[i]) * 16777619u;
+        }
+        m_header = header;
+        return true;
+    }
+
+    //--------------------------------------------------------------------------
+    //! \brief Return true if tables have been successfully loaded.
+    //--------------------------------------------------------------------------
+    inline bool isLoaded() const
+    {
+        return m_header != nullptr;
+    }
+
+    //--------------------------------------------------------------------------
+    //! \brief Return the header of loaded tables.
+    //--------------------------------------------------------------------------
+    inline Header const& header() const
+    {
+        assert(m_header != nullptr);
+        return *m_header;
+    }
+
+    //--------------------------------------------------------------------------
+    //! \brief Return the FNV-1a hash of the loaded tables.
+    //--------------------------------------------------------------------------
+    inline uint32_t hash() const
+    {
+        return m_hash;
+    }
+
+    inline Machine const& machine(uint16_t const i) const { return m_machines[i]; }
+    inline State const& state(uint16_t const i) const { return m_states[i]; }
+    inline Event const& event(uint16_t const i) const { return m_events[i]; }
+    inline Transition const& transition(uint16_t const i) const { return m_transitions[i]; }
+    inline Hook const& hook(uint16_t const i) const { return m_hooks[i]; }
+    inline Slot const& slot(uint16_t const i) const { return m_slots[i]; }
+
+    //--------------------------------------------------------------------------
+    //! \brief Return the value stored in the given slot: integers wrap to the
+    //! width and the signedness of their C++ variable as the generated C++
+    //! code does when assigning it.
+    //--------------------------------------------------------------------------
+    static inline MachineValue wrap(Slot const& slot, MachineValue value)
+    {
+        if ((slot.type == INT) && (slot.width != 0u) && (slot.width < 8u))
+        {
+            uint64_t const bits = 8u * uint64_t(slot.width);
+            uint64_t const mask = (uint64_t(1u) << bits) - 1u;
+            uint64_t u = uint64_t(value.i) & mask;
+            if ((slot.sign != 0u) && (((u >> (bits - 1u)) & 1u) != 0u))
+                u |= ~mask;
+            value.i = int64_t(u);
+        }
+        return value;
+    }
+    inline MachineValue const& constant(uint16_t const i) const { return m_constants[i]; }
+    inline Instruction const& instruction(uint16_t const i) const { return m_instructions[i]; }
+    inline char const* string(uint32_t const offset) const { return m_strings + offset; }
+
+    //--------------------------------------------------------------------------
+    //! \brief Return the identifier of the event of the given name (the name of
+    //! the event method in the generated C++ code) or NONE.
+    //--------------------------------------------------------------------------
+    uint16_t findEvent(char const* name) const
+    {
+        for (uint16_t i = 0u; i < header().events; ++i)
+        {
+            if (strcmp(string(m_events[i].name), name) == 0)
+                return i;
+        }
+        return NONE;
+    }
+
+    //--------------------------------------------------------------------------
+    //! \brief Return the identifier of the slot of the given name (the name of
+    //! the member variable or of the event parameter) or NONE.
+    //--------------------------------------------------------------------------
+    uint16_t findSlot(char const* name) const
+    {
+        for (uint16_t i = 0u; i < header().slots; ++i)
+        {
+            if (strcmp(string(m_slots[i].name), name) == 0)
+                return i;
+        }
+        return NONE;
+    }
+
+    //--------------------------------------------------------------------------
+    //! \brief Return the identifier of the state of the given name (the name of
+    //! its C++ enum) inside the given state machine or NONE.
+    //--------------------------------------------------------------------------
+    uint16_t findState(uint16_t const machine, char const* name) const
+    {
+        Machine const& m = m_machines[machine];
+        for (uint16_t i = m.first_state; i < m.first_state + m.state_count; ++i)
+        {
+            if (strcmp(string(m_states[i].name), name) == 0)
+                return i;
+        }
+        return NONE;
+    }
+
+protected:
+
+    //--------------------------------------------------------------------------
+    //! \brief Forget the loaded tables.
+    //--------------------------------------------------------------------------
+    inline void unload()
+    {
+        m_header = nullptr;
+    }
+
+private:
+
+    //! \brief Check the reference to a hook of the given kind.
+    inline bool isHook(uint16_t const id, Kind const kind, uint16_t const count) const
+    {
+        return (id == NONE) || ((id < count) && (m_hooks[id].kind == kind));
+    }
+
+    //! \brief Report malformed tables.
+    static inline bool invalid(char const* reason)
+    {
+        LOGE("[INTERPRETER] Invalid tables: %s\n", reason);
+        return false;
+    }
+
+private:
+
+    Header const* m_header = nullptr;
+    MachineValue const* m_constants = nullptr;
+    Slot const* m_slots = nullptr;
+    Machine const* m_machines = nullptr;
+    State const* m_states = nullptr;
+    Event const* m_events = nullptr;
+    Transition const* m_transitions = nullptr;
+    Hook const* m_hooks = nullptr;
+    Instruction const* m_instructions = nullptr;
+    char const* m_strings = nullptr;
+    uint32_t m_hash = 0u;
+};
+
+// *****************************************************************************
+//! \brief Read-only view on the mapping from the states and slots of a version
+//! of the tables of a state machine to those of its next version, generated by
+//! the translator with the options --tables --migrate-from=<old tables>. It is
+//! used to migrate running instances to the new version (see
+//! \c MachineInterpreter::migrate).
+//!
+//! The memory holds a \c Header followed by the array of new state indices
+//! (indexed by the old state indices) then by the array of new slot indices
+//! (indexed by the old slot indices). States are matched by their name inside
+//! the same state machine (or by '[migrate] annotations of the new diagram),
+//! slots by their name. Removed states are mapped to the initial pseudo-state
+//! of their state machine, removed slots to NONE.
+// *****************************************************************************
+class MachineMigration
+{
+public:
+
+    //! \brief Version of the binary format.
+    static constexpr uint16_t VERSION = 1u;
+
+    //! \brief Header of the mapping.
+    struct Header
+    {
+        char magic[4]; //!< "FSMM"
+        uint16_t version; //!< VERSION
+        uint16_t states; //!< Number of states of the old tables
+        uint16_t slots; //!< Number of slots of the old tables
+        uint16_t padding;
+        uint32_t from; //!< Hash of the old tables
+        uint32_t to; //!< Hash of the new tables
+    };
+
+    static_assert(sizeof(Header) == 20u, "Unexpected padding of Header");
+
+    //--------------------------------------------------------------------------
+    //! \brief Check and use the mapping stored in the given memory. The memory
+    //! is not copied: it shall outlive this instance.
+    //! \param[in] data the mapping aligned on 4 bytes.
+    //! \param[in] size the size of the memory in bytes.
+    //! \return true if the mapping is well formed.
+    //--------------------------------------------------------------------------
+    bool load(void const* data, size_t const size)
+    {
+        m_header = nullptr;
+        auto const* bytes = static_cast<unsigned char const*>(data);
+        if ((bytes == nullptr) || (reinterpret_cast<uintptr_t>(bytes) % 4u != 0u) ||
+            (size < sizeof(Header)))
+            return invalid("truncated or misaligned memory");
+        Header const* header = reinterpret_cast<Header const*>(bytes);
+        if ((memcmp(header->magic, "FSMM", 4u) != 0) || (header->version != VERSION))
+            return invalid("bad magic number or version");
+        if (sizeof(Header) + (header->states + header->slots) * sizeof(uint16_t) > size)
+            return invalid("bad size");
+        m_states = reinterpret_cast<uint16_t const*>(header + 1);
+        m_slots = m_states + header->states;
+        m_header = header;
+        return true;
+    }
+
+    //--------------------------------------------------------------------------
+    //! \brief Return true if the mapping has been successfully loaded.
+    //--------------------------------------------------------------------------
+    inline bool isLoaded() const
+    {
+        return m_header != nullptr;
+    }
+
+    //--------------------------------------------------------------------------
+    //! \brief Check that the mapping goes from the given old tables to the
+    //! given new tables.
+    //--------------------------------------------------------------------------
+    bool matches(MachineTable const& from, MachineTable const& to) const
+    {
+        if ((m_header == nullptr) || (m_header->from != from.hash()) || (m_header->to != to.hash()) ||
+            (m_header->states != from.header().states) || (m_header->slots != from.header().slots))
+            return invalid("not generated for these tables");
+        for (uint16_t i = 0u; i < m_header->states; ++i)
+        {
+            if ((m_states[i] != MachineTable::NONE) && (m_states[i] >= to.header().states))
+                return invalid("bad state");
+        }
+        for (uint16_t i = 0u; i < m_header->slots; ++i)
+        {
+            if ((m_slots[i] != MachineTable::NONE) && (m_slots[i] >= to.header().slots))
+                return invalid("bad slot");
+        }
+        return true;
+    }
+
+    //! \brief Return the new index of the given old state (or NONE).
+    inline uint16_t state(uint16_t const i) const { return m_states[i]; }
+    //! \brief Return the new index of the given old slot (or NONE).
+    inline uint16_t slot(uint16_t const i) const { return m_slots[i]; }
+
+protected:
+
+    //--------------------------------------------------------------------------
+    //! \brief Forget the loaded mapping.
+    //--------------------------------------------------------------------------
+    inline void unload()
+    {
+        m_header = nullptr;
+    }
+
+private:
+
+    //! \brief Report malformed mapping.
+    static inline bool invalid(char const* reason)
+    {
+        LOGE("[INTERPRETER] Invalid migration: %s\n", reason);
+        return false;
+    }
+
+private:
+
+    Header const* m_header = nullptr;
+    uint16_t const* m_states = nullptr;
+    uint16_t const* m_slots = nullptr;
+};
+
+#  if defined(__unix__) || defined(__APPLE__)
+// *****************************************************************************
+//! \brief Binary tables (or migration) of a state machine mapped in memory
+//! from their file. Pages are read-only and shared: processes mapping the same
+//! file share the same physical memory.
+//! \tparam VIEW MachineTable or MachineMigration.
+// *****************************************************************************
+template<class VIEW>
+class MappedFile: public VIEW
+{
+public:
+
+    MappedFile() = default;
+    MappedFile(MappedFile const&) = delete;
+    MappedFile& operator=(MappedFile const&) = delete;
+
+    ~MappedFile()
+    {
+        close();
+    }
+
+    //--------------------------------------------------------------------------
+    //! \brief Map the given file in memory and check its content.
+    //! \param[in] path the file generated by the translator.
+    //! \return true if the content is well formed.
+    //--------------------------------------------------------------------------
+    bool open(char const* path)
+    {
+        close();
+        int fd = ::open(path, O_RDONLY);
+        if (fd < 0)
+        {
+            LOGE("[INTERPRETER] Cannot open %s\n", path);
+            return false;
+        }
+        struct stat st;
+        if ((fstat(fd, &st) == 0) && (st.st_size > 0))
+        {
+            void* data = mmap(nullptr, size_t(st.st_size), PROT_READ, MAP_SHARED, fd, 0);
+            if (data != MAP_FAILED)
+            {
+                m_data = data;
+                m_size = size_t(st.st_size);
+            }
+        }
+        ::close(fd);
+        return (m_data != nullptr) && VIEW::load(m_data, m_size);
+    }
+
+    //--------------------------------------------------------------------------
+    //! \brief Unmap the file.
+    //--------------------------------------------------------------------------
+    void close()
+    {
+        if (m_data != nullptr)
+        {
+            munmap(m_data, m_size);
+            m_data = nullptr;
+            m_size = 0u;
+            VIEW::unload();
+        }
+    }
+
+private:
+
+    void* m_data = nullptr;
+    size_t m_size = 0u;
+};
+
+//! \brief Binary tables mapped from the file generated with --tables.
+using MappedTable = MappedFile<MachineTable>;
+//! \brief Migration mapped from the file generated with --migrate-from.
+using MappedMigration = MappedFile<MachineMigration>;
+#  endif
+
+// *****************************************************************************
+//! \brief Callbacks implementing the guards and actions of interpreted state
+//! machines, registered by the name of the method the translator would have
+//! generated (i.e. "MotorController::onGuarding_IDLE_START"). Callbacks take
+//! the data of the state machine instance (the context) instead of \c this.
+//! Hooks compiled into bytecode do not need callbacks (a registered callback
+//! replaces their bytecode).
+//!
+//! \tparam CONTEXT the data of a state machine instance (the member variables
+//! of the generated C++ class and the parameters of data events).
+// *****************************************************************************
+template<class CONTEXT>
+class MachineRegistry
+{
+public:
+
+    //! \brief Callback for guards.
+    using Guard = bool (*)(CONTEXT&);
+    //! \brief Callback for actions and for entering and leaving actions.
+    using Action = void (*)(CONTEXT&);
+
+    //--------------------------------------------------------------------------
+    //! \brief Register the callback of a guard.
+    //--------------------------------------------------------------------------
+    inline void guard(char const* name, Guard const callback)
+    {
+        m_guards[name] = callback;
+    }
+
+    //--------------------------------------------------------------------------
+    //! \brief Register the callback of an action.
+    //--------------------------------------------------------------------------
+    inline void action(char const* name, Action const callback)
+    {
+        m_actions[name] = callback;
+    }
+
+    //--------------------------------------------------------------------------
+    //! \brief Return the callback of the guard of the given name or nullptr.
+    //--------------------------------------------------------------------------
+    Guard findGuard(char const* name) const
+    {
+        auto const it = m_guards.find(name);
+        return (it == m_guards.end()) ? nullptr : it->second;
+    }
+
+    //--------------------------------------------------------------------------
+    //! \brief Return the callback of the action of the given name or nullptr.
+    //--------------------------------------------------------------------------
+    Action findAction(char const* name) const
+    {
+        auto const it = m_actions.find(name);
+        return (it == m_actions.end()) ? nullptr : it->second;
+    }
+
+private:
+
+    std::map<std::string, Guard> m_guards;
+    std::map<std::string, Action> m_actions;
+};
+
+// *****************************************************************************
+//! \brief Tables whose hooks have been bound to callbacks. Callbacks are looked
+//! up by name once: the dispatch only indexes arrays of function pointers (or
+//! runs the bytecode of hooks without callback). A program is read-only and
+//! shared by all the instances of the state machine.
+//!
+//! \tparam CONTEXT the data of a state machine instance.
+// *****************************************************************************
+template<class CONTEXT>
+class MachineProgram
+{
+public:
+
+    using Guard = typename MachineRegistry<CONTEXT>::Guard;
+    using Action = typename MachineRegistry<CONTEXT>::Action;
+
+    //--------------------------------------------------------------------------
+    //! \brief Bind the hooks of the tables to the registered callbacks.
+    //! \param[in] table loaded tables. They shall outlive this instance.
+    //! \param[in] registry the callbacks (only needed by the constructor).
+    //--------------------------------------------------------------------------
+    MachineProgram(MachineTable const& table, MachineRegistry<CONTEXT> const& registry)
+        : m_table(table)
+    {
+        if (!table.isLoaded())
+        {
+            m_bound = false;
+            return ;
+        }
+        uint16_t const count = table.header().hooks;
+        m_guards.resize(count, nullptr);
+        m_actions.resize(count, nullptr);
+        for (uint16_t i = 0u; i < count; ++i)
+        {
+            MachineTable::Hook const& hook = table.hook(i);
+            char const* name = table.string(hook.name);
+            if (hook.kind == MachineTable::GUARD)
+                m_guards[i] = registry.findGuard(name);
+            else
+                m_actions[i] = registry.findAction(name);
+            if ((m_guards[i] == nullptr) && (m_actions[i] == nullptr) &&
+                (hook.code == MachineTable::NONE))
+            {
+                LOGE("[INTERPRETER] No callback registered for %s\n", name);
+                m_bound = false;
+            }
+        }
+    }
+
+    //--------------------------------------------------------------------------
+    //! \brief Return true if all hooks have their callback.
+    //--------------------------------------------------------------------------
+    inline bool isBound() const
+    {
+        return m_bound;
+    }
+
+    inline MachineTable const& table() const { return m_table; }
+    inline Guard guard(uint16_t const hook) const { return m_guards[hook]; }
+    inline Action action(uint16_t const hook) const { return m_actions[hook]; }
+
+private:
+
+    MachineTable const& m_table;
+    std::vector<Guard> m_guards;
+    std::vector<Action> m_actions;
+    bool m_bound = true;
+};
+
+// *****************************************************************************
+//! \brief Instance of a state machine executed from its tables. The semantic
+//! is the one of the generated C++ classes: nested state machines react first
+//! to external events, guards of transitions reacting to the same event are
+//! evaluated in order, choice and junction pseudo-states are traversed within
+//! the transition, eventless transitions are taken when entering their origin
+//! state, and nested state machines are entered after the entering action of
+//! their composite state and exited before its leaving action.
+//!
+//! Events sent by callbacks while reacting are queued and processed once the
+//! current event has been reacted (run to completion).
+//!
+//! The instance does not allocate memory: its slots and the current state of
+//! each state machine are stored in a block given by the caller (see
+//! \c storage), so a pool of instances can share a single allocation.
+//!
+//! Variables read and written by the bytecode are slots of the instance,
+//! initialized from the tables. Parameters of data events used by the bytecode
+//! shall be stored in their slot before reacting.
+//!
+//! Instances can be migrated to a new version of their tables without being
+//! restarted (see \c migrate).
+//!
+//! \tparam CONTEXT the data of a state machine instance.
+// *****************************************************************************
+template<class CONTEXT>
+class MachineInterpreter
+{
+public:
+
+    //--------------------------------------------------------------------------
+    //! \brief Return the size in bytes of the memory block of an instance
+    //! running the given tables: its slots then the current state of each
+    //! state machine, rounded up to keep the next block of a pool aligned.
+    //--------------------------------------------------------------------------
+    static inline size_t storage(MachineTable const& table)
+    {
+        size_t const bytes = table.header().slots * sizeof(MachineValue)
+                           + table.header().machines * sizeof(uint16_t);
+        return (bytes + sizeof(MachineValue) - 1u) / sizeof(MachineValue) * sizeof(MachineValue);
+    }
+
+    //--------------------------------------------------------------------------
+    //! \brief Create an inactive instance of the state machine.
+    //! \param[in] program bound tables. They shall outlive this instance.
+    //! \param[in] context the data passed to callbacks.
+    //! \param[in] memory block holding the slots and the current states of the
+    //! instance, aligned on MachineValue. It shall outlive this instance.
+    //! \param[in] size the size in bytes of the block: at least
+    //! storage(program.table()), more to migrate to bigger tables.
+    //--------------------------------------------------------------------------
+    MachineInterpreter(MachineProgram<CONTEXT> const& program, CONTEXT& context,
+                       void* const memory, size_t const size)
+        : m_program(&program), m_table(&program.table()), m_context(context),
+          m_memory(memory), m_size(size)
+    {
+        assert(program.isBound());
+        assert(size >= storage(*m_table));
+        assert(reinterpret_cast<uintptr_t>(memory) % alignof(MachineValue) == 0u);
+        layout(*m_table);
+    }
+
+    //--------------------------------------------------------------------------
+    //! \brief Reset the state machine and do the initial transition.
+    //--------------------------------------------------------------------------
+    void enter()
+    {
+        LOGD("[INTERPRETER] Restart the state machine\n");
+        exitMachine(0u);
+        m_first = m_count = 0u;
+        m_reacting = true;
+        enterMachine(0u);
+        drain();
+    }
+
+    //--------------------------------------------------------------------------
+    //! \brief Deactivate the state machine and its nested state machines.
+    //--------------------------------------------------------------------------
+    inline void exit()
+    {
+        exitMachine(0u);
+    }
+
+    //--------------------------------------------------------------------------
+    //! \brief Check whether the state machine has been entered.
+    //--------------------------------------------------------------------------
+    inline bool isActive() const
+    {
+        return m_current[0] != MachineTable::NONE;
+    }
+
+    //--------------------------------------------------------------------------
+    //! \brief Return the current state of the given state machine (the root
+    //! one by default) or MachineTable::NONE if it is not active.
+    //--------------------------------------------------------------------------
+    inline uint16_t state(uint16_t const machine = 0u) const
+    {
+        return m_current[machine];
+    }
+
+    //--------------------------------------------------------------------------
+    //! \brief Return the current state of the given state machine as string.
+    //--------------------------------------------------------------------------
+    inline const char* c_str(uint16_t const machine = 0u) const
+    {
+        uint16_t const current = m_current[machine];
+        return (current == MachineTable::NONE) ? "--"
+            : m_table->string(m_table->state(current).name);
+    }
+
+    //--------------------------------------------------------------------------
+    //! \brief Return the slot of the given identifier (see
+    //! MachineTable::findSlot).
+    //--------------------------------------------------------------------------
+    inline MachineValue& slot(uint16_t const id)
+    {
+        return m_slots[id];
+    }
+
+    //--------------------------------------------------------------------------
+    //! \brief External event. Data of data events shall be stored in the
+    //! context (or in their slot) before calling this method.
+    //! \param[in] event the identifier of the event (see MachineTable::findEvent).
+    //--------------------------------------------------------------------------
+    void react(uint16_t const event)
+    {
+        if (!isActive())
+            return ;
+
+        // Event sent by a callback: react once the current event is done.
+        if (m_reacting)
+        {
+            if (m_count < MAX_PENDING)
+            {
+                m_pending[(m_first + m_count++) % MAX_PENDING] = event;
+            }
+            if (m_count >= MAX_PENDING)
+            {
+                LOGE("[INTERPRETER] Infinite loop detected. Abort!\n");
+                FSM_FATAL();
+            }
+            return ;
+        }
+
+        m_reacting = true;
+        dispatch(0u, event);
+        drain();
+    }
+
+    //--------------------------------------------------------------------------
+    //! \brief Migrate running instances to a new version of their tables
+    //! (hot reload). Instances keep their current states and the values of
+    //! their slots through the given mapping. Composite states that appeared
+    //! get their nested state machine entered, and state machines whose state
+    //! has been removed restart from their initial pseudo-state: the entering
+    //! actions of these states are called with the new program.
+    //!
+    //! Migrate at a quiescent point: between two run-to-completion steps, and
+    //! all instances sharing the old program before releasing it.
+    //! \param[in] instances the pool of instances running the old tables.
+    //! \param[in] count the number of instances.
+    //! \param[in] program new bound tables. They shall outlive the instances.
+    //! \param[in] migration mapping from the old tables to the new ones.
+    //! \return the number of migrated instances: instances reacting to an
+    //! event, running other tables or whose memory block is too small for the
+    //! new tables are not migrated.
+    //--------------------------------------------------------------------------
+    static size_t migrate(MachineInterpreter* const instances[], size_t const count,
+                          MachineProgram<CONTEXT> const& program,
+                          MachineMigration const& migration)
+    {
+        assert(program.isBound());
+        size_t migrated = 0u;
+        MachineTable const* from = nullptr;
+        std::vector<MachineValue> scratch;
+        for (size_t i = 0u; i < count; ++i)
+        {
+            MachineInterpreter& instance = *instances[i];
+            if (instance.m_reacting)
+            {
+                LOGE("[INTERPRETER] Cannot migrate an instance reacting to an event\n");
+                continue ;
+            }
+            if (instance.m_size < storage(program.table()))
+            {
+                LOGE("[INTERPRETER] Cannot migrate an instance whose memory block is too small\n");
+                continue ;
+            }
+            // Check the mapping once for all instances running the same tables
+            if (instance.m_table != from)
+            {
+                if (!migration.matches(*instance.m_table, program.table()))
+                    continue ;
+                from = instance.m_table;
+            }
+            instance.remap(program, migration, scratch);
+            ++migrated;
+        }
+        return migrated;
+    }
+
+    //--------------------------------------------------------------------------
+    //! \brief Migrate this instance to a new version of its tables (see the
+    //! static method).
+    //! \return true if the instance has been migrated.
+    //--------------------------------------------------------------------------
+    inline bool migrate(MachineProgram<CONTEXT> const& program,
+                        MachineMigration const& migration)
+    {
+        MachineInterpreter* const instance = this;
+        return migrate(&instance, 1u, program, migration) == 1u;
+    }
+
+private:
+
+    //! \brief Maximum number of chained choice or junction pseudo-states
+    //! traversed by a single transition.
+    static constexpr size_t MAX_PSEUDO_STATES = 8u;
+
+    //! \brief Capacity of the ring buffer of events sent by callbacks: more
+    //! pending events means an infinite loop.
+    static constexpr uint8_t MAX_PENDING = 16u;
+
+    //--------------------------------------------------------------------------
+    //! \brief Place the slots and the current states of the given tables in
+    //! the memory block, and initialize them.
+    //--------------------------------------------------------------------------
+    void layout(MachineTable const& table)
+    {
+        m_slots = static_cast<MachineValue*>(m_memory);
+        m_current = reinterpret_cast<uint16_t*>(m_slots + table.header().slots);
+        for (uint16_t i = 0u; i < table.header().slots; ++i)
+        {
+            m_slots[i] = table.slot(i).initial;
+        }
+        for (uint16_t m = 0u; m < table.header().machines; ++m)
+        {
+            m_current[m] = MachineTable::NONE;
+        }
+    }
+
+    //--------------------------------------------------------------------------
+    //! \brief React to events sent by callbacks.
+    //--------------------------------------------------------------------------
+    void drain()
+    {
+        while (m_count != 0u)
+        {
+            uint16_t const event = m_pending[m_first];
+            m_first = uint8_t((m_first + 1u) % MAX_PENDING);
+            --m_count;
+            if (isActive())
+                dispatch(0u, event);
+        }
+        m_reacting = false;
+    }
+
+    //--------------------------------------------------------------------------
+    //! \brief Make the given state machine react to the event after its active
+    //! nested state machine.
+    //--------------------------------------------------------------------------
+    void dispatch(uint16_t const machine, uint16_t const event)
+    {
+        uint16_t const child = m_table->state(m_current[machine]).child;
+        if ((child != MachineTable::NONE) && (m_current[child] != MachineTable::NONE))
+        {
+            dispatch(child, event);
+        }
+        if (fire(machine, event))
+        {
+            settle(machine);
+        }
+    }
+
+    //--------------------------------------------------------------------------
+    //! \brief Take the eventless transitions of the current state until a state
+    //! has none whose guard is true. Same bound than generated state machines
+    //! (see StateMachineEngine::MAX_TRANSITIONS).
+    //--------------------------------------------------------------------------
+    void settle(uint16_t const machine)
+    {
+        size_t transitions = 0u;
+        while (fire(machine, MachineTable::NONE))
+        {
+            if (++transitions > StateMachineEngine::MAX_TRANSITIONS)
+            {
+                LOGE("[INTERPRETER] Infinite loop detected. Abort!\n");
+                FSM_FATAL();
+            }
+        }
+    }
+
+    //--------------------------------------------------------------------------
+    //! \brief Return the first transition of the guard chain starting at the
+    //! given transition whose guard is true, or nullptr.
+    //--------------------------------------------------------------------------
+    MachineTable::Transition const*
+    select(MachineTable::Transition const* tr, MachineTable::Transition const* end)
+    {
+        uint16_t const event = tr->event;
+        for (; (tr != end) && (tr->event == event); ++tr)
+        {
+            if ((tr->guard == MachineTable::NONE) || check(tr->guard))
+                return tr;
+        }
+        return nullptr;
+    }
+
+    //--------------------------------------------------------------------------
+    //! \brief Do the transition of the current state of the given state machine
+    //! reacting to the event (NONE for eventless transitions).
+    //! \return true if a state has been entered (eventless transitions of the
+    //! new state shall be taken).
+    //--------------------------------------------------------------------------
+    bool fire(uint16_t const machine, uint16_t const event)
+    {
+        uint16_t const current = m_current[machine];
+        MachineTable::State const& cst = m_table->state(current);
+        MachineTable::Transition const* tr = &m_table->transition(cst.first_transition);
+        MachineTable::Transition const* end = tr + cst.transition_count;
+        while ((tr != end) && (tr->event != event))
+            ++tr;
+        if (tr == end)
+        {
+            if (event != MachineTable::NONE)
+            {
+                LOGD("[INTERPRETER] Ignoring external event\n");
+            }
+            return false;
+        }
+        tr = select(tr, end);
+        if (tr == nullptr)
+        {
+            LOGD("[INTERPRETER] Transition refused by guards. Stay in state %s\n",
+                 m_table->string(cst.name));
+            return false;
+        }
+
+        // Choice and junction pseudo-states: select their outgoing transitions
+        // before leaving the current state.
+        MachineTable::Transition const* branches[MAX_PSEUDO_STATES];
+        size_t count = 0u;
+        uint16_t target = tr->destination;
+        while (m_table->state(target).flags & MachineTable::PSEUDO_STATE)
+        {
+            if (count == MAX_PSEUDO_STATES)
+            {
+                LOGE("[INTERPRETER] Too many chained pseudo-states. Abort!\n");
+                FSM_FATAL();
+            }
+            MachineTable::State const& pst = m_table->state(target);
+            MachineTable::Transition const* first = &m_table->transition(pst.first_transition);
+            MachineTable::Transition const* branch =
+                (pst.transition_count == 0u) ? nullptr : select(first, first + pst.transition_count);
+            if (branch == nullptr)
+            {
+                LOGD("[INTERPRETER] No branch of the pseudo-state %s. Stay in state %s\n",
+                     m_table->string(pst.name), m_table->string(cst.name));
+                return false;
+            }
+            branches[count++] = branch;
+            target = branch->destination;
+        }
+
+        LOGD("[INTERPRETER] Transitioning from state %s to state %s\n",
+             m_table->string(cst.name), m_table->string(m_table->state(target).name));
+        bool const external = (target != current) || (count != 0u);
+        if (external)
+        {
+            leaveState(machine);
+        }
+        call(tr->action);
+        for (size_t i = 0u; i < count; ++i)
+        {
+            call(branches[i]->action);
+        }
+        if (external)
+        {
+            enterState(machine, target);
+        }
+        return external;
+    }
+
+    //--------------------------------------------------------------------------
+    //! \brief Remap current states and slots to the new tables then resume the
+    //! state machines whose state has been removed or added. The old values
+    //! are copied into the scratch buffer, shared by the migrated pool, since
+    //! the new ones are written in the same memory block.
+    //--------------------------------------------------------------------------
+    void remap(MachineProgram<CONTEXT> const& program, MachineMigration const& migration,
+               std::vector<MachineValue>& scratch)
+    {
+        MachineTable const& to = program.table();
+        uint16_t const slots = m_table->header().slots;
+        uint16_t const machines = m_table->header().machines;
+        bool const active = isActive();
+        scratch.assign(m_slots, m_slots + slots);
+        for (uint16_t m = 0u; m < machines; ++m)
+        {
+            MachineValue current;
+            current.i = m_current[m];
+            scratch.push_back(current);
+        }
+
+        MachineTable const& from = *m_table;
+        m_program = &program;
+        m_table = &to;
+        layout(to);
+        for (uint16_t m = 0u; active && (m < machines); ++m)
+        {
+            uint16_t const current = uint16_t(scratch[slots + m].i);
+            uint16_t const state = (current == MachineTable::NONE)
+                ? MachineTable::NONE : migration.state(current);
+            if (state != MachineTable::NONE)
+            {
+                m_current[to.state(state).machine] = state;
+            }
+        }
+        for (uint16_t i = 0u; i < slots; ++i)
+        {
+            uint16_t const slot = migration.slot(i);
+            if (slot != MachineTable::NONE)
+            {
+                m_slots[slot] = MachineTable::wrap(to.slot(slot), convert(scratch[i], from.slot(i).type,
+                                                                          to.slot(slot).type));
+            }
+        }
+        if (!active)
+            return ;
+
+        // Parents are listed before their nested state machines: deactivate
+        // nested state machines whose composite state is no longer current.
+        for (uint16_t m = 1u; m < to.header().machines; ++m)
+        {
+            MachineTable::Machine const& machine = to.machine(m);
+            if (m_current[machine.parent] != machine.owner)
+            {
+                m_current[m] = MachineTable::NONE;
+            }
+        }
+        m_reacting = true;
+        resume(0u);
+        drain();
+    }
+
+    //--------------------------------------------------------------------------
+    //! \brief Enter the given state machine if it has no current state, do its
+    //! initial transition if its state has been removed, else resume its
+    //! nested state machine.
+    //--------------------------------------------------------------------------
+    void resume(uint16_t const machine)
+    {
+        uint16_t const current = m_current[machine];
+        if (current == MachineTable::NONE)
+        {
+            enterMachine(machine);
+        }
+        else if (current == m_table->machine(machine).initial)
+        {
+            settle(machine);
+        }
+        else if (m_table->state(current).child != MachineTable::NONE)
+        {
+            resume(m_table->state(current).child);
+        }
+    }
+
+    //--------------------------------------------------------------------------
+    //! \brief Convert the value of a slot whose type has changed.
+    //--------------------------------------------------------------------------
+    static MachineValue convert(MachineValue const value, uint16_t const from, uint16_t const to)
+    {
+        MachineValue v;
+        if (from == to)
+            v = value;
+        else if (to == MachineTable::REAL)
+            v.f = double(value.i);
+        else if (from == MachineTable::REAL)
+            v.i = (to == MachineTable::BOOL) ? int64_t((value.f < 0.0) || (value.f > 0.0)) : int64_t(value.f);
+        else
+            v.i = (to == MachineTable::BOOL) ? int64_t(value.i != 0) : value.i;
+        return v;
+    }
+
+    //--------------------------------------------------------------------------
+    //! \brief Exit the nested state machine of the current state then call its
+    //! leaving action.
+    //--------------------------------------------------------------------------
+    void leaveState(uint16_t const machine)
+    {
+        MachineTable::State const& st = m_table->state(m_current[machine]);
+        if (st.child != MachineTable::NONE)
+        {
+            exitMachine(st.child);
+        }
+        call(st.leaving);
+    }
+
+    //--------------------------------------------------------------------------
+    //! \brief Make the given state current, call its entering action then enter
+    //! its nested state machine.
+    //--------------------------------------------------------------------------
+    void enterState(uint16_t const machine, uint16_t const state)
+    {
+        m_current[machine] = state;
+        MachineTable::State const& st = m_table->state(state);
+        call(st.entering);
+        if (st.child != MachineTable::NONE)
+        {
+            enterMachine(st.child);
+        }
+    }
+
+    //--------------------------------------------------------------------------
+    //! \brief Enter the given state machine from its initial pseudo-state.
+    //--------------------------------------------------------------------------
+    void enterMachine(uint16_t const machine)
+    {
+        m_current[machine] = m_table->machine(machine).initial;
+        settle(machine);
+    }
+
+    //--------------------------------------------------------------------------
+    //! \brief Deactivate the given state machine and its nested state machines
+    //! without calling leaving actions (like generated exit() methods).
+    //--------------------------------------------------------------------------
+    void exitMachine(uint16_t const machine)
+    {
+        uint16_t const current = m_current[machine];
+        if (current == MachineTable::NONE)
+            return ;
+        uint16_t const child = m_table->state(current).child;
+        if (child != MachineTable::NONE)
+        {
+            exitMachine(child);
+        }
+        m_current[machine] = MachineTable::NONE;
+    }
+
+    //--------------------------------------------------------------------------
+    //! \brief Return the result of the given guard hook.
+    //--------------------------------------------------------------------------
+    inline bool check(uint16_t const hook)
+    {
+        typename MachineProgram<CONTEXT>::Guard const guard = m_program->guard(hook);
+        return (guard != nullptr) ? guard(m_context) : execute(m_table->hook(hook).code);
+    }
+
+    //--------------------------------------------------------------------------
+    //! \brief Do the given action hook if any.
+    //--------------------------------------------------------------------------
+    inline void call(uint16_t const hook)
+    {
+        if (hook != MachineTable::NONE)
+        {
+            typename MachineProgram<CONTEXT>::Action const action = m_program->action(hook);
+            if (action != nullptr)
+                action(m_context);
+            else
+                execute(m_table->hook(hook).code);
+        }
+    }
+
+    //--------------------------------------------------------------------------
+    //! \brief Run the bytecode starting at the given instruction.
+    //! \return the result of a guard (true for actions).
+    //--------------------------------------------------------------------------
+    bool execute(uint16_t pc)
+    {
+        // Registers read before being written by a table file hold zero
+        MachineValue r[MachineTable::REGISTERS] = {};
+        while (true)
+        {
+            MachineTable::Instruction const& in = m_table->instruction(pc++);
+            MachineValue& d = r[in.dst];
+            MachineValue const& a = r[in.a];
+            MachineValue const& b = r[in.b];
+            switch (in.op)
+            {
+            case MachineTable::LOAD: d = m_slots[in.k]; break;
+            case MachineTable::STORE: m_slots[in.k] = MachineTable::wrap(m_table->slot(uint16_t(in.k)), a); break;
+            case MachineTable::CONST: d = m_table->constant(uint16_t(in.k)); break;
+            case MachineTable::ITOF: d.f = double(a.i); break;
+            case MachineTable::FTOI: d.i = int64_t(a.f); break;
+            case MachineTable::BOOLI: d.i = (a.i != 0); break;
+            // Overflows wrap (two's complement) instead of being undefined
+            case MachineTable::ADDI: d.i = int64_t(uint64_t(a.i) + uint64_t(b.i)); break;
+            case MachineTable::SUBI: d.i = int64_t(uint64_t(a.i) - uint64_t(b.i)); break;
+            case MachineTable::MULI: d.i = int64_t(uint64_t(a.i) * uint64_t(b.i)); break;
+            case MachineTable::DIVI: d.i = a.i / divisor(a.i, b.i); break;
+            case MachineTable::MODI: d.i = a.i % divisor(a.i, b.i); break;
+            case MachineTable::NEGI: d.i = int64_t(0u - uint64_t(a.i)); break;
+            case MachineTable::ADDF: d.f = a.f + b.f; break;
+            case MachineTable::SUBF: d.f = a.f - b.f; break;
+            case MachineTable::MULF: d.f = a.f * b.f; break;
+            case MachineTable::DIVF: d.f = a.f / b.f; break;
+            case MachineTable::NEGF: d.f = -a.f; break;
+            case MachineTable::EQI: d.i = (a.i == b.i); break;
+            case MachineTable::NEI: d.i = (a.i != b.i); break;
+            case MachineTable::LTI: d.i = (a.i < b.i); break;
+            case MachineTable::LEI: d.i = (a.i <= b.i); break;
+            case MachineTable::GTI: d.i = (a.i > b.i); break;
+            case MachineTable::GEI: d.i = (a.i >= b.i); break;
+            case MachineTable::EQF: d.i = (a.f <= b.f) && (a.f >= b.f); break;
+            case MachineTable::NEF: d.i = !((a.f <= b.f) && (a.f >= b.f)); break;
+            case MachineTable::LTF: d.i = (a.f < b.f); break;
+            case MachineTable::LEF: d.i = (a.f <= b.f); break;
+            case MachineTable::GTF: d.i = (a.f > b.f); break;
+            case MachineTable::GEF: d.i = (a.f >= b.f); break;
+            case MachineTable::NOT: d.i = (a.i == 0); break;
+            case MachineTable::JZ: if (a.i == 0) pc = uint16_t(in.k); break;
+            case MachineTable::JNZ: if (a.i != 0) pc = uint16_t(in.k); break;
+            case MachineTable::RET: return a.i != 0;
+            default: return true;
+            }
+        }
+    }
+
+    //--------------------------------------------------------------------------
+    //! \brief Check the divisor of the integer division of a by b: division
+    //! by zero and INT64_MIN / -1 (overflow) are undefined.
+    //--------------------------------------------------------------------------
+    static inline int64_t divisor(int64_t const a, int64_t const b)
+    {
+        if (b == 0)
+        {
+            LOGE("[INTERPRETER] Division by zero. Abort!\n");
+            FSM_FATAL();
+        }
+        if ((b == -1) && (a == INT64_MIN))
+        {
+            LOGE("[INTERPRETER] Overflow of the integer division. Abort!\n");
+            FSM_FATAL();
+        }
+        return b;
+    }
+
+private:
+
+    //! \brief Bound tables shared by instances.
+    MachineProgram<CONTEXT> const* m_program;
+    //! \brief Tables of the program.
+    MachineTable const* m_table;
+    //! \brief Data passed to callbacks.
+    CONTEXT& m_context;
+    //! \brief Block holding the slots and the current states.
+    void* m_memory;
+    //! \brief Size in bytes of the memory block.
+    size_t m_size;
+    //! \brief Variables of the instance used by the bytecode.
+    MachineValue* m_slots;
+    //! \brief Current state of each state machine (NONE when not active).
+    uint16_t* m_current;
+    //! \brief Ring buffer of the events sent by callbacks while reacting.
+    uint16_t m_pending[MAX_PENDING];
+    //! \brief Index of the oldest pending event.
+    uint8_t m_first = 0u;
+    //! \brief Number of pending events.
+    uint8_t m_count = 0u;
+    //! \brief Reacting to an event.
+    bool m_reacting = false;
+};
+
+#endif // INTERPRETER_HPP
@@ -0,0 +1,646 @@
+// ############################################################################
+// MIT License
+//
+// Copyright (c) 2022 Quentin Quadrat
+//
+// Permission is hereby granted, free of charge, to any person obtaining a copy
+// of this software and associated documentation files (the "Software"), to deal
+// in the Software without restriction, including without limitation the rights
+// to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+// copies of the Software, and to permit persons to whom the Software is
+// furnished to do so, subject to the following conditions:
+//
+// The above copyright notice and this permission notice shall be included in all
+// copies or substantial portions of the Software.
+//
+// THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+// IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+// FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+// AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+// LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+// OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+// SOFTWARE.
+// ############################################################################
+
+#ifndef MODEL_CHECKER_HPP
+#  define MODEL_CHECKER_HPP
+
+// Fatal errors of state machines (forbidden events, infinite loops ...) are
+// reported as counterexamples instead of stopping the process. This header
+// shall be included before the generated state machine.
+#  if defined(STATE_MACHINE_HPP)
+#    error "ModelChecker.hpp shall be included before StateMachine.hpp"
+#  endif
+#  define FSM_MODEL_CHECK
+#  define FSM_MOCKED_GUARDS
+#  define LOGE(...) ModelOracle::error(__VA_ARGS__)
+#  define FSM_FATAL() throw ModelOracle::Fatal()
+
+#  include <algorithm>
+#  include <atomic>
+#  include <chrono>
+#  include <cstdarg>
+#  include <cstdint>
+#  include <cstdio>
+#  include <cstring>
+#  include <memory>
+#  include <mutex>
+#  include <string>
+#  include <thread>
+#  include <vector>
+
+// *****************************************************************************
+//! \brief Nondeterministic guards of the state machines explored by the model
+//! checker. Generated guards (option --model-check) return the next outcome
+//! given to the oracle instead of evaluating their C++ condition, and actions
+//! are not run: the model checker explores the control part of the state
+//! machine (its configurations) for all outcomes of the guards of a step.
+//! Guards of a chain following the true one are evaluated too, so the
+//! outcomes where two of them are true are explored and reported: the state
+//! machine takes the first one, which may not be the intent of the diagram.
+//! The oracle is per thread.
+// *****************************************************************************
+class ModelOracle
+{
+public:
+
+    //! \brief Maximum number of guards evaluated by a step whose outcomes are
+    //! explored. Outcomes of the following guards are false.
+    static constexpr size_t MAX_GUARDS = 32u;
+
+    //--------------------------------------------------------------------------
+    //! \brief Exception thrown by a state machine on a fatal error.
+    //--------------------------------------------------------------------------
+    struct Fatal {};
+
+    //--------------------------------------------------------------------------
+    //! \brief Return the outcome of the next guard of the step.
+    //--------------------------------------------------------------------------
+    static bool guard()
+    {
+        Data& d = data();
+        bool const outcome = (d.count < MAX_GUARDS) && (((d.outcomes >> d.count) & 1u) != 0u);
+        ++d.count;
+        return outcome;
+    }
+
+    //--------------------------------------------------------------------------
+    //! \brief Start a step whose guards will return the given outcomes: bit i
+    //! is the outcome of the i-th guard evaluated.
+    //--------------------------------------------------------------------------
+    static void reset(uint32_t const outcomes)
+    {
+        Data& d = data();
+        d.outcomes = outcomes;
+        d.count = 0u;
+        d.error[0] = '\0';
+        d.overlap[0] = '\0';
+    }
+
+    //--------------------------------------------------------------------------
+    //! \brief Return the number of guards evaluated since the start of the
+    //! step.
+    //--------------------------------------------------------------------------
+    static size_t count()
+    {
+        return data().count;
+    }
+
+    //--------------------------------------------------------------------------
+    //! \brief Memorize the last error logged by the state machine.
+    //--------------------------------------------------------------------------
+    static void error(const char* format, ...)
+    {
+        va_list args;
+        va_start(args, format);
+        vsnprintf(data().error, sizeof(Data::error), format, args);
+        va_end(args);
+    }
+
+    //--------------------------------------------------------------------------
+    //! \brief Return the last error logged by the state machine.
+    //--------------------------------------------------------------------------
+    static const char* error()
+    {
+        return data().error;
+    }
+
+    //--------------------------------------------------------------------------
+    //! \brief Memorize the first pair of guards of a chain both true during
+    //! the step.
+    //--------------------------------------------------------------------------
+    static void overlap(const char* format, ...)
+    {
+        if (data().overlap[0] != '\0')
+            return ;
+        va_list args;
+        va_start(args, format);
+        vsnprintf(data().overlap, sizeof(Data::overlap), format, args);
+        va_end(args);
+    }
+
+    //--------------------------------------------------------------------------
+    //! \brief Return the pair of guards of a chain both true during the step
+    //! (empty if none).
+    //--------------------------------------------------------------------------
+    static const char* overlap()
+    {
+        return data().overlap;
+    }
+
+private:
+
+    //! \brief State of the oracle of the thread.
+    struct Data
+    {
+        uint32_t outcomes = 0u;
+        size_t count = 0u;
+        char error[128] = { '\0' };
+        char overlap[160] = { '\0' };
+    };
+
+    static Data& data()
+    {
+        static thread_local Data d;
+        return d;
+    }
+};
+
+// *****************************************************************************
+//! \brief Save and restore the data of the state machines not packed in their
+//! configuration word (histories, synchronization of orthogonal regions and
+//! scalar variables), used by the snapshot() and restore() methods generated
+//! with the option --model-check.
+// *****************************************************************************
+struct ModelSnapshot
+{
+    template<class T>
+    static inline void save(uint8_t*& data, T const& value)
+    {
+        static_assert(std::is_trivially_copyable<T>::value, "Data shall be trivially copyable");
+        std::memcpy(data, &value, sizeof(T));
+        data += sizeof(T);
+    }
+
+    template<class T>
+    static inline void load(uint8_t const*& data, T& value)
+    {
+        std::memcpy(&value, data, sizeof(T));
+        data += sizeof(T);
+    }
+};
+
+#  include "StateMachine.hpp"
+
+// *****************************************************************************
+//! \brief Explicit-state model checker of a generated state machine (option
+//! --model-check generates its main function). Starting from the outcomes of
+//! entering the state machine, it explores breadth-first the configurations
+//! reachable by any sequence of external events and any outcomes of the
+//! guards. A configuration is the configuration word packing the current
+//! states of the root and nested state machines, including orthogonal regions,
+//! and the snapshot of their histories, synchronization of join pseudo-states
+//! and scalar variables. Each level of the search is shared by all cores and
+//! configurations are deduplicated by a lock-free hash set. Fatal errors (i.e.
+//! reaching CANNOT_HAPPEN, cycles of eventless transitions) are reported with
+//! the shortest sequence of events and guard outcomes leading to them, and so
+//! are the configurations where two guards of a chain can be both true (the
+//! guards are not mutually exclusive: the first one wins).
+//!
+//! A configuration is restored in a new instance by the generated restore()
+//! method: nested state machines are constructed in their states without
+//! replaying the events leading to them, so state machines do not need to be
+//! copyable.
+//!
+//! \tparam FSM the generated state machine class (default constructible).
+// *****************************************************************************
+template<class FSM>
+class ModelChecker
+{
+public:
+
+    //! \brief React to an external event: 0 enters the state machine, other
+    //! values are the external events in the order of their names.
+    using Step = void (*)(FSM& fsm, size_t const event);
+
+    //--------------------------------------------------------------------------
+    //! \brief Bind the model checker to the events of the state machine.
+    //! \param[in] events the names of the events (the first is "enter").
+    //! \param[in] count the number of events.
+    //! \param[in] step the function reacting to an event.
+    //--------------------------------------------------------------------------
+    ModelChecker(const char* const* events, size_t const count, Step const step)
+        : m_events(events), m_count(count), m_step(step)
+    {}
+
+    //--------------------------------------------------------------------------
+    //! \brief Explore the reachable configurations and print the report.
+    //! \param[in] name the name of the state machine (for the report).
+    //! \param[in] limit the maximum number of configurations explored.
+    //! \param[in] threads the number of threads (0: one by core).
+    //! \return true if no fatal error is reachable.
+    //--------------------------------------------------------------------------
+    bool run(const char* const name, size_t const limit, size_t threads = 0u)
+    {
+        if (threads == 0u)
+            threads = std::max<size_t>(1u, std::thread::hardware_concurrency());
+
+        auto const start = std::chrono::steady_clock::now();
+        m_nodes.clear();
+        m_failures.clear();
+        m_overlaps.clear();
+        m_visited.reset();
+        bool truncated = false;
+
+        // Configurations reached by entering the state machine
+        std::vector<Found> found(1u);
+        successors(NONE, 0u, 1u, found[0]);
+        merge(found);
+
+        // Breadth-first search, level by level
+        size_t depth = 0u;
+        size_t first = 0u;
+        while (first < m_nodes.size())
+        {
+            if (m_nodes.size() >= limit)
+            {
+                truncated = true;
+                break;
+            }
+            size_t const last = m_nodes.size();
+            std::atomic<size_t> next(first);
+            found.assign(threads, Found());
+            std::vector<std::thread> workers;
+            for (size_t t = 0u; t < threads; ++t)
+            {
+                workers.emplace_back([this, &next, last, &found, t]() {
+                    constexpr size_t CHUNK = 64u;
+                    size_t begin;
+                    while ((begin = next.fetch_add(CHUNK)) < last)
+                    {
+                        size_t const end = std::min(begin + CHUNK, last);
+                        for (size_t n = begin; n < end; ++n)
+                            successors(uint32_t(n), 1u, m_count, found[t]);
+                    }
+                });
+            }
+            for (auto& w: workers)
+                w.join();
+            merge(found);
+            first = last;
+            if (m_nodes.size() > last)
+                ++depth;
+        }
+
+        auto const stop = std::chrono::steady_clock::now();
+        double const seconds = double(std::chrono::duration_cast<std::chrono::milliseconds>(
+            stop - start).count()) / 1000.0;
+        printf("%s: %zu configurations, depth %zu, %zu events, %zu threads, %.2f s\n",
+               name, m_nodes.size(), depth, m_count - 1u, threads, seconds);
+        if (truncated)
+            printf("  Exploration stopped after %zu configurations\n", limit);
+        for (auto const& o: m_overlaps)
+            report(o, false);
+        if (m_failures.empty())
+            printf("  No fatal error is reachable\n");
+        for (auto const& f: m_failures)
+            report(f, true);
+        return m_failures.empty();
+    }
+
+private:
+
+    //! \brief No configuration.
+    static constexpr uint32_t NONE = 0xFFFFFFFFu;
+
+    //--------------------------------------------------------------------------
+    //! \brief Configuration word followed by the snapshot of the data of the
+    //! state machines.
+    //--------------------------------------------------------------------------
+    struct Key
+    {
+        uint8_t bytes[sizeof(uint64_t) + FSM::SNAPSHOT];
+
+        Key() : bytes{} {}
+
+        //! \brief Save the configuration of the given state machine.
+        explicit Key(FSM const& fsm)
+        {
+            uint8_t* data = bytes;
+            ModelSnapshot::save(data, fsm.configuration());
+            fsm.snapshot(data);
+            std::memset(data, 0, size_t(bytes + sizeof(bytes) - data));
+        }
+
+        //! \brief Restore the configuration in the given new state machine.
+        void restore(FSM& fsm) const
+        {
+            uint8_t const* data = bytes;
+            uint64_t configuration;
+            ModelSnapshot::load(data, configuration);
+            fsm.restore(configuration, data);
+        }
+
+        bool operator==(Key const& other) const
+        {
+            return std::memcmp(bytes, other.bytes, sizeof(bytes)) == 0;
+        }
+
+        uint64_t hash() const
+        {
+            uint64_t h = UINT64_C(0xCBF29CE484222325);
+            for (uint8_t const b: bytes)
+                h = (h ^ b) * UINT64_C(0x100000001B3);
+            return h ^ (h >> 32u);
+        }
+    };
+
+    //--------------------------------------------------------------------------
+    //! \brief Configuration reached by an event from its parent configuration.
+    //--------------------------------------------------------------------------
+    struct Node
+    {
+        //! \brief The configuration.
+        Key configuration;
+        //! \brief The index of the parent node (NONE for entering).
+        uint32_t parent;
+        //! \brief The outcomes of the guards evaluated by the event.
+        uint32_t outcomes;
+        //! \brief The event.
+        uint16_t event;
+        //! \brief The number of guards evaluated by the event.
+        uint16_t guards;
+    };
+
+    //--------------------------------------------------------------------------
+    //! \brief Fatal error, or guards both true, with its counterexample.
+    //--------------------------------------------------------------------------
+    struct Failure
+    {
+        std::string error;
+        Node last;
+    };
+
+    // *************************************************************************
+    //! \brief Lock-free set of configurations (open addressing, linear
+    //! probing). It is filled concurrently during a level of the search and
+    //! grown between two levels. A slot is claimed by the thread writing its
+    //! key: other threads wait for the key before comparing it.
+    // *************************************************************************
+    class VisitedSet
+    {
+    public:
+
+        //! \brief Result of an insertion.
+        enum class Insert { NEW, PRESENT, FULL };
+
+        //! \brief Empty the set.
+        void reset()
+        {
+            allocate(CAPACITY);
+        }
+
+        //! \brief Insert the given configuration (thread-safe). The set is full
+        //! when 3/4 of its slots are used: the configuration shall be inserted
+        //! again after grow().
+        Insert insert(Key const& key)
+        {
+            size_t i = size_t(key.hash()) & (m_capacity - 1u);
+            while (true)
+            {
+                uint8_t state = m_states[i].load(std::memory_order_acquire);
+                if (state == EMPTY)
+                {
+                    if (m_size.load(std::memory_order_relaxed) >= m_capacity / 4u * 3u)
+                        return Insert::FULL;
+                    if (m_states[i].compare_exchange_strong(state, WRITING))
+                    {
+                        m_keys[i] = key;
+                        m_states[i].store(USED, std::memory_order_release);
+                        m_size.fetch_add(1u, std::memory_order_relaxed);
+                        return Insert::NEW;
+                    }
+                }
+                while (state == WRITING)
+                    state = m_states[i].load(std::memory_order_acquire);
+                if (m_keys[i] == key)
+                    return Insert::PRESENT;
+                i = (i + 1u) & (m_capacity - 1u);
+            }
+        }
+
+        //! \brief Double the capacity (not thread-safe: between two levels).
+        void grow()
+        {
+            std::unique_ptr<std::atomic<uint8_t>[]> states(std::move(m_states));
+            std::vector<Key> keys(std::move(m_keys));
+            size_t const capacity = m_capacity;
+            allocate(2u * capacity);
+            for (size_t i = 0u; i < capacity; ++i)
+            {
+                if (states[i].load(std::memory_order_relaxed) == USED)
+                    insert(keys[i]);
+            }
+        }
+
+    private:
+
+        //! \brief Initial number of slots (power of two).
+        static constexpr size_t CAPACITY = 4096u;
+        //! \brief States of the slots.
+        static constexpr uint8_t EMPTY = 0u;
+        static constexpr uint8_t WRITING = 1u;
+        static constexpr uint8_t USED = 2u;
+
+        void allocate(size_t const capacity)
+        {
+            m_capacity = capacity;
+            m_states.reset(new std::atomic<uint8_t>[capacity]);
+            for (size_t i = 0u; i < capacity; ++i)
+                m_states[i].store(EMPTY, std::memory_order_relaxed);
+            m_keys.assign(capacity, Key());
+            m_size.store(0u);
+        }
+
+    private:
+
+        std::unique_ptr<std::atomic<uint8_t>[]> m_states;
+        std::vector<Key> m_keys;
+        std::atomic<size_t> m_size{0u};
+        size_t m_capacity = 0u;
+    };
+
+    //--------------------------------------------------------------------------
+    //! \brief Configurations found by a thread during a level of the search.
+    //--------------------------------------------------------------------------
+    struct Found
+    {
+        //! \brief New configurations.
+        std::vector<Node> nodes;
+        //! \brief Configurations not inserted because the visited set was full.
+        std::vector<Node> pending;
+    };
+
+    //--------------------------------------------------------------------------
+    //! \brief Explore the given events from the configuration of the given
+    //! node for all outcomes of the guards they evaluate, and collect the new
+    //! configurations.
+    //--------------------------------------------------------------------------
+    void successors(uint32_t const node, size_t const first, size_t const last, Found& found)
+    {
+        for (size_t event = first; event < last; ++event)
+            successors(node, event, found);
+    }
+
+    //--------------------------------------------------------------------------
+    //! \brief Explore the given event from the configuration of the given node
+    //! (NONE: a new instance) for all outcomes of the guards it evaluates.
+    //--------------------------------------------------------------------------
+    void successors(uint32_t const node, size_t const event, Found& found)
+    {
+        uint32_t outcomes = 0u;
+        while (true)
+        {
+            FSM fsm;
+            if (node != NONE)
+            {
+                m_nodes[node].configuration.restore(fsm);
+                assert(Key(fsm) == m_nodes[node].configuration);
+            }
+            ModelOracle::reset(outcomes);
+            Node const next = { Key(), node, outcomes, uint16_t(event), 0u };
+            size_t guards;
+            try
+            {
+                m_step(fsm, event);
+                guards = std::min(ModelOracle::count(), size_t(ModelOracle::MAX_GUARDS));
+                Node n = next;
+                n.configuration = Key(fsm);
+                n.guards = uint16_t(guards);
+                if (ModelOracle::overlap()[0] != '\0')
+                    memorize(m_overlaps, ModelOracle::overlap(), n);
+                auto const inserted = m_visited.insert(n.configuration);
+                if (inserted == VisitedSet::Insert::NEW)
+                    found.nodes.push_back(n);
+                else if (inserted == VisitedSet::Insert::FULL)
+                    found.pending.push_back(n);
+            }
+            catch (ModelOracle::Fatal const&)
+            {
+                guards = std::min(ModelOracle::count(), size_t(ModelOracle::MAX_GUARDS));
+                Node n = next;
+                n.guards = uint16_t(guards);
+                if (ModelOracle::overlap()[0] != '\0')
+                    memorize(m_overlaps, ModelOracle::overlap(), n);
+                memorize(m_failures, ModelOracle::error(), n);
+            }
+
+            // Next outcomes of the evaluated guards (depth-first enumeration:
+            // guards evaluated after a changed outcome may differ)
+            size_t j = guards;
+            while ((j != 0u) && (((outcomes >> (j - 1u)) & 1u) != 0u))
+                --j;
+            if (j == 0u)
+                return ;
+            outcomes = (outcomes & ((uint32_t(1u) << (j - 1u)) - 1u)) | (uint32_t(1u) << (j - 1u));
+        }
+    }
+
+    //--------------------------------------------------------------------------
+    //! \brief Append the configurations found by the threads during a level,
+    //! growing the visited set for those which did not fit.
+    //--------------------------------------------------------------------------
+    void merge(std::vector<Found>& found)
+    {
+        for (auto const& f: found)
+            m_nodes.insert(m_nodes.end(), f.nodes.begin(), f.nodes.end());
+        for (auto const& f: found)
+        {
+            for (auto const& n: f.pending)
+            {
+                auto inserted = m_visited.insert(n.configuration);
+                while (inserted == VisitedSet::Insert::FULL)
+                {
+                    m_visited.grow();
+                    inserted = m_visited.insert(n.configuration);
+                }
+                if (inserted == VisitedSet::Insert::NEW)
+                    m_nodes.push_back(n);
+            }
+        }
+    }
+
+    //--------------------------------------------------------------------------
+    //! \brief Memorize the first counterexample of the given fatal error or
+    //! guards both true.
+    //--------------------------------------------------------------------------
+    void memorize(std::vector<Failure>& failures, const char* const error, Node const& last)
+    {
+        std::lock_guard<std::mutex> lock(m_mutex);
+        for (auto const& f: failures)
+        {
+            if (f.error == error)
+                return ;
+        }
+        failures.push_back({ error, last });
+    }
+
+    //--------------------------------------------------------------------------
+    //! \brief Print the counterexample of a fatal error or of guards both
+    //! true (in the configuration reached before the last event).
+    //--------------------------------------------------------------------------
+    void report(Failure const& failure, bool const fatal) const
+    {
+        printf("  %s: %s", fatal ? "Fatal error" : "Guards not proven mutually exclusive",
+               failure.error.c_str());
+        std::vector<Node> path(1u, failure.last);
+        for (uint32_t n = failure.last.parent; n != NONE; n = m_nodes[n].parent)
+            path.push_back(m_nodes[n]);
+        FSM fsm;
+        for (auto it = path.rbegin(); it != path.rend(); ++it)
+        {
+            printf("    %s", m_events[it->event]);
+            if (it->guards != 0u)
+            {
+                printf(" [guards:");
+                for (size_t g = 0u; g < it->guards; ++g)
+                    printf(" %s", ((it->outcomes >> g) & 1u) ? "true" : "false");
+                printf("]");
+            }
+            if (it + 1 == path.rend())
+            {
+                if (fatal)
+                    printf(" -> fatal error\n");
+                else
+                    printf(" -> guards both true in configuration 0x%016llx\n",
+                           static_cast<unsigned long long>(fsm.configuration()));
+                break;
+            }
+            ModelOracle::reset(it->outcomes);
+            m_step(fsm, it->event);
+            printf(" -> %s (configuration 0x%016llx)\n", fsm.c_str(),
+                   static_cast<unsigned long long>(fsm.configuration()));
+        }
+    }
+
+private:
+
+    //! \brief Names of the events.
+    const char* const* m_events;
+    //! \brief Number of events.
+    size_t m_count;
+    //! \brief React to an event.
+    Step m_step;
+    //! \brief Reached configurations, level by level.
+    std::vector<Node> m_nodes;
+    //! \brief Configurations already reached.
+    VisitedSet m_visited;
+    //! \brief Fatal errors found.
+    std::vector<Failure> m_failures;
+    //! \brief Guards of a chain found both true.
+    std::vector<Failure> m_overlaps;
+    //! \brief Protect the fatal errors and the guards both true.
+    std::mutex m_mutex;
+};
+
+#endif // MODEL_CHECKER_HPP
@@ -27,7 +27,13 @@
 
 #  include <map>
 #  include <queue>
+#  include <tuple>
+#  include <vector>
+#  include <type_traits>
+#  include <new>
 #  include <cassert>
+#  include <cstdint>
+#  include <cstddef>
 #  include <stdlib.h>
 
 //-----------------------------------------------------------------------------
@@ -39,7 +45,47 @@
 #  else
 #    define LOGD(...)
 #  endif
-#  define LOGE printf
+#  if !defined(LOGE)
+#    define LOGE printf
+#  endif
+
+//-----------------------------------------------------------------------------
+//! \brief Stop the system on a fatal error of a state machine (forbidden
+//! event, infinite loop ...). The model checker reports the error instead.
+//-----------------------------------------------------------------------------
+#  if !defined(FSM_FATAL)
+#    define FSM_FATAL() ::exit(EXIT_FAILURE)
+#  endif
+
+//-----------------------------------------------------------------------------
+//! \brief Monotonic time in microseconds used by the filters of noisy events
+//! (debounce and throttle annotations). Define it before including this file
+//! to use the tick counter of the target.
+//-----------------------------------------------------------------------------
+#  if !defined(FSM_CLOCK_US)
+#    include <chrono>
+#    define FSM_CLOCK_US() uint64_t(std::chrono::duration_cast<std::chrono::microseconds>( \
+         std::chrono::steady_clock::now().time_since_epoch()).count())
+#  endif
+
+//-----------------------------------------------------------------------------
+//! \brief Name of a table of transitions of the data-only mode (option
+//! --data-only) depending on the hooks of the generated classes: virtual or not
+//! (MOCKABLE) and mocked guards or not (FSM_MOCKED_GUARDS). The files of tables
+//! and the code including the generated header shall define them the same way,
+//! else the link fails on the name of the tables.
+//-----------------------------------------------------------------------------
+#  define FSM_PASTE_(a, b) a ## b
+#  define FSM_PASTE(a, b) FSM_PASTE_(a, b)
+#  if (FSM_PASTE(MOCKABLE, 1) == 1) && !defined(FSM_MOCKED_GUARDS)
+#    define FSM_TABLE(name) name
+#  elif (FSM_PASTE(MOCKABLE, 1) == 1)
+#    define FSM_TABLE(name) name ## _mocked_guards
+#  elif !defined(FSM_MOCKED_GUARDS)
+#    define FSM_TABLE(name) name ## _virtual_hooks
+#  else
+#    define FSM_TABLE(name) name ## _virtual_hooks_mocked_guards
+#  endif
 
 //-----------------------------------------------------------------------------
 //! \brief Return the given state as raw string (they shall not be free).
@@ -48,6 +94,811 @@
 template<class STATES_ID>
 const char* stringify(STATES_ID const state);
 
+// *****************************************************************************
+//! \brief Buffer of deferred side effects. Actions of state machines generated
+//! with the option --deferred do not run their code inline: they push it as a
+//! command into the buffer bound to the state machine, and commands are run in
+//! order when the buffer is flushed. Side effects (logs, I/O, calls to other
+//! threads) of many state machines can therefore be coalesced: the buffer is
+//! either flushed at the end of each run-to-completion step or by its owner,
+//! i.e. once per tick for a pool of state machines sharing the same buffer.
+//! Commands are small trivially copyable callables (typically lambdas
+//! capturing \c this and the event parameters they read) stored inline: no
+//! memory is allocated once the buffer has reached its working size. Commands
+//! of a state machine are run when it exits and dropped when it is destroyed.
+// *****************************************************************************
+class CommandBuffer
+{
+public:
+
+    //--------------------------------------------------------------------------
+    //! \brief When commands are run.
+    //--------------------------------------------------------------------------
+    enum class Flush : uint8_t
+    {
+        //! \brief At the end of each run-to-completion step of the state
+        //! machines writing into the buffer.
+        STEP,
+        //! \brief Only when the owner of the buffer calls flush().
+        MANUAL
+    };
+
+    //! \brief Maximum size of the data captured by a command.
+    static constexpr size_t PAYLOAD = 32u;
+
+    //--------------------------------------------------------------------------
+    //! \brief Create an empty buffer.
+    //! \param[in] flush when commands are run.
+    //! \param[in] capacity the number of commands reserved.
+    //--------------------------------------------------------------------------
+    explicit CommandBuffer(Flush const flush = Flush::STEP, size_t const capacity = 64u)
+        : m_flush(flush)
+    {
+        m_commands.reserve(capacity);
+    }
+
+    //--------------------------------------------------------------------------
+    //! \brief Append a command to run at the next flush.
+    //! \param[in] owner the state machine pushing the command (see release()
+    //! and discard()).
+    //! \param[in] command the callable to run.
+    //--------------------------------------------------------------------------
+    template<class F>
+    inline void push(void const* const owner, F const& command)
+    {
+        static_assert(sizeof(F) <= PAYLOAD, "Command capturing too much data");
+        static_assert(alignof(F) <= alignof(std::max_align_t), "Command over-aligned");
+        static_assert(std::is_trivially_copyable<F>::value &&
+                      std::is_trivially_destructible<F>::value,
+                      "Commands shall be trivially copyable");
+        m_commands.emplace_back();
+        Command& c = m_commands.back();
+        c.owner = owner;
+        c.run = [](void const* payload) { (*static_cast<F const*>(payload))(); };
+        new (c.payload) F(command);
+    }
+
+    //--------------------------------------------------------------------------
+    //! \brief Run the pending commands in order, including the ones they push,
+    //! then empty the buffer.
+    //--------------------------------------------------------------------------
+    inline void flush()
+    {
+        if (m_flushing)
+            return ;
+
+        m_flushing = true;
+        for (size_t i = 0u; i < m_commands.size(); ++i)
+        {
+            // Copy: running the command may push new ones and move the buffer
+            Command const command = m_commands[i];
+            m_commands[i].run = nullptr;
+            if (command.run != nullptr)
+            {
+                command.run(command.payload);
+            }
+        }
+        m_commands.clear();
+        m_flushing = false;
+    }
+
+    //--------------------------------------------------------------------------
+    //! \brief Run now, in order, the pending commands of the given state
+    //! machine and drop them from the buffer. Called when the state machine
+    //! exits: a nested state machine is destroyed right after.
+    //--------------------------------------------------------------------------
+    inline void release(void const* const owner)
+    {
+        for (size_t i = 0u; i < m_commands.size(); ++i)
+        {
+            if ((m_commands[i].owner == owner) && (m_commands[i].run != nullptr))
+            {
+                Command const command = m_commands[i];
+                m_commands[i].run = nullptr;
+                command.run(command.payload);
+            }
+        }
+    }
+
+    //--------------------------------------------------------------------------
+    //! \brief Drop the pending commands of the given state machine without
+    //! running them. Called when the state machine is destroyed.
+    //--------------------------------------------------------------------------
+    inline void discard(void const* const owner)
+    {
+        for (Command& command: m_commands)
+        {
+            if (command.owner == owner)
+            {
+                command.run = nullptr;
+            }
+        }
+    }
+
+    //--------------------------------------------------------------------------
+    //! \brief Return the number of pending commands.
+    //--------------------------------------------------------------------------
+    inline size_t size() const
+    {
+        return m_commands.size();
+    }
+
+    //--------------------------------------------------------------------------
+    //! \brief Called by state machines when starting a run-to-completion step.
+    //--------------------------------------------------------------------------
+    inline void begin()
+    {
+        ++m_steps;
+    }
+
+    //--------------------------------------------------------------------------
+    //! \brief Called by state machines when ending a run-to-completion step:
+    //! flush the buffer once the outermost step is done (Flush::STEP).
+    //--------------------------------------------------------------------------
+    inline void end()
+    {
+        assert(m_steps != 0u);
+        if ((--m_steps == 0u) && (m_flush == Flush::STEP))
+        {
+            flush();
+        }
+    }
+
+private:
+
+    //! \brief Deferred side effect: a function running the captured data
+    //! (nullptr once run or dropped).
+    struct Command
+    {
+        void const* owner;
+        void (*run)(void const* payload);
+        alignas(std::max_align_t) unsigned char payload[PAYLOAD];
+    };
+
+    //! \brief Pending commands.
+    std::vector<Command> m_commands;
+    //! \brief Number of nested run-to-completion steps in progress.
+    size_t m_steps = 0u;
+    //! \brief When commands are run.
+    Flush m_flush;
+    //! \brief Commands are being run.
+    bool m_flushing = false;
+};
+
+// *****************************************************************************
+//! \brief Filter of an event annotated with debounce(N ms) on its transitions:
+//! the event is rejected when it comes less than DELAY microseconds after its
+//! previous occurrence, accepted or not. A bouncing switch therefore produces
+//! a single event until it has been stable for DELAY.
+// *****************************************************************************
+template<uint64_t DELAY>
+class Debounce
+{
+public:
+
+    //--------------------------------------------------------------------------
+    //! \brief Return true if the event occurring at the given time is accepted.
+    //! \param[in] now the current time in microseconds (FSM_CLOCK_US()).
+    //--------------------------------------------------------------------------
+    inline bool accept(uint64_t const now)
+    {
+        bool const accepted = (now >= m_quiet);
+        m_quiet = now + DELAY;
+        return accepted;
+    }
+
+private:
+
+    //! \brief Time from which the event is accepted again.
+    uint64_t m_quiet = 0u;
+};
+
+// *****************************************************************************
+//! \brief Filter of an event annotated with throttle(N/s) on its transitions:
+//! at most COUNT occurrences of the event are accepted by window of PERIOD
+//! microseconds, the other ones are rejected.
+// *****************************************************************************
+template<uint32_t COUNT, uint64_t PERIOD>
+class Throttle
+{
+public:
+
+    //--------------------------------------------------------------------------
+    //! \brief Return true if the event occurring at the given time is accepted.
+    //! \param[in] now the current time in microseconds (FSM_CLOCK_US()).
+    //--------------------------------------------------------------------------
+    inline bool accept(uint64_t const now)
+    {
+        if (now >= m_window)
+        {
+            m_window = now + PERIOD;
+            m_count = 0u;
+        }
+        if (m_count >= COUNT)
+            return false;
+        ++m_count;
+        return true;
+    }
+
+private:
+
+    //! \brief End of the current window.
+    uint64_t m_window = 0u;
+    //! \brief Number of events accepted in the current window.
+    uint32_t m_count = 0u;
+};
+
+// *****************************************************************************
+//! \brief Non-template core shared by all state machines: it holds the current
+//! state, the configuration word and the queue of nested transitions, and runs
+//! the transitions. Tables of states and transitions are type-erased: states
+//! are indices and guards, actions and choices are pointers to static functions
+//! of the concrete state machine taking this class (the concrete state machine
+//! derives from it) and calling the method they are instantiated for (see
+//! StateMachine::hook). Therefore the code running the transitions (and its
+//! logs) is compiled once per program instead of once per state machine class,
+//! while calling a hook still costs a single indirect call (the method is
+//! inlined in its function) and a hook takes a single pointer instead of the
+//! two of a pointer to method. See \c StateMachine for the typed wrapper used
+//! by generated code.
+// *****************************************************************************
+class StateMachineEngine
+{
+public:
+
+    //! \brief Maximum number of transitions done by a single run-to-completion
+    //! step (beyond, eventless transitions are cycling).
+    static constexpr size_t MAX_TRANSITIONS = 256u;
+
+    struct Transition;
+
+    //--------------------------------------------------------------------------
+    //! \brief Function calling a method of the concrete state machine, with no
+    //! argument and returning R (see StateMachine::hook). Functions are called
+    //! on the concrete state machine only.
+    //--------------------------------------------------------------------------
+    template<class R>
+    struct Hook
+    {
+        using Function = R (*)(StateMachineEngine& fsm);
+
+        constexpr Hook() = default;
+        constexpr Hook(std::nullptr_t) {}
+        constexpr Hook(Function const function)
+            : call(function)
+        {}
+
+        //! \brief The function (nullptr if none).
+        Function call = nullptr;
+    };
+
+    //! \brief Method with no argument and returning a boolean (guards).
+    using Guard = Hook<bool>;
+    //! \brief Method with no argument and returning void (actions).
+    using Action = Hook<void>;
+    //! \brief Method with no argument selecting the outgoing transition of a
+    //! choice or junction pseudo-state (nullptr if no guard is true).
+    using Choice = Hook<Transition const*>;
+
+    //--------------------------------------------------------------------------
+    //! \brief Identifier of a state converted from the enum of the concrete
+    //! state machine.
+    //--------------------------------------------------------------------------
+    struct Destination
+    {
+        //! \brief No destination: the event is ignored.
+        static constexpr uint16_t NONE = 0xFFFFu;
+
+        constexpr Destination() = default;
+        template<class STATES_ID>
+        constexpr Destination(STATES_ID const state)
+            : id(uint16_t(state))
+        {}
+
+        uint16_t id = NONE;
+    };
+
+    //--------------------------------------------------------------------------
+    //! \brief How a composite state is re-entered: from its initial state or
+    //! from its history pseudo-state. The shallow history restores the last
+    //! active state of the nested state machine, the deep history restores the
+    //! last active states of all nested state machines.
+    //--------------------------------------------------------------------------
+    enum class History : uint8_t { NONE, SHALLOW, DEEP };
+
+    //--------------------------------------------------------------------------
+    //! \brief Class depicting a state of the state machine and hold pointer
+    //! methods for each desired action to perform. In UML states are like
+    //! Moore state machine: states can do action.
+    //--------------------------------------------------------------------------
+    struct State
+    {
+        //! \brief Call the "on leaving" callback when leavinging for the first
+        //! time (AND ONLY THE FIRST TIME) the state. Note: the guard can
+        //! prevent calling this function.
+        Action leaving = nullptr;
+        //! \brief Call the "on entry" callback when entering for the first time
+        //! (AND ONLY THE FIRST TIME) in the state. Note: the transition guard
+        //! can prevent calling this function.
+        Action entering = nullptr;
+        //! \brief The condition validating the event and therefore preventing
+        //! the transition to occur.
+        Action internal = nullptr;
+        //! \brief The state is a choice or junction pseudo-state: the decision
+        //! tree selecting its outgoing transition.
+        Choice choice = nullptr;
+    };
+
+    //--------------------------------------------------------------------------
+    //! \brief Class depicting a transition from a source state to a destination
+    //! state. A transition occurs when an event has occured. In UML,
+    //! transitions are like Mealey state machine: transition can do action.
+    //--------------------------------------------------------------------------
+    struct Transition
+    {
+        //! \brief State of destination. When it is a choice or junction
+        //! pseudo-state, the choice of the State selects the outgoing
+        //! transition.
+        Destination destination = Destination();
+        //! \brief Number of transitions following this one in memory reacting
+        //! to the same event from the same state. They are tried in order when
+        //! the guard of this transition is false.
+        uint8_t chain = 0u;
+        //! \brief The condition validating the event and therefore preventing
+        //! the transition to occur.
+        Guard guard = nullptr;
+        //! \brief The action to perform when transitioning to the destination
+        //! state.
+        Action action = nullptr;
+    };
+
+    static_assert(sizeof(Transition) == 3u * sizeof(void*),
+                  "Transition shall be the destination, the chain and two function pointers");
+
+    //--------------------------------------------------------------------------
+    //! \brief First transition of a state reacting to an event. Tables of
+    //! transitions generated with the option --data-only hold, for each event,
+    //! an array of them sorted by state.
+    //--------------------------------------------------------------------------
+    struct Lookup
+    {
+        //! \brief The origin state.
+        uint16_t state;
+        //! \brief The first transition of its guard chain.
+        Transition const* rows;
+    };
+
+    //! \brief Return the name of the given state (for logs).
+    using Names = const char* (*)(uint16_t const state);
+
+    //--------------------------------------------------------------------------
+    //! \brief Handler of the external events by a state for state machines
+    //! generated with the option --handlers: a function switching over the
+    //! events the state reacts to.
+    //--------------------------------------------------------------------------
+    using Handler = void (*)(StateMachineEngine& fsm, uint8_t const event);
+
+    //--------------------------------------------------------------------------
+    //! \brief Deactivate the state machine.
+    //--------------------------------------------------------------------------
+    inline void exit()
+    {
+        m_enabled = false;
+    }
+
+    //--------------------------------------------------------------------------
+    //! \brief Check whether the state machine is active meaning if it has been
+    //! entered.
+    //--------------------------------------------------------------------------
+    inline bool isActive() const
+    {
+        return m_enabled;
+    }
+
+    //--------------------------------------------------------------------------
+    //! \brief Return the configuration word packing the current state of the
+    //! root state machine and of its alive nested state machines, one byte
+    //! each (two bytes for state machines of more than 253 states). Nested
+    //! state machines return the word of their root state machine.
+    //--------------------------------------------------------------------------
+    inline uint64_t configuration() const
+    {
+        return (m_root == nullptr) ? m_configuration : *m_root;
+    }
+
+    //--------------------------------------------------------------------------
+    //! \brief Make the nested state machine write its current state inside the
+    //! configuration word of its root state machine.
+    //! \param[in] root the configuration word of the root state machine.
+    //! \param[in] slot the index of the first byte holding the current state.
+    //--------------------------------------------------------------------------
+    inline void bind(uint64_t* const root, uint8_t const slot)
+    {
+        assert(8u * slot + ((m_mask > 0xFFu) ? 16u : 8u) <= 64u);
+        m_root = root;
+        m_shift = uint8_t(8u * slot);
+        setState(m_state);
+    }
+
+protected:
+
+    //--------------------------------------------------------------------------
+    //! \brief Create an inactive state machine.
+    //! \param[in] initial the initial state to start with.
+    //! \param[in] max_states the number of states (MAX_STATES): beyond 256
+    //! the current state takes two bytes of the configuration word.
+    //--------------------------------------------------------------------------
+    StateMachineEngine(uint16_t const initial, uint16_t const max_states)
+        : m_state(initial), m_configuration(initial), m_initial_state(initial),
+          m_mask((max_states > 256u) ? 0xFFFFu : 0xFFu)
+    {}
+
+    //--------------------------------------------------------------------------
+    //! \brief Activate the state machine in the given state and forget the
+    //! pending transitions.
+    //--------------------------------------------------------------------------
+    inline void restart(uint16_t const state)
+    {
+        setState(state);
+        std::queue<Transition const*> empty;
+        std::swap(m_nesting, empty);
+        m_enabled = true;
+    }
+
+    //--------------------------------------------------------------------------
+    //! \brief Return the initial state.
+    //--------------------------------------------------------------------------
+    inline uint16_t initialState() const
+    {
+        return m_initial_state;
+    }
+
+    //--------------------------------------------------------------------------
+    //! \brief Call the given hook of the concrete state machine if any.
+    //--------------------------------------------------------------------------
+    inline void call(Action const& action)
+    {
+        if (action.call != nullptr)
+        {
+            action.call(*this);
+        }
+    }
+
+    //--------------------------------------------------------------------------
+    //! \brief Run the given transition, and the transitions it causes, until
+    //! completion. This will call the guard, leaving actions, entering actions
+    //! ...
+    //! \param[in] tr the transition (and its guard chain).
+    //! \param[in] states the states of the concrete state machine.
+    //! \param[in] max_states the number of states (MAX_STATES) of the enum of
+    //! the concrete state machine, ending with IGNORING_EVENT and
+    //! CANNOT_HAPPEN.
+    //! \param[in] names the name of the states (for logs).
+    //! \param[in] commands the buffer of commands of deferred actions, told
+    //! when the run-to-completion step begins and ends (nullptr if none).
+    //--------------------------------------------------------------------------
+    void dispatch(Transition const* tr, State const* states, uint16_t const max_states,
+                  Names const names, CommandBuffer* const commands);
+
+    //--------------------------------------------------------------------------
+    //! \brief Return the first transition of the current state among the given
+    //! lookup sorted by state (binary search) or nullptr if the current state
+    //! does not react to the event.
+    //--------------------------------------------------------------------------
+    inline Transition const* find(Lookup const* lookup, size_t count) const
+    {
+        while (count != 0u)
+        {
+            size_t const half = count / 2u;
+            if (lookup[half].state < m_state)
+            {
+                lookup += half + 1u;
+                count -= half + 1u;
+            }
+            else if (lookup[half].state > m_state)
+            {
+                count = half;
+            }
+            else
+            {
+                return lookup[half].rows;
+            }
+        }
+        return nullptr;
+    }
+
+    //--------------------------------------------------------------------------
+    //! \brief Return the configuration word shared with nested state machines.
+    //--------------------------------------------------------------------------
+    inline uint64_t* word()
+    {
+        return (m_root == nullptr) ? &m_configuration : m_root;
+    }
+
+    //--------------------------------------------------------------------------
+    //! \brief Return the index of the byte holding the current state inside
+    //! the configuration word. Generated code only uses slots relative to this
+    //! one so a nested state machine class can be instantiated at any depth.
+    //--------------------------------------------------------------------------
+    inline uint8_t slot() const
+    {
+        return uint8_t(m_shift / 8u);
+    }
+
+private:
+
+    //--------------------------------------------------------------------------
+    //! \brief Change the current state and update its bytes in the
+    //! configuration word.
+    //--------------------------------------------------------------------------
+    inline void setState(uint16_t const state)
+    {
+        m_state = state;
+        uint64_t* config = word();
+        *config = (*config & ~(uint64_t(m_mask) << m_shift)) | (uint64_t(state) << m_shift);
+    }
+
+protected:
+
+    //! \brief Current active state.
+    uint16_t m_state;
+
+private:
+
+    //! \brief Maximum number of chained choice or junction pseudo-states
+    //! traversed by a single transition.
+    static constexpr size_t MAX_PSEUDO_STATES = 8u;
+    //! \brief Temporary variable saving the nesting state (needed for internal
+    //! event).
+    std::queue<Transition const*> m_nesting;
+    //! \brief Configuration word of the root state machine when this state
+    //! machine is nested (nullptr for the root state machine).
+    uint64_t* m_root = nullptr;
+    //! \brief Configuration word of the root state machine.
+    uint64_t m_configuration;
+    //! \brief Save the initial state need for restoring initial state.
+    uint16_t m_initial_state;
+    //! \brief Mask of the current state inside the configuration word.
+    uint16_t m_mask;
+    //! \brief Position of the byte holding the current state inside the
+    //! configuration word.
+    uint8_t m_shift = 0u;
+    //! \brief Enable / disable state machine (TBD: usable for nesting state
+    //! machine (that is not generated as flat state machine)).
+    bool m_enabled = false;
+};
+
+//------------------------------------------------------------------------------
+inline void StateMachineEngine::dispatch(Transition const* tr, State const* states,
+                                         uint16_t const max_states, Names const names,
+                                         CommandBuffer* const commands)
+{
+    (void) names;
+#if defined(THREAD_SAFETY)
+    // If try_lock failed it is not important: it just means that we have called
+    // an internal event from this method and internal states are still
+    // protected.
+    m_mutex.try_lock();
+#endif
+
+    // Reaction from internal event (therefore coming from this method called by
+    // one of the action functions: memorize and leave the function: it will
+    // continue thank to the while loop. This avoids recursion.
+    if (m_nesting.size())
+    {
+        LOGD("[STATE MACHINE] Internal event. Memorize state %s\n",
+             names(tr->destination.id));
+        m_nesting.push(tr);
+        if (m_nesting.size() >= 16u)
+        {
+            LOGE("[STATE MACHINE] Infinite loop detected. Abort!\n");
+            FSM_FATAL();
+        }
+        return ;
+    }
+
+    // The enum of states ends with IGNORING_EVENT, CANNOT_HAPPEN, MAX_STATES
+    uint16_t const cannot_happen = uint16_t(max_states - 1u);
+    uint16_t const ignoring_event = uint16_t(max_states - 2u);
+
+    // Deferred actions are run once the step is done
+    if (commands != nullptr)
+    {
+        commands->begin();
+    }
+
+    m_nesting.push(tr);
+    Transition const* transition;
+    size_t transitions = 0u;
+    do
+    {
+        // Cycle of eventless transitions
+        if (++transitions > MAX_TRANSITIONS)
+        {
+            LOGE("[STATE MACHINE] Infinite loop detected. Abort!\n");
+            FSM_FATAL();
+        }
+
+        // Consum the current state
+        transition = m_nesting.front();
+        uint16_t const destination = transition->destination.id;
+
+        LOGD("[STATE MACHINE] React to event from state %s\n", names(m_state));
+
+        // Forbidden event: kill the system
+        if (destination == cannot_happen)
+        {
+            LOGE("[STATE MACHINE] Forbidden event. Aborting!\n");
+            FSM_FATAL();
+        }
+
+        // Do not react to this event
+        else if ((destination == ignoring_event) || (destination == Destination::NONE))
+        {
+            LOGD("[STATE MACHINE] Ignoring external event\n");
+            if (commands != nullptr)
+            {
+                commands->end();
+            }
+            return ;
+        }
+
+        // Unknown state: kill the system
+        else if (destination >= max_states)
+        {
+            LOGE("[STATE MACHINE] Unknown state. Aborting!\n");
+            FSM_FATAL();
+        }
+
+        // Call the guards of the chain until one is true
+        bool guard_res = (transition->guard.call == nullptr);
+        while (true)
+        {
+            if (!guard_res)
+            {
+                LOGD("[STATE MACHINE] Call the guard %s -> %s\n",
+                     names(m_state), names(transition->destination.id));
+                guard_res = transition->guard.call(*this);
+            }
+            if (guard_res || (transition->chain == 0u))
+                break ;
+            ++transition;
+            guard_res = (transition->guard.call == nullptr);
+        }
+
+#if defined(FSM_MODEL_CHECK)
+        // Model checker: also evaluate the guards following the true one in
+        // the chain (the first true guard still wins) so the outcomes where two
+        // of them are true are explored and reported.
+        if (guard_res && (transition->guard.call != nullptr))
+        {
+            for (size_t i = 1u; i <= transition->chain; ++i)
+            {
+                Transition const& other = transition[i];
+                if ((other.guard.call != nullptr) && other.guard.call(*this))
+                {
+                    ModelOracle::overlap("From state %s, the guards of the transitions to %s and to %s can be both true\n",
+                                         names(m_state), names(transition->destination.id),
+                                         names(other.destination.id));
+                }
+            }
+        }
+#endif
+
+        // Choice and junction pseudo-states: select their outgoing transitions
+        // before leaving the current state. Pseudo-states are never entered:
+        // the whole path is done within the same transition step.
+        Transition const* branches[MAX_PSEUDO_STATES];
+        size_t count = 0u;
+        Transition const* target = transition;
+        while (guard_res && (states[target->destination.id].choice.call != nullptr))
+        {
+            if (count == MAX_PSEUDO_STATES)
+            {
+                LOGE("[STATE MACHINE] Too many chained pseudo-states. Abort!\n");
+                FSM_FATAL();
+            }
+            LOGD("[STATE MACHINE] Select the branch of the pseudo-state %s\n",
+                 names(target->destination.id));
+            target = states[target->destination.id].choice.call(*this);
+            guard_res = (target != nullptr);
+            if (guard_res)
+            {
+                branches[count++] = target;
+            }
+        }
+
+        if (!guard_res)
+        {
+            LOGD("[STATE MACHINE] Transition refused by the %s guard. Stay"
+                 " in state %s\n", names(transition->destination.id),
+                 names(m_state));
+        }
+        else
+        {
+            // Reaction: call the member function associated to the current state
+            uint16_t const next = target->destination.id;
+            State const& cst = states[m_state];
+            State const& nst = states[next];
+
+            // The guard allowed the transition to the next state
+            LOGD("[STATE MACHINE] Transitioning to new state %s\n", names(next));
+
+            // Transition. Passing through a pseudo-state is never an internal
+            // transition even when coming back to the same state.
+            uint16_t const previous_state = m_state;
+            setState(next);
+            bool const external = (previous_state != next) || (count != 0u);
+
+            // Transitioning to a new state ?
+            if (external)
+            {
+                // Do reactions when leaving the current state
+                if (cst.leaving.call != nullptr)
+                {
+                    LOGD("[STATE MACHINE] Call the state %s 'on leaving' action\n",
+                         names(previous_state));
+                    cst.leaving.call(*this);
+                }
+            }
+
+            // Do transitiona ction
+            if (transition->action.call != nullptr)
+            {
+                LOGD("[STATE MACHINE] Call the transition %s -> %s action\n",
+                     names(previous_state), names(transition->destination.id));
+                transition->action.call(*this);
+            }
+
+            // Do actions of the outgoing transitions of pseudo-states
+            for (size_t i = 0u; i < count; ++i)
+            {
+                if (branches[i]->action.call != nullptr)
+                {
+                    LOGD("[STATE MACHINE] Call the branch action to state %s\n",
+                         names(branches[i]->destination.id));
+                    branches[i]->action.call(*this);
+                }
+            }
+
+            // Transitioning to a new state ?
+            if (external)
+            {
+                // Do reactions when entring into the new state
+                if (nst.entering.call != nullptr)
+                {
+                    LOGD("[STATE MACHINE] Call the state %s 'on entry' action\n",
+                         names(next));
+                    nst.entering.call(*this);
+                }
+
+                // Do internal transitions when no event are present
+                if (nst.internal.call != nullptr)
+                {
+                    LOGD("[STATE MACHINE] Call the state %s 'on internal' action\n",
+                         names(next));
+                    nst.internal.call(*this);
+                }
+            }
+            else
+            {
+                LOGD("[STATE MACHINE] Stay in the same state %s\n", names(next));
+            }
+        }
+
+        m_nesting.pop();
+    } while (!m_nesting.empty());
+
+    if (commands != nullptr)
+    {
+        commands->end();
+    }
+
+#if defined(THREAD_SAFETY)
+    m_mutex.unlock();
+#endif
+}
+
 // *****************************************************************************
 //! \brief Base class for depicting and running small Finite State Machine (FSM)
 //! by implementing a subset of UML statechart. See this document for more
@@ -125,60 +976,23 @@ const char* stringify(STATES_ID const state);
 //!
 //! Transition, like states, can do reaction and have guards as pointer
 //! functions.
-// *****************************************************************************
-template<typename FSM, class STATES_ID>
-class StateMachine
-{
-public:
-
-    //! \brief Pointer method with no argument and returning a boolean.
-    using bFuncPtr = bool (FSM::*)();
-    //! \brief Pointer method with no argument and returning void.
-    using xFuncPtr = void (FSM::*)();
-
-    //--------------------------------------------------------------------------
-    //! \brief Class depicting a state of the state machine and hold pointer
-    //! methods for each desired action to perform. In UML states are like
-    //! Moore state machine: states can do action.
-    //--------------------------------------------------------------------------
-    struct State
-    {
-        //! \brief Call the "on leaving" callback when leavinging for the first
-        //! time (AND ONLY THE FIRST TIME) the state. Note: the guard can
-        //! prevent calling this function.
-        xFuncPtr leaving = nullptr;
-        //! \brief Call the "on entry" callback when entering for the first time
-        //! (AND ONLY THE FIRST TIME) in the state. Note: the transition guard
-        //! can prevent calling this function.
-        xFuncPtr entering = nullptr;
-        //! \brief The condition validating the event and therefore preventing
-        //! the transition to occur.
-        xFuncPtr internal = nullptr;
-    };
-
-    //--------------------------------------------------------------------------
-    //! \brief Class depicting a transition from a source state to a destination
-    //! state. A transition occurs when an event has occured. In UML,
-    //! transitions are like Mealey state machine: transition can do action.
-    //--------------------------------------------------------------------------
-    struct Transition
-    {
-        //! \brief State of destination
-        STATES_ID destination = STATES_ID::IGNORING_EVENT;
-        //! \brief The condition validating the event and therefore preventing
-        //! the transition to occur.
-        bFuncPtr guard = nullptr;
-        //! \brief The action to perform when transitioning to the destination
-        //! state.
-        xFuncPtr action = nullptr;
-    };
+//!
+//! This class is a thin typed wrapper: transitions are run by the non-template
+//! \c StateMachineEngine shared by all state machine classes.
+// *****************************************************************************
+template<typename FSM, class STATES_ID>
+class StateMachine: public StateMachineEngine
+{
+public:
 
     //! \brief Define the type of container holding all stated of the state
     //! machine.
     using States = State[int(STATES_ID::MAX_STATES)];
     //! \brief Define the type of container holding states transitions. Since
-    //! a state machine is generally a sparse matrix we use red-back tree.
-    using Transitions = std::map<STATES_ID, Transition>;
+    //! a state machine is generally a sparse matrix we use red-back tree. Each
+    //! state refers to the first transition of its guard chain, stored with
+    //! the following ones in a contiguous array.
+    using Transitions = std::map<STATES_ID, Transition const*>;
 
     //--------------------------------------------------------------------------
     //! \brief Default constructor. Pass the number of states the FSM will use,
@@ -186,8 +1000,13 @@ public:
     //! \param[in] initial the initial state to start with.
     //--------------------------------------------------------------------------
     StateMachine(STATES_ID const initial) // FIXME should be ok for constexpr
-        : m_current_state(initial), m_initial_state(initial)
+        : StateMachineEngine(uint16_t(initial), uint16_t(STATES_ID::MAX_STATES))
     {
+        static_assert(int(STATES_ID::MAX_STATES) < int(Destination::NONE),
+                      "Too many states");
+        static_assert((int(STATES_ID::IGNORING_EVENT) + 2 == int(STATES_ID::MAX_STATES)) &&
+                      (int(STATES_ID::CANNOT_HAPPEN) + 1 == int(STATES_ID::MAX_STATES)),
+                      "States shall end with IGNORING_EVENT, CANNOT_HAPPEN, MAX_STATES");
         // FIXME static_assert not working
         assert(initial < STATES_ID::MAX_STATES);
     }
@@ -198,27 +1017,35 @@ public:
     inline void enter()
     {
         LOGD("[STATE MACHINE] Restart the state machine\n");
-        m_current_state = m_initial_state;
-        std::queue<Transition const*> empty;
-        std::swap(m_nesting, empty);
-        m_enabled = true;
+        restart(initialState());
     }
 
     //--------------------------------------------------------------------------
-    //! \brief Return the current state.
+    //! \brief Re-enter the state machine directly in the given state (history
+    //! pseudo-state). The initial transition is not replayed: only the entering
+    //! action (and internal transition) of the restored state is called, so
+    //! resuming costs the same as a normal transition.
+    //! \param[in] state the state to restore.
     //--------------------------------------------------------------------------
-    inline void exit()
+    inline void resume(STATES_ID const state)
     {
-        m_enabled = false;
-    }
+        LOGD("[STATE MACHINE] Resume the state machine in state %s\n",
+             stringify(state));
+        assert(state < STATES_ID::MAX_STATES);
+        restart(uint16_t(state));
 
-    //--------------------------------------------------------------------------
-    //! \brief Check whether the state machine is active meaning if it has been
-    //! entered.
-    //--------------------------------------------------------------------------
-    inline bool isActive() const
-    {
-        return m_enabled;
+        CommandBuffer* const buffer = static_cast<FSM*>(this)->commands();
+        if (buffer != nullptr)
+        {
+            buffer->begin();
+        }
+        State const& st = m_states[int(state)];
+        call(st.entering);
+        call(st.internal);
+        if (buffer != nullptr)
+        {
+            buffer->end();
+        }
     }
 
     //--------------------------------------------------------------------------
@@ -226,7 +1053,7 @@ public:
     //--------------------------------------------------------------------------
     inline STATES_ID state() const
     {
-        return m_current_state;
+        return STATES_ID(m_state);
     }
 
     //--------------------------------------------------------------------------
@@ -234,7 +1061,7 @@ public:
     //--------------------------------------------------------------------------
     inline const char* c_str() const
     {
-        return m_enabled ? stringify(m_current_state) : "--";
+        return isActive() ? stringify(state()) : "--";
     }
 
     //--------------------------------------------------------------------------
@@ -244,13 +1071,13 @@ public:
     //--------------------------------------------------------------------------
     inline void transition(Transitions const& transitions)
     {
-        if (!m_enabled)
+        if (!isActive())
             return ;
 
-        auto const& it = transitions.find(m_current_state);
+        auto const& it = transitions.find(state());
         if (it != transitions.end())
         {
-            transition(&it->second);
+            transition(it->second);
         }
         else
         {
@@ -260,174 +1087,377 @@ public:
         }
     }
 
+    //--------------------------------------------------------------------------
+    //! \brief External event of state machines generated with the option
+    //! --data-only: generic dispatch on the constant tables of the event.
+    //! \param[in] lookup the first transition of each state reacting to the
+    //! event, sorted by state.
+    //! \param[in] count the number of states reacting to the event.
+    //--------------------------------------------------------------------------
+    inline void transition(Lookup const* lookup, size_t const count)
+    {
+        if (!isActive())
+            return ;
+
+        Transition const* rows = find(lookup, count);
+        if (rows != nullptr)
+        {
+            transition(rows);
+        }
+        else
+        {
+            LOGD("[STATE MACHINE] Ignoring external event\n");
+        }
+    }
+
+    //--------------------------------------------------------------------------
+    //! \brief External event whose transition from the current state has been
+    //! selected by the generated code (guards compiled into intervals of
+    //! values) instead of calling the guards one by one.
+    //! \param[in] transitions the transitions of the current state.
+    //! \param[in] index the index of the selected transition or a negative
+    //! value when no transition reacts to the event.
+    //--------------------------------------------------------------------------
+    inline void transition(Transition const* transitions, int const index)
+    {
+        if (!isActive())
+            return ;
+
+        if (index >= 0)
+        {
+            transition(&transitions[index]);
+        }
+        else
+        {
+            LOGD("[STATE MACHINE] Ignoring external event\n");
+        }
+    }
+
 protected:
 
     //--------------------------------------------------------------------------
     //! \brief Internal transition: jump to the desired state from internal
     //! event. This will call the guard, leaving actions, entering actions ...
-    //! \param[in] transitions the table of transitions.
+    //! \param[in] tr the transition (and its guard chain).
     //--------------------------------------------------------------------------
-    void transition(Transition const* transition);
+    inline void transition(Transition const* tr)
+    {
+        dispatch(tr, m_states, uint16_t(STATES_ID::MAX_STATES), &StateMachine::name,
+                 static_cast<FSM*>(this)->commands());
+    }
 
-protected:
+    //--------------------------------------------------------------------------
+    //! \brief No buffer of commands: state machines generated without the
+    //! option --deferred run their actions immediately (see
+    //! DeferredStateMachine hiding this method).
+    //--------------------------------------------------------------------------
+    inline CommandBuffer* commands() const
+    {
+        return nullptr;
+    }
 
-    //! \brief Container of states.
-    States m_states;
+    //--------------------------------------------------------------------------
+    //! \brief Hooks of the tables of states and transitions (guards, actions
+    //! and choices) calling the given method of the concrete state machine,
+    //! i.e. &StateMachine::hook<&FSM::onGuarding_IDLE_STARTING>. The method
+    //! being known at compile time, it is inlined inside the hook.
+    //--------------------------------------------------------------------------
+    template<bool (FSM::*METHOD)()>
+    static bool hook(StateMachineEngine& fsm)
+    {
+        return (static_cast<FSM&>(fsm).*METHOD)();
+    }
 
-    //! \brief Current active state.
-    STATES_ID m_current_state;
+    template<void (FSM::*METHOD)()>
+    static void hook(StateMachineEngine& fsm)
+    {
+        (static_cast<FSM&>(fsm).*METHOD)();
+    }
+
+    template<Transition const* (FSM::*METHOD)()>
+    static Transition const* hook(StateMachineEngine& fsm)
+    {
+        return (static_cast<FSM&>(fsm).*METHOD)();
+    }
+
+    //--------------------------------------------------------------------------
+    //! \brief Handler of external events calling the given method of the
+    //! concrete state machine. The method being known at compile time, it is
+    //! inlined inside the handler.
+    //--------------------------------------------------------------------------
+    template<void (FSM::*METHOD)(uint8_t const)>
+    static void handler(StateMachineEngine& fsm, uint8_t const event)
+    {
+        (static_cast<FSM&>(fsm).*METHOD)(event);
+    }
 
 private:
 
-    //! \brief Save the initial state need for restoring initial state.
-    STATES_ID m_initial_state;
-    //! \brief Temporary variable saving the nesting state (needed for internal
-    //! event).
-    std::queue<Transition const*> m_nesting;
-    //! \brief Enable / disable state machine (TBD: usable for nesting state
-    //! machine (that is not generated as flat state machine)).
-    bool m_enabled = false;
+    //--------------------------------------------------------------------------
+    //! \brief Return the name of the given state (for logs of the engine).
+    //--------------------------------------------------------------------------
+    static const char* name(uint16_t const state)
+    {
+        return stringify(STATES_ID(state));
+    }
+
+protected:
+
+    //! \brief Container of states.
+    States m_states;
 };
 
-//------------------------------------------------------------------------------
-template<class FSM, class STATES_ID>
-void StateMachine<FSM, STATES_ID>::transition(Transition const* tr)
+// *****************************************************************************
+//! \brief Typed wrapper of the state machines generated with the option
+//! --handlers: external events are dispatched by the handler of the current
+//! state instead of looking up a table of transitions. Only these classes hold
+//! the table of handlers: the other state machines keep their size and their
+//! changes of state do not update any handler.
+// *****************************************************************************
+template<typename FSM, class STATES_ID>
+class HandlerStateMachine: public StateMachine<FSM, STATES_ID>
 {
-#if defined(THREAD_SAFETY)
-    // If try_lock failed it is not important: it just means that we have called
-    // an internal event from this method and internal states are still
-    // protected.
-    m_mutex.try_lock();
-#endif
+public:
 
-    // Reaction from internal event (therefore coming from this method called by
-    // one of the action functions: memorize and leave the function: it will
-    // continue thank to the while loop. This avoids recursion.
-    if (m_nesting.size())
+    //--------------------------------------------------------------------------
+    //! \brief Default constructor (see StateMachine).
+    //! \param[in] initial the initial state to start with.
+    //--------------------------------------------------------------------------
+    HandlerStateMachine(STATES_ID const initial)
+        : StateMachine<FSM, STATES_ID>(initial)
+    {}
+
+protected:
+
+    using Handler = StateMachineEngine::Handler;
+
+    //--------------------------------------------------------------------------
+    //! \brief Store the handlers of external events of the states.
+    //! \param[in] handlers the handler of each state, indexed by state.
+    //--------------------------------------------------------------------------
+    inline void handlers(Handler const* handlers)
     {
-        LOGD("[STATE MACHINE] Internal event. Memorize state %s\n",
-             stringify(tr->destination));
-        m_nesting.push(tr);
-        if (m_nesting.size() >= 16u)
+        m_handlers = handlers;
+    }
+
+    //--------------------------------------------------------------------------
+    //! \brief External event: a single indirect call to the handler of the
+    //! current state, no lookup of the table of transitions.
+    //--------------------------------------------------------------------------
+    inline void handle(uint8_t const event)
+    {
+        if (this->isActive())
         {
-            LOGE("[STATE MACHINE] Infinite loop detected. Abort!\n");
-            ::exit(EXIT_FAILURE);
+            m_handlers[this->m_state](*this, event);
         }
-        return ;
     }
 
-    m_nesting.push(tr);
-    Transition const* transition;
-    do
-    {
-        // Consum the current state
-        transition = m_nesting.front();
+private:
 
-        LOGD("[STATE MACHINE] React to event from state %s\n",
-             stringify(m_current_state));
+    //! \brief Handlers of external events indexed by state.
+    Handler const* m_handlers = nullptr;
+};
 
-        // Forbidden event: kill the system
-        if (transition->destination == STATES_ID::CANNOT_HAPPEN)
-        {
-            LOGE("[STATE MACHINE] Forbidden event. Aborting!\n");
-            ::exit(EXIT_FAILURE);
-        }
+// *****************************************************************************
+//! \brief Typed wrapper of the state machines generated with the option
+//! --deferred: the side effects of their actions are pushed into a buffer of
+//! commands (see CommandBuffer). Only these classes hold the buffer: the other
+//! state machines keep their size and do not test it at each step.
+//!
+//! \tparam BASE the wrapper of the option --handlers or StateMachine.
+// *****************************************************************************
+template<typename FSM, class STATES_ID, class BASE = StateMachine<FSM, STATES_ID>>
+class DeferredStateMachine: public BASE
+{
+public:
 
-        // Do not react to this event
-        else if (transition->destination == STATES_ID::IGNORING_EVENT)
+    //--------------------------------------------------------------------------
+    //! \brief Default constructor (see StateMachine).
+    //! \param[in] initial the initial state to start with.
+    //--------------------------------------------------------------------------
+    DeferredStateMachine(STATES_ID const initial)
+        : BASE(initial)
+    {}
+
+    //--------------------------------------------------------------------------
+    //! \brief Drop the pending commands of deferred actions: the state machine
+    //! can no longer run them.
+    //--------------------------------------------------------------------------
+    ~DeferredStateMachine()
+    {
+        if (m_commands != nullptr)
         {
-            LOGD("[STATE MACHINE] Ignoring external event\n");
-            return ;
+            m_commands->discard(this);
         }
+    }
 
-        // Unknown state: kill the system
-        else if (transition->destination >= STATES_ID::MAX_STATES)
+    //--------------------------------------------------------------------------
+    //! \brief Deactivate the state machine. The pending commands of its
+    //! deferred actions are run: nested state machines are destroyed once
+    //! exited.
+    //--------------------------------------------------------------------------
+    inline void exit()
+    {
+        BASE::exit();
+        if (m_commands != nullptr)
         {
-            LOGE("[STATE MACHINE] Unknown state. Aborting!\n");
-            ::exit(EXIT_FAILURE);
+            m_commands->release(this);
         }
+    }
+
+    //--------------------------------------------------------------------------
+    //! \brief Make the deferred actions push their code into the given buffer
+    //! of commands. Without buffer (nullptr, default) actions are run
+    //! immediately.
+    //--------------------------------------------------------------------------
+    inline void commands(CommandBuffer* const buffer)
+    {
+        m_commands = buffer;
+    }
 
-        // Reaction: call the member function associated to the current state
-        StateMachine<FSM, STATES_ID>::State const& cst = m_states[int(m_current_state)];
-        StateMachine<FSM, STATES_ID>::State const& nst = m_states[int(transition->destination)];
+    //--------------------------------------------------------------------------
+    //! \brief Return the buffer of commands of deferred actions (nullptr if
+    //! none).
+    //--------------------------------------------------------------------------
+    inline CommandBuffer* commands() const
+    {
+        return m_commands;
+    }
 
-        // Call the guard
-        bool guard_res = (transition->guard == nullptr);
-        if (!guard_res)
-        {
-            LOGD("[STATE MACHINE] Call the guard %s -> %s\n",
-                 stringify(m_current_state), stringify(transition->destination));
-            guard_res = (static_cast<FSM*>(this)->*transition->guard)();
-        }
+protected:
 
-        if (!guard_res)
+    //--------------------------------------------------------------------------
+    //! \brief Push the given code of a deferred action into the buffer of
+    //! commands, or run it immediately when there is no buffer.
+    //--------------------------------------------------------------------------
+    template<class F>
+    inline void defer(F const& command)
+    {
+        if (m_commands == nullptr)
         {
-            LOGD("[STATE MACHINE] Transition refused by the %s guard. Stay"
-                 " in state %s\n", stringify(transition->destination),
-                 stringify(m_current_state));
+            command();
         }
         else
         {
-            // The guard allowed the transition to the next state
-            LOGD("[STATE MACHINE] Transitioning to new state %s\n",
-                 stringify(transition->destination));
+            m_commands->push(this, command);
+        }
+    }
 
-            // Transition
-            STATES_ID previous_state = m_current_state;
-            m_current_state = transition->destination;
+private:
 
-            // Transitioning to a new state ?
-            if (previous_state != transition->destination)
-            {
-                // Do reactions when leaving the current state
-                if (cst.leaving != nullptr)
-                {
-                    LOGD("[STATE MACHINE] Call the state %s 'on leaving' action\n",
-                         stringify(previous_state));
-                    (static_cast<FSM*>(this)->*cst.leaving)();
-                }
-            }
+    //! \brief Buffer of commands of deferred actions (nullptr: run them
+    //! immediately).
+    CommandBuffer* m_commands = nullptr;
+};
 
-            // Do transitiona ction
-            if (transition->action != nullptr)
-            {
-                LOGD("[STATE MACHINE] Call the transition %s -> %s action\n",
-                     stringify(previous_state), stringify(transition->destination));
-                (static_cast<FSM*>(this)->*transition->action)();
-            }
+// *****************************************************************************
+//! \brief Storage shared by the nested state machines of a parent state
+//! machine. Composite states of the same state machine are mutually exclusive
+//! therefore their nested state machines are never alive at the same time: they
+//! share the same memory (like an union) which is sized for the biggest one
+//! instead of the sum of all of them. A nested state machine is constructed
+//! when entering its composite state and destroyed when leaving it.
+//! Orthogonal regions of a composite state are alive at the same time: they
+//! are grouped in a std::tuple constructed as a single nested state machine.
+//!
+//! \tparam NESTED the classes of the nested state machines.
+// *****************************************************************************
+template<class... NESTED>
+class NestedOverlay
+{
+public:
 
-            // Transitioning to a new state ?
-            if (previous_state != transition->destination)
-            {
-                // Do reactions when entring into the new state
-                if (nst.entering != nullptr)
-                {
-                    LOGD("[STATE MACHINE] Call the state %s 'on entry' action\n",
-                         stringify(transition->destination));
-                    (static_cast<FSM*>(this)->*nst.entering)();
-                }
+    NestedOverlay() = default;
+    NestedOverlay(NestedOverlay const&) = delete;
+    NestedOverlay& operator=(NestedOverlay const&) = delete;
 
-                // Do internal transitions when no event are present
-                if (nst.internal != nullptr)
-                {
-                    LOGD("[STATE MACHINE] Call the state %s 'on internal' action\n",
-                         stringify(transition->destination));
-                    (static_cast<FSM*>(this)->*nst.internal)();
-                }
-            }
-            else
-            {
-                LOGD("[STATE MACHINE] Stay in the same state %s\n",
-                     stringify(transition->destination));
-            }
+    //--------------------------------------------------------------------------
+    //! \brief Destroy the alive nested state machine if any.
+    //--------------------------------------------------------------------------
+    ~NestedOverlay()
+    {
+        reset();
+    }
+
+    //--------------------------------------------------------------------------
+    //! \brief Destroy the alive nested state machine and construct the given
+    //! one in place.
+    //! \return the newly constructed nested state machine.
+    //--------------------------------------------------------------------------
+    template<class T>
+    T& emplace()
+    {
+        reset();
+        T* nested = new (m_storage) T();
+        m_destroy = [](void* p) { static_cast<T*>(p)->~T(); };
+        return *nested;
+    }
+
+    //--------------------------------------------------------------------------
+    //! \brief Return the alive nested state machine. The caller shall know
+    //! which one is alive (the one owned by the current composite state).
+    //--------------------------------------------------------------------------
+    template<class T>
+    inline T& get()
+    {
+        assert(m_destroy != nullptr);
+        return *launder(reinterpret_cast<T*>(m_storage));
+    }
+
+    //--------------------------------------------------------------------------
+    //! \brief Return the alive nested state machine (const version).
+    //--------------------------------------------------------------------------
+    template<class T>
+    inline T const& get() const
+    {
+        assert(m_destroy != nullptr);
+        return *launder(reinterpret_cast<T const*>(m_storage));
+    }
+
+    //--------------------------------------------------------------------------
+    //! \brief Destroy the alive nested state machine if any.
+    //--------------------------------------------------------------------------
+    inline void reset()
+    {
+        if (m_destroy != nullptr)
+        {
+            m_destroy(m_storage);
+            m_destroy = nullptr;
         }
+    }
 
-        m_nesting.pop();
-    } while (!m_nesting.empty());
+private:
 
-#if defined(THREAD_SAFETY)
-    m_mutex.unlock();
-#endif
-}
+    //--------------------------------------------------------------------------
+    //! \brief Return a pointer to the object constructed by placement new in
+    //! the storage reused by the nested state machines. Since C++17 the pointer
+    //! to the storage shall be laundered to reach this object.
+    //--------------------------------------------------------------------------
+    template<class T>
+    static inline T* launder(T* p)
+    {
+#  if defined(__cpp_lib_launder)
+        return std::launder(p);
+#  else
+        return p;
+#  endif
+    }
+
+    //! \brief Return the size of the biggest nested state machine.
+    static constexpr size_t size()
+    {
+        size_t res = 0u;
+        for (size_t s: { sizeof(NESTED)... })
+            res = (s > res) ? s : res;
+        return res;
+    }
+
+private:
+
+    //! \brief Memory shared by nested state machines.
+    alignas(NESTED...) unsigned char m_storage[size()];
+    //! \brief Destructor of the alive nested state machine (nullptr if none).
+    void (*m_destroy)(void*) = nullptr;
+};
 
 #endif // STATE_MACHINE_HPP
@@ -28,7 +28,7 @@ from collections import deque
 from datetime import date
 from lark import Lark, Transformer
 
-import sys, os, re, itertools
+import sys, os, re, itertools, hashlib, struct
 import networkx as nx
 
 ###############################################################################
@@ -113,14 +113,16 @@ class Event(object):
     ###   fooBar(var.x, var.y)
     ### Or:
     ###   fooBar(x, y)
+    ### param[in] postfix optional postfix added to parameter names (i.e. '_'
+    ### for forwarding the parameters of the method generated by header()).
     ###########################################################################
-    def caller(self, var=''):
+    def caller(self, var='', postfix=''):
         s = '' if var == '' else var + '.'
         params = ''
         for p in self.params:
             if params != '':
                 params += ', '
-            params += s + p
+            params += s + p.strip() + postfix
         return self.name + '(' + params + ')'
 
     def __hash__(self):
@@ -157,8 +159,16 @@ class Transition(object):
         self.count_guard = 0
         # Expected number of times the mock is called (for unit tests).
         self.count_action = 0
-        # Save the arrow direction (for generating the PlantUML file back)
+        # Save the arrow direction (for generating the PlantUML file back)
         self.arrow = ''
+        # Enter the destination composite state from its history pseudo-state:
+        # '' (initial state), 'H' (shallow history) or 'H*' (deep history).
+        self.history = ''
+        # Index of the transition among the transitions having the same origin
+        # and destination states (0 for the first one).
+        self.key = 0
+        # Filter of noisy events: 'debounce(N ms)', 'throttle(N/s)' or ''.
+        self.filter = ''
 
     def __str__(self):
         # Internal transition
@@ -167,6 +177,8 @@ class Transition(object):
                    ' [' + self.guard + '] / ' + self.action
         # source -> destination or destination <- source
         dest = '[*]' if self.destination == '*' else self.destination
+        if self.history != '':
+            dest += '[' + self.history + ']'
         if self.arrow[-1] == '>':
             code = self.origin + ' ' + self.arrow + ' ' + dest
         else:
@@ -176,12 +188,351 @@ class Transition(object):
             code += ' : '
         if self.event.name != '':
             code += self.event.name
+        if self.filter != '':
+            code += ' ' + self.filter
         if self.guard != '':
            code += ' [' + self.guard + ']'
         if self.action != '':
            code += '\\n--\\n' + self.action
         return code
 
+###############################################################################
+### Guard comparing a single variable against literal constants, possibly
+### combined with && and || and parenthesis (i.e. 'speed > 0 && speed <= 10').
+### Such guards can be evaluated on intervals of values instead of calling the
+### guard method. The parsing raises ValueError for any other guard.
+###############################################################################
+class RangeGuard(object):
+    def __init__(self, code):
+        # Name of the compared variable.
+        self.variable = ''
+        # Compared constants: numeric value -> C++ literal.
+        self.constants = dict()
+        # Tokens of the boolean expression.
+        self.tokens = re.findall(r'[A-Za-z_]\w*|[-+]?\d+\.?\d*(?:[eE][-+]?\d+)?[uUlLfF]*|&&|\|\||[<>=!]=|[<>()]|\S', code)
+        self.tree = self.parse_or()
+        if len(self.tokens) != 0 or self.variable == '':
+            raise ValueError(code)
+
+    def pop(self):
+        if len(self.tokens) == 0:
+            raise ValueError('Unexpected end of guard')
+        return self.tokens.pop(0)
+
+    def parse_or(self):
+        tree = self.parse_and()
+        while len(self.tokens) != 0 and self.tokens[0] == '||':
+            self.pop()
+            tree = ('||', tree, self.parse_and())
+        return tree
+
+    def parse_and(self):
+        tree = self.parse_comparison()
+        while len(self.tokens) != 0 and self.tokens[0] == '&&':
+            self.pop()
+            tree = ('&&', tree, self.parse_comparison())
+        return tree
+
+    def parse_comparison(self):
+        token = self.pop()
+        if token == '(':
+            tree = self.parse_or()
+            if self.pop() != ')':
+                raise ValueError('Missing parenthesis')
+            return tree
+        operator = self.pop()
+        operand = self.pop()
+        if operator not in ['<', '<=', '>', '>=', '==', '!=']:
+            raise ValueError(operator)
+        # Constant on the left side: mirror the comparison
+        if re.match(r'[A-Za-z_]', operand):
+            mirror = { '<': '>', '<=': '>=', '>': '<', '>=': '<=', '==': '==', '!=': '!=' }
+            token, operator, operand = operand, mirror[operator], token
+        if not re.match(r'[A-Za-z_]', token) or self.variable not in ['', token]:
+            raise ValueError(token)
+        self.variable = token
+        value = float(operand.rstrip('uUlLfF'))
+        self.constants.setdefault(value, operand)
+        return (operator, value)
+
+    ###########################################################################
+    ### Return the result of the guard for the given value of the variable.
+    ###########################################################################
+    def evaluate(self, x, tree=None):
+        tree = self.tree if tree == None else tree
+        if tree[0] == '||':
+            return self.evaluate(x, tree[1]) or self.evaluate(x, tree[2])
+        if tree[0] == '&&':
+            return self.evaluate(x, tree[1]) and self.evaluate(x, tree[2])
+        return { '<': x < tree[1], '<=': x <= tree[1], '>': x > tree[1], '>=': x >= tree[1],
+                 '==': x == tree[1], '!=': x != tree[1] }[tree[0]]
+
+###############################################################################
+### Compiler of simple guards and actions (i.e. 'count < 10',
+### 'm_reference_speed = refSpeed', 'hours = (hours + 1) % 24') into the
+### register-based bytecode run by the interpreter of include/Interpreter.hpp.
+### Variables are slots of the interpreted instance typed 'int', 'bool' or
+### 'real'. Guards are expressions (arithmetic, comparisons, !, && and ||),
+### actions are assignments (=, +=, -=, *=, /=, %=, ++ and --) separated by ';'.
+### The compilation raises ValueError for any other C++ code (function calls,
+### members ...): these hooks stay bound to C++ callbacks.
+###############################################################################
+class Bytecode(object):
+    # Opcodes, in the order of the enum of include/Interpreter.hpp.
+    OPCODES = ['LOAD', 'STORE', 'CONST', 'ITOF', 'FTOI', 'BOOLI',
+               'ADDI', 'SUBI', 'MULI', 'DIVI', 'MODI', 'NEGI',
+               'ADDF', 'SUBF', 'MULF', 'DIVF', 'NEGF',
+               'EQI', 'NEI', 'LTI', 'LEI', 'GTI', 'GEI',
+               'EQF', 'NEF', 'LTF', 'LEF', 'GTF', 'GEF',
+               'NOT', 'JZ', 'JNZ', 'RET', 'END']
+    # Number of registers of the virtual machine.
+    REGISTERS = 16
+
+    ###########################################################################
+    ### param[in] code the C++ code of the guard or of the action.
+    ### param[in] guard True for a guard, False for an action.
+    ### param[in] variables dictionnary "name => (type, initial value, width)" of
+    ###   the declared variables. Undeclared variables are typed 'int'.
+    ### param[in] defines dictionnary "name => (type, value)" of the macros
+    ###   defining literal constants (i.e. '#define Enable true').
+    ###########################################################################
+    def __init__(self, code, guard, variables, defines):
+        self.variables = variables
+        self.defines = defines
+        # Variables used without being declared.
+        self.undeclared = []
+        # Instructions (opcode, dst, a, b, k) where k is the name of the slot
+        # for LOAD and STORE, the (type, value) of the constant for CONST and
+        # the index of the target instruction for jumps.
+        self.code = []
+        self.tokens = re.findall(r'\d+\.\d*(?:[eE][-+]?\d+)?[fF]?|\.\d+(?:[eE][-+]?\d+)?[fF]?|\d+[uUlL]*|' +
+                                 r'[A-Za-z_]\w*|\+\+|--|[-+*/%]=|&&|\|\||[<>=!]=|\S', code)
+        if guard:
+            register, kind = self.parse_or(0)
+            self.logical(register, kind)
+            self.emit('RET', 0, register)
+        else:
+            while len(self.tokens) != 0:
+                if self.tokens[0] != ';':
+                    self.parse_statement()
+                if len(self.tokens) != 0 and self.pop() != ';':
+                    raise ValueError('Missing ;')
+            self.emit('END')
+        if len(self.tokens) != 0:
+            raise ValueError(code)
+
+    def pop(self):
+        if len(self.tokens) == 0:
+            raise ValueError('Unexpected end of code')
+        return self.tokens.pop(0)
+
+    def emit(self, op, dst=0, a=0, b=0, k=0):
+        if max(dst, a, b) >= Bytecode.REGISTERS:
+            raise ValueError('Too many registers')
+        self.code.append([op, dst, a, b, k])
+        return len(self.code) - 1
+
+    ###########################################################################
+    ### Return the type of the given variable.
+    ###########################################################################
+    def variable(self, name):
+        if not re.match(r'[A-Za-z_]\w*$', name) or name in ['true', 'false'] or name in self.defines:
+            raise ValueError(name)
+        if name not in self.variables and name not in self.undeclared:
+            self.undeclared.append(name)
+        return self.variables.get(name, ('int', 0))[0]
+
+    ###########################################################################
+    ### Convert the register holding a value of the given type to the type of
+    ### the destination. Bool values are ints holding 0 or 1.
+    ###########################################################################
+    def convert(self, register, kind, destination):
+        if destination == 'real' and kind != 'real':
+            self.emit('ITOF', register, register)
+        elif destination != 'real' and kind == 'real':
+            if destination == 'bool':
+                self.emit('CONST', register + 1, k=('real', 0.0))
+                self.emit('NEF', register, register, register + 1)
+            else:
+                self.emit('FTOI', register, register)
+        elif destination == 'bool' and kind == 'int':
+            self.emit('BOOLI', register, register)
+
+    ###########################################################################
+    ### Convert the register to a boolean value (0 or 1).
+    ###########################################################################
+    def logical(self, register, kind):
+        self.convert(register, kind, 'bool')
+
+    def parse_statement(self):
+        token = self.pop()
+        if token in ['++', '--']:
+            self.increment(self.pop(), token)
+        elif len(self.tokens) != 0 and self.tokens[0] in ['++', '--']:
+            self.increment(token, self.pop())
+        else:
+            self.parse_assignment(token, 0)
+
+    def increment(self, name, operator):
+        kind = self.variable(name)
+        self.emit('LOAD', 0, k=name)
+        self.emit('CONST', 1, k=(kind if kind == 'real' else 'int', 1.0 if kind == 'real' else 1))
+        self.emit(('ADD' if operator == '++' else 'SUB') + ('F' if kind == 'real' else 'I'), 0, 0, 1)
+        self.convert(0, 'real' if kind == 'real' else 'int', kind)
+        self.emit('STORE', 0, 0, k=name)
+
+    ###########################################################################
+    ### Compile 'name op expression' (expression possibly being an assignment)
+    ### in the given register and return the type of the stored value.
+    ###########################################################################
+    def parse_assignment(self, name, register):
+        kind = self.variable(name)
+        operator = self.pop()
+        if operator not in ['=', '+=', '-=', '*=', '/=', '%=']:
+            raise ValueError(operator)
+        if operator != '=':
+            self.emit('LOAD', register, k=name)
+            _, right = self.parse_or(register + 1)
+            value = self.binary(register, 'real' if kind == 'real' else 'int', register + 1, right, operator[0])
+        elif len(self.tokens) > 1 and self.tokens[1] in ['=', '+=', '-=', '*=', '/=', '%=']:
+            value = self.parse_assignment(self.pop(), register)
+        else:
+            _, value = self.parse_or(register)
+        self.convert(register, value, kind)
+        self.emit('STORE', 0, register, k=name)
+        return kind
+
+    ###########################################################################
+    ### Emit the binary operation 'left op right' into the register holding
+    ### the left operand and return the type of the result.
+    ###########################################################################
+    def binary(self, register, left, right_register, right, operator):
+        kind = 'real' if 'real' in [left, right] else 'int'
+        if kind == 'real':
+            if left != 'real':
+                self.emit('ITOF', register, register)
+            if right != 'real':
+                self.emit('ITOF', right_register, right_register)
+        if operator == '%' and kind == 'real':
+            raise ValueError('Modulo of real')
+        ops = { '+': 'ADD', '-': 'SUB', '*': 'MUL', '/': 'DIV', '%': 'MOD', '==': 'EQ', '!=': 'NE',
+                '<': 'LT', '<=': 'LE', '>': 'GT', '>=': 'GE' }
+        self.emit(ops[operator] + ('F' if kind == 'real' else 'I'), register, register, right_register)
+        return 'bool' if operator in ['==', '!=', '<', '<=', '>', '>='] else kind
+
+    def parse_or(self, register):
+        return self.parse_logical(register, '||', 'JNZ', self.parse_and)
+
+    def parse_and(self, register):
+        return self.parse_logical(register, '&&', 'JZ', self.parse_equality)
+
+    ###########################################################################
+    ### Short-circuit evaluation of && and ||: jump to the end as soon as the
+    ### result is known.
+    ###########################################################################
+    def parse_logical(self, register, operator, jump, parse):
+        _, kind = parse(register)
+        jumps = []
+        while len(self.tokens) != 0 and self.tokens[0] == operator:
+            self.pop()
+            self.logical(register, kind)
+            jumps.append(self.emit(jump, 0, register))
+            _, kind = parse(register)
+            self.logical(register, kind)
+            kind = 'bool'
+        for j in jumps:
+            self.code[j][4] = len(self.code)
+        return register, kind
+
+    def parse_binary(self, register, operators, parse):
+        _, left = parse(register)
+        while len(self.tokens) != 0 and self.tokens[0] in operators:
+            operator = self.pop()
+            _, right = parse(register + 1)
+            left = self.binary(register, left, register + 1, right, operator)
+        return register, left
+
+    def parse_equality(self, register):
+        return self.parse_binary(register, ['==', '!='], self.parse_relational)
+
+    def parse_relational(self, register):
+        return self.parse_binary(register, ['<', '<=', '>', '>='], self.parse_additive)
+
+    def parse_additive(self, register):
+        return self.parse_binary(register, ['+', '-'], self.parse_multiplicative)
+
+    def parse_multiplicative(self, register):
+        return self.parse_binary(register, ['*', '/', '%'], self.parse_unary)
+
+    def parse_unary(self, register):
+        token = self.pop()
+        if token == '!':
+            _, kind = self.parse_unary(register)
+            if kind == 'real':
+                self.logical(register, kind)
+            self.emit('NOT', register, register)
+            return register, 'bool'
+        if token == '-':
+            _, kind = self.parse_unary(register)
+            self.emit('NEGF' if kind == 'real' else 'NEGI', register, register)
+            return register, kind
+        if token == '+':
+            return self.parse_unary(register)
+        if token == '(':
+            result = self.parse_or(register)
+            if self.pop() != ')':
+                raise ValueError('Missing parenthesis')
+            return result
+        if token in ['true', 'false']:
+            self.emit('CONST', register, k=('int', 1 if token == 'true' else 0))
+            return register, 'bool'
+        if re.match(r'\.?\d', token):
+            if re.match(r'\d+[uUlL]*$', token):
+                self.emit('CONST', register, k=('int', int(token.rstrip('uUlL'))))
+                return register, 'int'
+            self.emit('CONST', register, k=('real', float(token.rstrip('fF'))))
+            return register, 'real'
+        if token in self.defines:
+            kind, value = self.defines[token]
+            self.emit('CONST', register, k=(kind, value))
+            return register, kind
+        if len(self.tokens) != 0 and self.tokens[0] == '(':
+            raise ValueError('Function call ' + token)
+        self.emit('LOAD', register, k=token)
+        return register, self.variable(token)
+
+###############################################################################
+### Worst-case cost of the reaction to an event: number of guards evaluated,
+### hooks executed (entering, leaving and transition actions), hops through
+### the nesting queue (eventless transitions), events forwarded to nested state
+### machines and estimated duration in nanoseconds from '[cost] annotations.
+### Sequences of reactions are added and alternatives take the maximum of each
+### counter, giving an upper bound.
+###############################################################################
+class Cost(object):
+    def __init__(self, guards=0, hooks=0, hops=0, forwards=0, ns=0):
+        self.guards = guards
+        self.hooks = hooks
+        self.hops = hops
+        self.forwards = forwards
+        self.ns = ns
+
+    def __add__(self, other):
+        return Cost(self.guards + other.guards, self.hooks + other.hooks, self.hops + other.hops,
+                    self.forwards + other.forwards, self.ns + other.ns)
+
+    def max(self, other):
+        return Cost(max(self.guards, other.guards), max(self.hooks, other.hooks), max(self.hops, other.hops),
+                    max(self.forwards, other.forwards), max(self.ns, other.ns))
+
+    def __str__(self):
+        count = lambda n, what: ('unbounded' if n == float('inf') else str(n)) + ' ' + what
+        text = ', '.join([count(self.guards, 'guards'), count(self.hooks, 'hooks'),
+                          count(self.hops, 'hops'), count(self.forwards, 'forwards')])
+        if self.ns == float('inf'):
+            return text + ' (unbounded time)'
+        return text + ' ({:g} ns)'.format(self.ns) if self.ns != 0 else text
+
 ###############################################################################
 ### Structure holding information after having parsed a PlantUML state.
 ### PlantUML states are stored as attributes for graph nodes.
@@ -211,6 +562,14 @@ class State(object):
         self.count_entering = 0
         # Expected number of times the mock of exit action is called.
         self.count_leaving = 0
+        # Pseudo-state kind: '' for a real state, 'choice' or 'junction'.
+        # Pseudo-states are never entered: their outgoing transitions are
+        # selected within the transition step reaching them.
+        self.pseudo = ''
+        # Fork and join pseudo-states: list of (nested state machine, state)
+        # of the orthogonal regions entered by the fork or synchronized by the
+        # join.
+        self.regions = []
 
     def __str__(self):
         code = ''
@@ -260,31 +619,58 @@ class ExtraCode(object):
 ###############################################################################
 class StateMachine(object):
     def __init__(self):
-        # The state machine representation as graph structure.
-        # FIXME shall be nx.MultiDiGraph() since we cannot create several events
-        # leaving and entering to the same state or two events from a source
-        # state going to the same destination state.
-        self.graph = nx.DiGraph()
+        # The state machine representation as graph structure. Several
+        # transitions can link the same source and destination states (i.e.
+        # two events, or the same event with different guards).
+        self.graph = nx.MultiDiGraph()
         # Know the parent state machine (needed for composite state).
         self.parent = None
         # Know the nested state machines (needed for composite state).
         self.children = []
+        # Composite state of the parent state machine owning this nested state
+        # machine (upper case).
+        self.owner = ''
+        # Index (starting from 1) of the orthogonal region of the composite
+        # state or 0 if the composite state has a single region.
+        self.region = 0
+        # Orthogonal regions: dictionnary "state => bit mask" of states
+        # synchronized by join pseudo-states of the parent state machine.
+        self.join_bits = {}
+        # Number of bits used in the word synchronizing orthogonal regions.
+        self.region_bits = 0
+        # Index of the first byte holding the current state inside the
+        # configuration word of the root state machine.
+        self.slot = 0
+        # True when the configuration word of the root state machine has no
+        # room left for this nested state machine: it packs its state and the
+        # states of its own nested state machines in its own word.
+        self.detached = False
         # Memorize the initial state of the state machine.
         self.initial_state = ''
         # Memorize the final state of the state machine.
         self.final_state = ''
-        # Dictionnary of "event => (source state, destination state)" needed for
-        # computing tables of state transitions for each events.
+        # Dictionnary of "event => list of Transition" needed for computing
+        # tables of state transitions for each events.
         self.lookup_events = defaultdict(list)
         # Broadcast external event to nested state machines (for composite
         # state only).
         self.broadcasts = [] # tuple (state machine name, Event)
+        # Dictionnary of "event => filter" for events annotated with
+        # 'debounce(N ms)' or 'throttle(N/s)' on their transitions.
+        self.filters = dict()
+        # Dictionnary of "(field, code) => list of Transition" sharing the same
+        # guard or action code, in the graph order. Built on demand and cleared
+        # when the graph changes.
+        self.sharing = dict()
         # Stem of the plantUML file.
         self.name = ''
         # The name of the generated C++ state machine class.
         self.class_name = ''
         # The name of the generated C++ enumerates for defining states.
         self.enum_name = ''
+        # Structurally identical nested state machine whose generated class is
+        # reused by this one (None if this state machine has its own class).
+        self.shared = None
         # Extra lines of C++ code to be merged inside the generated file.
         self.extra_code = ExtraCode()
         # C++ warnings inside the generated file when missformed state
@@ -321,7 +707,280 @@ class StateMachine(object):
     ### param[in] tr the state machine transition to add.
     ###########################################################################
     def add_transition(self, tr):
-        self.graph.add_edge(tr.origin, tr.destination, data=tr)
+        tr.key = self.graph.add_edge(tr.origin, tr.destination, data=tr)
+        self.sharing.clear()
+
+    ###########################################################################
+    ### Return the list of all transitions of the state machine.
+    ###########################################################################
+    def transitions(self):
+        return [tr for (_, _, tr) in self.graph.edges(data='data')]
+
+    ###########################################################################
+    ### Return the list of outgoing transitions of the given state.
+    ### param[in] state the PlantUML name of the state.
+    ###########################################################################
+    def transitions_from(self, state):
+        return [tr for (_, _, tr) in self.graph.out_edges(state, data='data')]
+
+    ###########################################################################
+    ### Return the first transition from the origin state to the destination
+    ### state (for paths of states where the transition taken does not matter).
+    ### param[in] origin the PlantUML name of the origin state.
+    ### param[in] destination the PlantUML name of the destination state.
+    ###########################################################################
+    def transition(self, origin, destination):
+        return list(self.graph[origin][destination].values())[0]['data']
+
+    ###########################################################################
+    ### Return the transitions reacting to the given event from the given
+    ### state, in the order their guards are evaluated: the transition without
+    ### guard is evaluated last.
+    ### param[in] state the PlantUML name of the origin state.
+    ### param[in] transitions the list of transitions of the event.
+    ###########################################################################
+    def guard_chain(self, state, transitions):
+        chain = [tr for tr in transitions if tr.origin == state]
+        return [tr for tr in chain if tr.guard != ''] + [tr for tr in chain if tr.guard == '']
+
+    ###########################################################################
+    ### Return True if the given state is a choice or junction pseudo-state.
+    ### param[in] state the PlantUML name of the state.
+    ###########################################################################
+    def is_pseudo_state(self, state):
+        return self.graph.nodes[state]['data'].pseudo != ''
+
+    ###########################################################################
+    ### Return the outgoing transitions of the given pseudo-state in the order
+    ### their guards are evaluated: the transition without guard (the [else]
+    ### branch) is evaluated last.
+    ### param[in] state the PlantUML name of the pseudo-state.
+    ###########################################################################
+    def pseudo_state_branches(self, state):
+        return self.guard_chain(state, self.transitions_from(state))
+
+    ###########################################################################
+    ### Make each parent state machine forward the given external event to its
+    ### nested state machine leading to this state machine. Each parent only
+    ### knows its direct children: a deeply nested event is forwarded level by
+    ### level.
+    ### param[in] event the external event reacted by this state machine.
+    ###########################################################################
+    def add_broadcast(self, event):
+        if event.name == '':
+            return
+        child, parent = self, self.parent
+        while parent != None:
+            if (child.name, event) not in parent.broadcasts:
+                parent.broadcasts.append((child.name, event))
+            child, parent = parent, parent.parent
+
+    ###########################################################################
+    ### Return the nested state machine owned by the given composite state or
+    ### None if the state is not a composite state.
+    ### param[in] state the PlantUML name of the state.
+    ###########################################################################
+    def nested_machine(self, state):
+        for sm in self.children:
+            if sm.owner_state() == state:
+                return sm
+        return None
+
+    ###########################################################################
+    ### Return the dictionnary "event => list of nested state machine names"
+    ### of external events this state machine shall forward.
+    ###########################################################################
+    def broadcasted_events(self):
+        events = defaultdict(list)
+        for (sm, e) in self.broadcasts:
+            events[e].append(sm)
+        return events
+
+    ###########################################################################
+    ### Return the name of the state of the parent state machine owning this
+    ### nested state machine (composite state). Nested state machines are only
+    ### active when this state is the current state of the parent.
+    ###########################################################################
+    def owner_state(self):
+        return self.owner
+
+    ###########################################################################
+    ### Return the list of composite states owning nested state machines.
+    ###########################################################################
+    def composite_states(self):
+        states = []
+        for sm in self.children:
+            if sm.owner_state() not in states:
+                states.append(sm.owner_state())
+        return states
+
+    ###########################################################################
+    ### Return the nested state machines of the given composite state: a single
+    ### one or one by orthogonal region.
+    ### param[in] state the PlantUML name of the composite state.
+    ###########################################################################
+    def regions_of(self, state):
+        return [sm for sm in self.children if sm.owner_state() == state]
+
+    ###########################################################################
+    ### Return the list of all nested state machines (recursively).
+    ###########################################################################
+    def descendants(self):
+        machines = []
+        for sm in self.children:
+            machines += [sm] + sm.descendants()
+        return machines
+
+    ###########################################################################
+    ### Return the nested state machines packing their state in the same
+    ### configuration word as this state machine: the descendants except the
+    ### detached ones and their own descendants.
+    ###########################################################################
+    def packed_descendants(self):
+        machines = []
+        for sm in self.children:
+            if not sm.detached:
+                machines += [sm] + sm.packed_descendants()
+        return machines
+
+    ###########################################################################
+    ### Return the structural hash of the state machine: its states, its
+    ### transitions, its C++ code and, recursively, its nested state machines.
+    ### The names of the state machine and of its composite state are not part
+    ### of the hash: two submachines with the same hash generate the same class.
+    ###########################################################################
+    def signature(self):
+        text = [self.initial_state, self.final_state, str(self.region_bits)]
+        for name, s in self.graph.nodes(data='data'):
+            text.append('|'.join([name, s.comment, s.entering, s.leaving, s.activity, s.pseudo] +
+                                 [sm.owner + str(sm.region) + ':' + state for (sm, state) in s.regions]))
+        for origin, destination, tr in self.graph.edges(data='data'):
+            text.append('|'.join([origin, destination, tr.event.header(), tr.guard, tr.action, tr.history]))
+        for event, arcs in self.lookup_events.items():
+            text.append(event.header() + str([(tr.origin, tr.destination, tr.key) for tr in arcs]))
+        for sm in self.children:
+            slot = 'detached' if sm.detached else str(sm.slot - self.slot)
+            text.append(sm.owner + str(sm.region) + slot + str(list(sm.join_bits.items())) + sm.signature())
+        for (name, event) in self.broadcasts:
+            sm = [c for c in self.children if c.name == name][0]
+            text.append(sm.owner + str(sm.region) + event.header())
+        text += [event.header() + f for event, f in self.filters.items()]
+        code = self.extra_code
+        text += [code.brief, code.header, code.footer, code.argvs, code.cons, code.init, code.code, code.unit_tests]
+        return hashlib.sha1('\n'.join(text).encode()).hexdigest()
+
+    ###########################################################################
+    ### Return the number of bytes of the configuration word holding the current
+    ### state: two when the enum of states (with IGNORING_EVENT, CANNOT_HAPPEN
+    ### and MAX_STATES) does not fit in a byte.
+    ###########################################################################
+    def slot_width(self):
+        return 2 if self.graph.number_of_nodes() + 2 > 256 else 1
+
+    ###########################################################################
+    ### Return the C++ mask of the current state inside its bytes.
+    ###########################################################################
+    def slot_mask(self):
+        return 0xFFFF if self.slot_width() == 2 else 0xFF
+
+    ###########################################################################
+    ### Return the orthogonal region holding the given state or None.
+    ### param[in] state the PlantUML name of the state.
+    ###########################################################################
+    def region_holding(self, state):
+        for sm in self.children:
+            if sm.region != 0 and state not in ['[*]', '*'] and sm.graph.has_node(state):
+                return sm
+        return None
+
+    ###########################################################################
+    ### Return the list of pseudo-states of the given kind.
+    ### param[in] kind 'choice', 'junction', 'fork' or 'join'.
+    ###########################################################################
+    def pseudo_states(self, kind):
+        return [s for s in self.graph.nodes if self.graph.nodes[s]['data'].pseudo == kind]
+
+    ###########################################################################
+    ### Return True if the transition leaves a composite state toward one of its
+    ### join pseudo-states. This transition is triggered by the orthogonal
+    ### regions and not by an event.
+    ###########################################################################
+    def is_join_edge(self, origin, destination):
+        return self.graph.nodes[destination]['data'].pseudo == 'join'
+
+    ###########################################################################
+    ### Return the first transition of the graph having the same guard or action
+    ### code than the given transition. Transitions with the same code share the
+    ### same generated C++ method.
+    ### param[in] tr the transition.
+    ### param[in] field 'guard' or 'action'.
+    ###########################################################################
+    def canonical_transition(self, tr, field):
+        transitions = self.sharing_transitions(tr, field)
+        return transitions[0] if len(transitions) != 0 else tr
+
+    ###########################################################################
+    ### Return the transitions sharing the guard or action method of the given
+    ### transition.
+    ### param[in] tr the transition.
+    ### param[in] field 'guard' or 'action'.
+    ###########################################################################
+    def sharing_transitions(self, tr, field):
+        if len(self.sharing) == 0:
+            for _, _, t in self.graph.edges(data='data'):
+                for f in ['guard', 'action']:
+                    self.sharing.setdefault((f, getattr(t, f)), []).append(t)
+        return self.sharing.get((field, getattr(tr, field)), [])
+
+    ###########################################################################
+    ### Return True if the given state is only traversed: it is left as soon as
+    ### it is entered by its single outgoing transition having no event, no
+    ### guard and no history. Composite states, pseudo-states, states with an
+    ### activity and states synchronized by join pseudo-states are not transient.
+    ### States with entering or leaving actions are not transient either: their
+    ### actions shall run while the state machine is in the state (isIn()).
+    ### param[in] state the PlantUML name of the state.
+    ###########################################################################
+    def is_transient(self, state):
+        if state in ['[*]', '*'] or self.is_pseudo_state(state) or state in self.join_bits:
+            return False
+        data = self.graph.nodes[state]['data']
+        if self.nested_machine(state) != None or data.activity != '':
+            return False
+        if data.entering != '' or data.leaving != '':
+            return False
+        if self.graph.out_degree(state) != 1:
+            return False
+        tr = self.transitions_from(state)[0]
+        destination = tr.destination
+        return (destination != state) and (tr.event.name == '') and (tr.guard == '') and \
+               (tr.history == '') and not self.is_pseudo_state(destination)
+
+    ###########################################################################
+    ### Return the eventless transitions traversed after the given transition
+    ### when its destination is transient. An empty list is returned when the
+    ### chain comes back to the origin of the transition or loops forever (the
+    ### transitions are then done one by one at runtime).
+    ### param[in] tr the transition.
+    ###########################################################################
+    def eventless_chain(self, tr):
+        chain, origin, state = [], tr.origin, tr.destination
+        while self.is_transient(state):
+            tr = self.transitions_from(state)[0]
+            chain.append(tr)
+            state = tr.destination
+            if state == origin or state in [t.origin for t in chain]:
+                return []
+        return chain
+
+    ###########################################################################
+    ### Return True if the path of states passes through a join pseudo-state.
+    ###########################################################################
+    def has_join_edge(self, path):
+        for i in range(len(path) - 1):
+            if self.is_join_edge(path[i], path[i+1]):
+                return True
+        return False
 
     ###########################################################################
     ### Return all cycles in the graph (list of list of nodes).
@@ -414,7 +1073,7 @@ class StateMachine(object):
                 continue
             # Check if there is at least one event along the cycle path.
             for i in range(len(cycle) - 1):
-                if self.graph[cycle[i]][cycle[i+1]]['data'].event.name != '':
+                if self.transition(cycle[i], cycle[i+1]).event.name != '':
                     find = False
                     break
             # Add the warning in the generated code.
@@ -433,18 +1092,35 @@ class StateMachine(object):
     def verify_transitions(self):
         # Case 1
         for state in list(self.graph.nodes()):
-            out = list(self.graph.neighbors(state))
-            if len(out) <= 1:
+            out = self.transitions_from(state)
+            if len(out) <= 1 or self.is_pseudo_state(state):
                 continue
-            for d in out:
-                tr = self.graph[state][d]['data']
-                if (tr.event.name == '') and (tr.guard == ''):
+            for tr in out:
+                d = tr.destination
+                if (tr.event.name == '') and (tr.guard == '') and not self.is_join_edge(state, d):
                     self.warning('The state ' + state + ' has an issue with its transitions: it has' +
                                  ' several possible ways while the way to state ' + d +
                                  ' is always true and therefore will be always a candidate and transition' +
                                  ' to other states is non determinist.')
         # Case 2: TODO
 
+    ###########################################################################
+    ### Choice and junction pseudo-states shall have at least one outgoing
+    ### transition, outgoing transitions shall not have events and at most one
+    ### of them has no guard (the [else] branch).
+    ###########################################################################
+    def verify_pseudo_states(self):
+        for state in list(self.graph.nodes()):
+            if not self.is_pseudo_state(state):
+                continue
+            branches = self.pseudo_state_branches(state)
+            if len(branches) == 0:
+                self.warning('The pseudo-state ' + state + ' shall have at least one outgoing transition')
+            if len([tr for tr in branches if tr.event.name != '']) != 0:
+                self.warning('Outgoing transitions of the pseudo-state ' + state + ' shall not have events')
+            if len([tr for tr in branches if tr.guard == '']) > 1:
+                self.warning('The pseudo-state ' + state + ' has several outgoing transitions without guard')
+
     ###########################################################################
     ### Entry point to check if the state machine is well formed (determinist).
     ### Do not exit the program or throw exception, just display warning on the
@@ -459,6 +1135,7 @@ class StateMachine(object):
         self.verify_number_of_events()
         self.verify_incoming_transitions()
         self.verify_transitions()
+        self.verify_pseudo_states()
         self.verify_infinite_loops()
         pass
 
@@ -496,6 +1173,21 @@ class Parser(object):
         self.master = StateMachine()
         # Dictionnary of all state machines (master and nested).
         self.machines = dict() # type: StateMachine()
+        # History pseudo-states used by the diagram: '' (none), 'H' (shallow
+        # only) or 'H*' (deep, also allowing shallow).
+        self.history = ''
+        # Command line options (i.e. '--report-dead-states').
+        self.options = []
+        # Estimated duration in nanoseconds of C++ methods (guards and actions)
+        # given by '[cost] annotations: method name -> duration ('default' for
+        # the others).
+        self.costs = dict()
+        # Memory budget of the main state machine given by '[budget] annotations:
+        # 'instance' (bytes), 'tables' (bytes) or 'queue' (transitions) -> limit.
+        self.budgets = dict()
+        # States of the previous version of the tables given by '[migrate]
+        # annotations: (state machine path, old state name) -> new state name.
+        self.migrations = dict()
 
     ###########################################################################
     ### Is the generated file should be a C++ source file or header file ?
@@ -515,6 +1207,16 @@ class Parser(object):
               ": " + msg + f"{bcolors.ENDC}")
         sys.exit(-1)
 
+    ###########################################################################
+    ### Print a report message on the console (information for the designer of
+    ### the state machine, not needing to change the diagram).
+    ### param[in] fsm the state machine concerned by the message.
+    ### param[in] msg the message to print.
+    ###########################################################################
+    def report(self, fsm, msg):
+        print(f"{bcolors.OKBLUE}   REPORT in the state machine " + fsm.name + \
+              ": " + msg + f"{bcolors.ENDC}")
+
     ###########################################################################
     ### Generate a separator line for function.
     ### param[in] spaces the number of spaces char to print.
@@ -595,13 +1297,21 @@ class Parser(object):
         if hpp:
             self.fd.write('#ifndef ' + self.current.class_name.upper() + '_HPP\n')
             self.fd.write('#  define ' + self.current.class_name.upper() + '_HPP\n\n')
-        for sm in self.current.children:
-            self.generate_include(indent, '"', sm.class_name + '.hpp', '"')
+        for c in dict.fromkeys(sm.class_name for sm in self.current.children):
+            self.generate_include(indent, '"', c + '.hpp', '"')
         if len(self.current.children) == 0:
             self.generate_include(indent, '"', 'StateMachine.hpp', '"')
         for w in self.current.warnings:
             self.fd.write('\n#warning "' + w + '"\n')
-        self.fd.write(self.current.extra_code.header)
+        # Nested state machines also need the types of the root state machine
+        # (i.e. parameters of broadcast events): its header code is guarded
+        # to be written once.
+        if self.master.extra_code.header != '':
+            guard = self.master.class_name.upper() + '_HEADER_CODE'
+            self.fd.write('#ifndef ' + guard + '\n')
+            self.fd.write('#  define ' + guard + '\n')
+            self.fd.write(self.master.extra_code.header)
+            self.fd.write('#endif // ' + guard + '\n')
         self.fd.write('\n')
 
     ###########################################################################
@@ -623,6 +1333,9 @@ class Parser(object):
         for state in list(self.current.graph.nodes):
             self.indent(1), self.fd.write(self.state_name(state) + ',')
             comment = self.current.graph.nodes[state]['data'].comment
+            pseudo = self.current.graph.nodes[state]['data'].pseudo
+            if comment == '' and pseudo != '':
+                comment = 'Pseudo-state (' + pseudo + '): never active.'
             if comment != '':
                 self.fd.write(' //!< ' + comment)
             self.fd.write('\n')
@@ -664,24 +1377,113 @@ class Parser(object):
         return self.current.enum_name + '::' + self.state_name(state)
 
     ###########################################################################
-    ### Return the C++ method for transition guards.
-    ### param[in] source the origin state (PlantUML name).
-    ### param[in] destination the destination state (PlantUML name).
+    ### Return the C++ suffix naming the methods of the transition: its origin
+    ### and destination states, followed by its index when several transitions
+    ### link the same states.
+    ### param[in] tr the transition.
+    ###########################################################################
+    def transition_suffix(self, tr):
+        suffix = self.state_name(tr.origin) + '_' + self.state_name(tr.destination)
+        return suffix if tr.key == 0 else suffix + '_' + str(tr.key)
+
+    ###########################################################################
+    ### Return the C++ method for transition guards. Transitions with the same
+    ### guard code share the method named after the first of them.
+    ### param[in] tr the transition.
+    ### param[in] class_name if True prepend the class name.
+    ###########################################################################
+    def guard_function(self, tr, class_name=False):
+        s = self.current.class_name + '::' if class_name else ''
+        return s + 'onGuarding_' + self.transition_suffix(self.current.canonical_transition(tr, 'guard'))
+
+    ###########################################################################
+    ### Return the C++ method for transition actions. Transitions with the same
+    ### action code share the method named after the first of them.
+    ### param[in] tr the transition.
     ### param[in] class_name if True prepend the class name.
     ###########################################################################
-    def guard_function(self, source, destination, class_name=False):
+    def transition_function(self, tr, class_name=False):
         s = self.current.class_name + '::' if class_name else ''
-        return s + 'onGuarding_' + self.state_name(source) + '_' + self.state_name(destination)
+        return s + 'onTransitioning_' + self.transition_suffix(self.current.canonical_transition(tr, 'action'))
 
     ###########################################################################
-    ### Return the C++ method for transition actions.
-    ### param[in] source the origin state (PlantUML name).
-    ### param[in] destination the destination state (PlantUML name).
+    ### Return the C++ method entering the composite state from its history
+    ### pseudo-state when transitioning.
+    ### param[in] tr the transition.
     ### param[in] class_name if True prepend the class name.
     ###########################################################################
-    def transition_function(self, source, destination, class_name=False):
+    def resuming_function(self, tr, class_name=False):
         s = self.current.class_name + '::' if class_name else ''
-        return s + 'onTransitioning_' + self.state_name(source) + '_' + self.state_name(destination)
+        return s + 'onResuming_' + self.transition_suffix(tr)
+
+    ###########################################################################
+    ### Return the C++ method doing the actions of the transition and of the
+    ### eventless transitions chained after it.
+    ### param[in] tr the transition.
+    ### param[in] class_name if True prepend the class name.
+    ###########################################################################
+    def chaining_function(self, tr, class_name=False):
+        s = self.current.class_name + '::' if class_name else ''
+        return s + 'onChaining_' + self.transition_suffix(tr)
+
+    ###########################################################################
+    ### Return the list of C++ calls done by the transition when its eventless
+    ### chain is collapsed: its own action then the outgoing action of each
+    ### traversed transient state (transient states have no entering or leaving
+    ### action).
+    ### param[in] tr the transition.
+    ###########################################################################
+    def chaining_calls(self, tr):
+        calls = [self.transition_function(tr)] if tr.action != '' else []
+        for t in self.current.eventless_chain(tr):
+            if t.action != '':
+                calls.append(self.transition_function(t))
+        return calls
+
+    ###########################################################################
+    ### Return the state reached by the transition: its destination or, when
+    ### its destination is transient, the last state of the eventless chain.
+    ### param[in] tr the transition.
+    ###########################################################################
+    def transition_destination(self, tr):
+        chain = self.current.eventless_chain(tr)
+        return tr.destination if len(chain) == 0 else chain[-1].destination
+
+    ###########################################################################
+    ### Return the C++ method to store as action in the table of transitions or
+    ### '' if the transition has no action.
+    ### param[in] tr the transition.
+    ###########################################################################
+    def transition_action(self, tr):
+        if self.current.graph.nodes[tr.origin]['data'].pseudo == 'fork':
+            return self.forking_function(tr.origin, True)
+        if tr.history != '':
+            return self.resuming_function(tr, True)
+        if len(self.current.eventless_chain(tr)) != 0:
+            if len(self.chaining_calls(tr)) == 0:
+                return ''
+            return self.chaining_function(tr, True)
+        if tr.action != '':
+            return self.transition_function(tr, True)
+        return ''
+
+    ###########################################################################
+    ### Return the C++ method selecting the outgoing transition of a choice or
+    ### junction pseudo-state.
+    ### param[in] state the PlantUML name of the pseudo-state.
+    ### param[in] class_name if True prepend the class name.
+    ###########################################################################
+    def choice_function(self, state, class_name=True):
+        s = self.current.class_name + '::' if class_name else ''
+        return s + 'onChoosing_' + self.state_name(state)
+
+    ###########################################################################
+    ### Return the hook of the tables of states and transitions calling the
+    ### given method (see StateMachine::hook).
+    ### param[in] method the C++ method prefixed by its class name.
+    ###########################################################################
+    def hook(self, method):
+        return '&StateMachine::hook<&' + method + '>'
 
     ###########################################################################
     ### Return the C++ method for entering state actions.
@@ -701,6 +1503,24 @@ class Parser(object):
         s = self.current.class_name + '::' if class_name else ''
         return s + 'onLeaving_' + self.state_name(state)
 
+    ###########################################################################
+    ### Return the C++ method constructing the nested state machine when entering
+    ### a composite state.
+    ### param[in] state the PlantUML name of the state.
+    ###########################################################################
+    def composite_entering_function(self, state, class_name=True):
+        s = self.current.class_name + '::' if class_name else ''
+        return s + 'onEnteringComposite_' + self.state_name(state)
+
+    ###########################################################################
+    ### Return the C++ method destroying the nested state machine when leaving
+    ### a composite state.
+    ### param[in] state the PlantUML name of the state.
+    ###########################################################################
+    def composite_leaving_function(self, state, class_name=True):
+        s = self.current.class_name + '::' if class_name else ''
+        return s + 'onLeavingComposite_' + self.state_name(state)
+
     ###########################################################################
     ### Return the C++ method for internal state transition.
     ### param[in] state the PlantUML name of the state.
@@ -725,8 +1545,122 @@ class Parser(object):
     ###########################################################################
     def child_machine_instance(self, fsm):
         if isinstance(fsm, str):
-            return 'm_nested_' + fsm.lower()
-        return 'm_nested_' + fsm.name.lower()
+            fsm = self.machines[fsm]
+        if fsm.region != 0:
+            return 'std::get<' + str(fsm.region - 1) + '>(m_nested.get<' + \
+                   self.regions_type(fsm.owner_state()) + '>())'
+        return 'm_nested.get<' + fsm.class_name + '>()'
+
+    ###########################################################################
+    ### Return the C++ variable member memorizing the history of the nested state
+    ### machine.
+    ### param[in] fsm the nested state machine.
+    ###########################################################################
+    def child_machine_history(self, fsm):
+        return 'm_history_' + self.child_machine_suffix(fsm)
+
+    ###########################################################################
+    ### Return the C++ index of the byte of the configuration word holding the
+    ### state of the nested state machine, relative to the current state machine.
+    ### param[in] fsm the nested state machine.
+    ###########################################################################
+    def child_machine_slot(self, fsm):
+        offset = str(fsm.slot - self.current.slot) + 'u'
+        if self.current.parent == None:
+            return offset
+        return 'uint8_t(slot() + ' + offset + ')'
+
+    ###########################################################################
+    ### Return the C++ value of a history not yet memorized.
+    ###########################################################################
+    def history_sentinel(self):
+        return 'UINT64_MAX' if self.history == 'H*' else 'UINT16_MAX'
+
+    ###########################################################################
+    ### Return the C++ constant holding the composite state owning the nested
+    ### state machine.
+    ### param[in] fsm the nested state machine.
+    ###########################################################################
+    def child_machine_owner(self, fsm):
+        return 's_owner_' + self.child_machine_suffix(fsm)
+
+    ###########################################################################
+    ### Return the C++ suffix naming the members related to the nested state
+    ### machine. It is made from the composite state and the orthogonal region
+    ### and not from the name of the state machine, since shared submachines
+    ### are generated from the first occurrence.
+    ### param[in] fsm the nested state machine.
+    ###########################################################################
+    def child_machine_suffix(self, fsm):
+        if isinstance(fsm, str):
+            fsm = self.machines[fsm]
+        suffix = fsm.owner_state().lower()
+        return suffix if fsm.region == 0 else suffix + 'region' + str(fsm.region)
+
+    ###########################################################################
+    ### Return the C++ type grouping the orthogonal regions of a composite state.
+    ### param[in] state the PlantUML name of the composite state.
+    ###########################################################################
+    def regions_type(self, state):
+        return 'Regions_' + self.state_name(state)
+
+    ###########################################################################
+    ### Return the C++ constant holding the bits of the states of orthogonal
+    ### regions synchronized by the join pseudo-state.
+    ### param[in] state the PlantUML name of the join pseudo-state.
+    ###########################################################################
+    def join_mask(self, state):
+        return 's_join_' + self.state_name(state).lower()
+
+    ###########################################################################
+    ### Return the C++ constant holding the bits of all the states of orthogonal
+    ### regions of the composite state synchronized by join pseudo-states.
+    ### param[in] state the PlantUML name of the composite state.
+    ###########################################################################
+    def regions_mask(self, state):
+        return 's_regions_' + self.state_name(state).lower()
+
+    ###########################################################################
+    ### Return the value of the join or regions mask as C++ literal.
+    ### param[in] pairs the list of (orthogonal region, state).
+    ###########################################################################
+    def mask_value(self, pairs):
+        mask = 0
+        for (sm, s) in pairs:
+            mask |= sm.join_bits[s]
+        return '0x' + format(mask, 'X') + 'u'
+
+    ###########################################################################
+    ### Return the C++ method memorizing the fork pseudo-state being traversed.
+    ### param[in] state the PlantUML name of the fork pseudo-state.
+    ### param[in] class_name if True prepend the class name.
+    ###########################################################################
+    def forking_function(self, state, class_name=True):
+        s = self.current.class_name + '::' if class_name else ''
+        return s + 'onForking_' + self.state_name(state)
+
+    ###########################################################################
+    ### Return the C++ method leaving the orthogonal regions synchronized by the
+    ### join pseudo-state.
+    ### param[in] state the PlantUML name of the join pseudo-state.
+    ### param[in] class_name if True prepend the class name.
+    ###########################################################################
+    def joining_function(self, state, class_name=True):
+        s = self.current.class_name + '::' if class_name else ''
+        return s + 'onJoining_' + self.state_name(state)
+
+    ###########################################################################
+    ### Return the C++ methods setting or clearing the bit of a state of an
+    ### orthogonal region synchronized by a join pseudo-state.
+    ### param[in] state the PlantUML name of the state.
+    ###########################################################################
+    def join_entering_function(self, state, class_name=True):
+        s = self.current.class_name + '::' if class_name else ''
+        return s + 'onEnteringJoin_' + self.state_name(state)
+
+    def join_leaving_function(self, state, class_name=True):
+        s = self.current.class_name + '::' if class_name else ''
+        return s + 'onLeavingJoin_' + self.state_name(state)
 
     ###########################################################################
     ### Generate the PlantUML code from the graph.
@@ -741,8 +1675,7 @@ class Parser(object):
                 continue
             code += comm + str(state).replace('\n', '\n' + comm) + '\n'
         for src in list(self.current.graph.nodes()):
-            for dest in list(self.current.graph.neighbors(src)):
-                tr = self.current.graph[src][dest]['data']
+            for tr in self.current.transitions_from(src):
                 code += comm + str(tr) + '\n'
         return code
 
@@ -781,26 +1714,43 @@ class Parser(object):
             # Nothing to do with initial state
             if (s.name == '[*]'):
                 continue
+            # Composite states construct and destroy their nested state machine
+            composite = self.current.nested_machine(state) != None
+            # States of orthogonal regions synchronized by join pseudo-states
+            join = state in self.current.join_bits
+            # Choice and junction pseudo-states select their outgoing transition
+            choice = self.current.is_pseudo_state(state) and s.pseudo != 'join'
             # Sparse notation: nullptr are implicit so skip generating them
-            if s.entering == '' and s.leaving == '' and s.internal == '':
+            if s.entering == '' and s.leaving == '' and s.internal == '' and not composite and not join and not choice:
                 continue
             self.indent(2), self.fd.write('m_states[int(' + self.state_enum(s.name) + ')] =\n')
             self.indent(2), self.fd.write('{\n')
-            if s.leaving != '':
-                self.indent(3), self.fd.write('.leaving = &')
-                self.fd.write(self.state_leaving_function(state, True))
+            if composite:
+                self.indent(3), self.fd.write('.leaving = ' + self.hook(self.composite_leaving_function(state, True)))
                 self.fd.write(',\n')
-            if s.entering != '':
-                self.indent(3), self.fd.write('.entering = &')
-                self.fd.write(self.state_entering_function(state, True))
+            elif join:
+                self.indent(3), self.fd.write('.leaving = ' + self.hook(self.join_leaving_function(state, True)))
+                self.fd.write(',\n')
+            elif s.leaving != '':
+                self.indent(3), self.fd.write('.leaving = ' + self.hook(self.state_leaving_function(state, True)))
+                self.fd.write(',\n')
+            if composite:
+                self.indent(3), self.fd.write('.entering = ' + self.hook(self.composite_entering_function(state, True)))
+                self.fd.write(',\n')
+            elif join:
+                self.indent(3), self.fd.write('.entering = ' + self.hook(self.join_entering_function(state, True)))
+                self.fd.write(',\n')
+            elif s.entering != '':
+                self.indent(3), self.fd.write('.entering = ' + self.hook(self.state_entering_function(state, True)))
                 self.fd.write(',\n')
             if s.internal != '':
-                self.indent(3), self.fd.write('.internal = &')
-                self.fd.write(self.state_internal_function(state, True))
+                self.indent(3), self.fd.write('.internal = ' + self.hook(self.state_internal_function(state, True)))
+                self.fd.write(',\n')
+            if choice:
+                self.indent(3), self.fd.write('.choice = ' + self.hook(self.choice_function(state)))
                 self.fd.write(',\n')
             if s.activity != '':
-                self.indent(3), self.fd.write('.activity = &')
-                self.fd.write(self.state_activity_function(state, True))
+                self.indent(3), self.fd.write('.activity = ' + self.hook(self.state_activity_function(state, True)))
                 self.fd.write(',\n')
             self.indent(2), self.fd.write('};\n')
 
@@ -813,11 +1763,12 @@ class Parser(object):
                                      'state and call it actions.')
         self.indent(1)
         self.fd.write(self.current.class_name + '(' + self.current.extra_code.argvs + ')\n')
-        self.indent(2), self.fd.write(': StateMachine(' + self.state_enum(self.current.initial_state) + ')')
+        self.indent(2), self.fd.write(': ' + self.base_class() + '(' + self.state_enum(self.current.initial_state) + ')')
         self.fd.write(self.current.extra_code.cons), self.fd.write('\n')
         self.indent(1), self.fd.write('{\n')
         self.indent(2), self.fd.write('// Init actions on states\n')
         self.generate_table_of_states()
+        self.generate_table_of_handlers()
         self.fd.write('\n'), self.indent(2), self.fd.write('// Init user code\n')
         self.fd.write(self.current.extra_code.init)
         self.indent(1), self.fd.write('}\n\n')
@@ -841,9 +1792,9 @@ class Parser(object):
         self.indent(1), self.fd.write('{\n')
         # Init base class of the state machine
         self.indent(2), self.fd.write('StateMachine::enter();\n')
-        # Init nested state machines
-        for sm in self.current.children:
-            self.indent(2), self.fd.write(self.child_machine_instance(sm) + '.enter();\n')
+        # Nested state machines are constructed when entering their composite state
+        if len(self.current.children) != 0:
+            self.indent(2), self.fd.write('m_nested.reset();\n')
         # User's init code
         if self.current.extra_code.init != '':
             self.fd.write('\n'), self.indent(2), self.fd.write('// Init user code\n')
@@ -862,10 +1813,14 @@ class Parser(object):
         self.indent(1), self.fd.write('void exit()\n')
         self.indent(1), self.fd.write('{\n')
         # Init base class of the state machine
-        self.indent(2), self.fd.write('StateMachine::exit();\n')
-        # Init nested state machines
+        self.indent(2), self.fd.write(self.base_class() + '::exit();\n')
+        # Exit the alive nested state machine
         for sm in self.current.children:
-            self.indent(2), self.fd.write(self.child_machine_instance(sm) + '.exit();\n')
+            self.indent(2), self.fd.write('if (state() == ' + self.child_machine_owner(sm) + ')\n')
+            self.indent(3), self.fd.write(self.child_machine_instance(sm) + '.exit();\n')
+        # Destroy it: nested state machines only live inside their composite state
+        if len(self.current.children) != 0:
+            self.indent(2), self.fd.write('m_nested.reset();\n')
         self.indent(1), self.fd.write('}\n\n')
 
     ###########################################################################
@@ -880,75 +1835,1312 @@ class Parser(object):
 #                    self.indent(2), self.fd.write(self.child_machine_instance(sm) + '.enter();\n')
 #            # Generate the table of transitions
     ###########################################################################
-    def generate_event_methods(self):
-        # Broadcasr external events to nested state machine
-        for (sm, e) in self.current.broadcasts:
-            self.generate_method_comment('Broadcast external event.')
-            self.indent(1), self.fd.write('inline '), self.fd.write(e.header())
-            self.fd.write(' { ' + self.child_machine_instance(sm) + '.' + e.caller() + '; }\n\n')
-        # React to external events
-        for event, arcs in self.current.lookup_events.items():
-            if event.name == '':
+    def generate_event_methods(self):
+        # Broadcast external events to nested state machine. Events also
+        # reacted by this state machine are forwarded from their own method.
+        broadcasts = self.current.broadcasted_events()
+        for e, machines in broadcasts.items():
+            if e in self.current.lookup_events:
+                continue
+            self.generate_method_comment('Broadcast external event.')
+            self.indent(1), self.fd.write('inline '), self.fd.write(e.header() + '\n')
+            self.indent(1), self.fd.write('{\n')
+            self.generate_broadcast(e, machines)
+            self.indent(1), self.fd.write('}\n\n')
+        # React to external events
+        for event, arcs in self.current.lookup_events.items():
+            if event.name == '':
+                continue
+            self.generate_method_comment('External event.')
+            self.indent(1), self.fd.write(event.header() + '\n')
+            self.indent(1), self.fd.write('{\n')
+            # Noisy events are rejected before anything else
+            self.generate_event_filter(event)
+            # Nested state machines react first to the event
+            if event in broadcasts:
+                self.generate_broadcast(event, broadcasts[event])
+                self.fd.write('\n')
+            # Display data event
+            self.indent(2), self.fd.write('LOGD("[' + self.current.class_name.upper() + '][EVENT %s]')
+            if len(event.params) != 0:
+                self.fd.write(' with params XXX') # FIXME a finir
+            self.fd.write('\\n", __func__);\n\n')
+            # Copy data event
+            for arg in event.params:
+                self.indent(2), self.fd.write(arg + ' = ' + arg + '_;\n\n')
+            # Data-only mode: the tables are defined in a separated file
+            if self.data_files() != 0:
+                self.generate_range_selections(event, arcs)
+                self.indent(2), self.fd.write('transition(' + self.data_lookup(event) + ', ')
+                self.fd.write(str(len(self.transition_rows(arcs))) + 'u);\n')
+                self.indent(1), self.fd.write('}\n\n')
+                continue
+            # State-handler mode: the handler of the current state reacts
+            if self.handlers_mode():
+                self.indent(2), self.fd.write('handle(uint8_t(EventId::' + event.name + '));\n')
+                self.indent(1), self.fd.write('}\n\n')
+                continue
+            # Rows of transitions: the transitions of a state reacting to this
+            # event are contiguous and their guards are tried in order
+            origins = list(dict.fromkeys(tr.origin for tr in arcs))
+            rows = dict()
+            self.indent(2), self.fd.write('// State transition and actions\n')
+            self.indent(2), self.fd.write('static const Transition s_rows[] =\n')
+            self.indent(2), self.fd.write('{\n')
+            for origin in origins:
+                chain = self.current.guard_chain(origin, arcs)
+                rows[origin] = sum(len(self.current.guard_chain(o, arcs)) for o in origins[:origins.index(origin)])
+                for tr in chain:
+                    self.generate_transition_row(tr, chain)
+            self.indent(2), self.fd.write('};\n\n')
+            # Table of transitions
+            self.indent(2), self.fd.write('static const Transitions s_transitions =\n')
+            self.indent(2), self.fd.write('{\n')
+            for origin in origins:
+                self.indent(3), self.fd.write('{ ' + self.state_enum(origin) + ', &s_rows[' + str(rows[origin]) + '] },\n')
+            self.indent(2), self.fd.write('};\n\n')
+            self.generate_range_selections(event, arcs)
+            self.indent(2), self.fd.write('transition(s_transitions);\n')
+            self.indent(1), self.fd.write('}\n\n')
+
+    ###########################################################################
+    ### Generate a row of the table of transitions of an external event.
+    ### param[in] tr the transition.
+    ### param[in] chain the transitions of the origin state reacting to the
+    ###   event or None when the guard is not called (compiled ranges).
+    ### param[in] depth the indentation of the row.
+    ###########################################################################
+    def generate_transition_row(self, tr, chain, depth=3):
+        self.indent(depth), self.fd.write('{ // ' + tr.origin + ' --> ' + tr.destination + '\n')
+        self.indent(depth + 1), self.fd.write('.destination = ' + self.state_enum(self.transition_destination(tr)) + ',\n')
+        if chain != None and tr != chain[-1]:
+            self.indent(depth + 1), self.fd.write('.chain = ' + str(len(chain) - chain.index(tr) - 1) + 'u,\n')
+        if tr.guard != '' and chain != None:
+            self.indent(depth + 1), self.fd.write('.guard = ' + self.hook(self.guard_function(tr, True)) + ',\n')
+        if self.transition_action(tr) != '':
+            self.indent(depth + 1), self.fd.write('.action = ' + self.hook(self.transition_action(tr)) + ',\n')
+        self.indent(depth), self.fd.write('},\n')
+
+    ###########################################################################
+    ### Return the C++ type of the filter of an event annotated with
+    ### 'debounce(N ms)' or 'throttle(N/s)', or '' if the event is not filtered.
+    ###########################################################################
+    def filter_type(self, event):
+        if event not in self.current.filters:
+            return ''
+        f = self.current.filters[event]
+        m = re.match(r'^debounce\s*\(\s*(\d+)\s*(us|ms|s)\s*\)$', f)
+        if m != None:
+            scale = { 'us': 1, 'ms': 1000, 's': 1000000 }[m.group(2)]
+            return 'Debounce<' + str(int(m.group(1)) * scale) + 'u>'
+        m = re.match(r'^throttle\s*\(\s*(\d+)\s*/\s*(s|min)\s*\)$', f)
+        period = 1000000 if m.group(2) == 's' else 60000000
+        return 'Throttle<' + str(int(m.group(1))) + 'u, ' + str(period) + 'u>'
+
+    ###########################################################################
+    ### Return the C++ name of the member filtering an event.
+    ###########################################################################
+    def filter_member(self, event):
+        return 'm_filter_' + event.name
+
+    ###########################################################################
+    ### Generate the code rejecting a noisy event at the beginning of its
+    ### method: before forwarding it to nested state machines, logging it,
+    ### looking for the transition of the current state and calling guards.
+    ### Filters are not compiled with mocked guards (unit tests and model
+    ### checker) since they depend on time.
+    ###########################################################################
+    def generate_event_filter(self, event):
+        if self.filter_type(event) == '':
+            return
+        self.fd.write('#if !defined(FSM_MOCKED_GUARDS)\n')
+        self.indent(2), self.fd.write('// Reject redundant events: ' + self.current.filters[event] + '\n')
+        self.indent(2), self.fd.write('if (!' + self.filter_member(event) + '.accept(FSM_CLOCK_US()))\n')
+        self.indent(3), self.fd.write('return ;\n')
+        self.fd.write('#endif\n\n')
+
+    ###########################################################################
+    ### Generate the members holding the timestamps of filtered events.
+    ###########################################################################
+    def generate_filter_members(self):
+        for event in self.current.lookup_events:
+            if event.name == '' or self.filter_type(event) == '':
+                continue
+            self.indent(1), self.fd.write('//! \\brief Filter of event ' + event.name + ': ' + self.current.filters[event] + '\n')
+            self.indent(1), self.fd.write(self.filter_type(event) + ' ' + self.filter_member(event) + ';\n')
+
+    ###########################################################################
+    ### Return the number of files holding the tables of transitions in the
+    ### data-only mode (option --data-only[=N]), 0 when not in this mode.
+    ###########################################################################
+    def data_files(self):
+        for o in self.options:
+            if o == '--data-only':
+                return 1
+            if o.startswith('--data-only='):
+                return max(1, int(o[len('--data-only='):]))
+        return 0
+
+    ###########################################################################
+    ### Return the guard chains of the states reacting to an event, in the
+    ### order of their rows, as a list of tuples (origin state, transitions).
+    ### param[in] arcs the transitions reacting to the event.
+    ###########################################################################
+    def transition_rows(self, arcs):
+        return [(origin, self.current.guard_chain(origin, arcs))
+                for origin in dict.fromkeys(tr.origin for tr in arcs)]
+
+    ###########################################################################
+    ### Return the C++ names of the static tables of the data-only mode. They
+    ### depend on the hooks of the class (see FSM_TABLE in StateMachine.hpp).
+    ###########################################################################
+    def data_rows(self, event, class_name=False):
+        return (self.current.class_name + '::' if class_name else '') + 'FSM_TABLE(s_rows_' + event.name + ')'
+
+    def data_lookup(self, event, class_name=False):
+        return (self.current.class_name + '::' if class_name else '') + 'FSM_TABLE(s_lookup_' + event.name + ')'
+
+    ###########################################################################
+    ### Generate the declarations of the static tables of the data-only mode:
+    ### for each event, its rows of transitions and the lookup of the first row
+    ### of each state, sorted by state. They are defined in separated files.
+    ###########################################################################
+    def generate_data_declarations(self):
+        if self.data_files() == 0:
+            return
+        files = ', '.join(self.data_file(i) for i in range(self.data_files()))
+        self.fd.write('private: // Tables of transitions (defined in ' + files + ')\n\n')
+        for event, arcs in self.current.lookup_events.items():
+            if event.name == '':
+                continue
+            rows = self.transition_rows(arcs)
+            self.indent(1), self.fd.write('//! \\brief Transitions of the event ' + event.name + '.\n')
+            self.indent(1), self.fd.write('static const Transition ' + self.data_rows(event) + '[')
+            self.fd.write(str(sum(len(chain) for (origin, chain) in rows)) + '];\n')
+            self.indent(1), self.fd.write('//! \\brief First transition of the states reacting to the event ' + event.name + '.\n')
+            self.indent(1), self.fd.write('static const Lookup ' + self.data_lookup(event) + '[' + str(len(rows)) + '];\n')
+        self.fd.write('\n')
+
+    ###########################################################################
+    ### Return the name of the given file of tables of the data-only mode.
+    ###########################################################################
+    def data_file(self, index):
+        return self.current.class_name + 'Tables' + ('' if self.data_files() == 1 else str(index)) + '.cpp'
+
+    ###########################################################################
+    ### Generate the files defining the static tables of the data-only mode.
+    ### Tables are plain constant data: they are constant-initialized and their
+    ### compilation time grows linearly with the size of the diagram. Events
+    ### are spread over the files by number of rows so they can be compiled in
+    ### parallel.
+    ### param[in] cxxfile the path of the generated header.
+    ###########################################################################
+    def generate_data_tables(self, cxxfile):
+        count = self.data_files()
+        events = [(e, arcs) for e, arcs in self.current.lookup_events.items() if e.name != '']
+        batches, sizes = [[] for i in range(count)], [0] * count
+        for event, arcs in sorted(events, key=lambda ea: -len(ea[1])):
+            i = sizes.index(min(sizes))
+            batches[i].append((event, arcs))
+            sizes[i] += len(arcs)
+        for i, batch in enumerate(batches):
+            self.fd = open(os.path.join(os.path.dirname(cxxfile), self.data_file(i)), 'w')
+            self.generate_common_header()
+            self.fd.write('// Compile with the MOCKABLE and FSM_MOCKED_GUARDS of the code including the\n')
+            self.fd.write('// header, else the link fails (see FSM_TABLE). Default: the unit tests.\n')
+            self.fd.write('#if !defined(MOCKABLE)\n')
+            self.fd.write('#  define MOCKABLE virtual\n')
+            self.fd.write('#  define FSM_MOCKED_GUARDS\n')
+            self.fd.write('#endif\n')
+            self.fd.write('#include "' + self.current.class_name + '.hpp"\n')
+            for event, arcs in batch:
+                rows = self.transition_rows(arcs)
+                fsm = self.current.class_name
+                states = list(self.current.graph.nodes)
+                self.fd.write('\n// Event ' + event.name + '\n')
+                self.fd.write('const ' + fsm + '::Transition ' + self.data_rows(event, True) + '[')
+                self.fd.write(str(sum(len(chain) for (origin, chain) in rows)) + '] =\n{\n')
+                first = []
+                for (origin, chain) in rows:
+                    first.append((origin, sum(len(c) for (o, c) in rows[:len(first)])))
+                    for tr in chain:
+                        self.generate_transition_row(tr, chain, 1)
+                self.fd.write('};\n\n')
+                self.fd.write('const ' + fsm + '::Lookup ' + self.data_lookup(event, True) + '[' + str(len(rows)) + '] =\n{\n')
+                for (origin, row) in sorted(first, key=lambda o: states.index(o[0])):
+                    self.indent(1), self.fd.write('{ uint16_t(' + self.state_enum(origin) + '), &' + self.data_rows(event, True) + '[' + str(row) + '] },\n')
+                self.fd.write('};\n')
+            self.fd.close()
+
+    ###########################################################################
+    ### Return True when generating the state-handler mode (option --handlers):
+    ### the current state is stored as a pointer to a function switching over
+    ### the events it reacts to.
+    ###########################################################################
+    def handlers_mode(self):
+        return '--handlers' in self.options
+
+    ###########################################################################
+    ### Return the C++ method reacting to the external events of the given
+    ### state in the state-handler mode.
+    ###########################################################################
+    def handler_function(self, state, class_name=False):
+        return (self.current.class_name + '::' if class_name else '') + 'onEvent_' + self.state_name(state)
+
+    ###########################################################################
+    ### Return the external events of the current state machine reacting from
+    ### the given state as a list of tuples (event, transitions of the state).
+    ###########################################################################
+    def handled_events(self, state):
+        events = []
+        for event, arcs in self.current.lookup_events.items():
+            if event.name != '' and any(tr.origin == state for tr in arcs):
+                events.append((event, arcs))
+        return events
+
+    ###########################################################################
+    ### Generate the table giving the handler of external events of each state
+    ### in the state-handler mode. States not reacting to external events, and
+    ### the mandatory internal states, share the handler ignoring events.
+    ###########################################################################
+    def generate_table_of_handlers(self):
+        if not self.handlers_mode():
+            return
+        self.fd.write('\n'), self.indent(2), self.fd.write('// Handlers of external events by state\n')
+        self.indent(2), self.fd.write('static const Handler s_handlers[int(' + self.current.enum_name + '::MAX_STATES)] =\n')
+        self.indent(2), self.fd.write('{\n')
+        for state in list(self.current.graph.nodes):
+            method = self.handler_function(state, True) if len(self.handled_events(state)) != 0 else self.current.class_name + '::ignoreEvent'
+            self.indent(3), self.fd.write('&StateMachine::handler<&' + method + '>, // ' + self.state_name(state) + '\n')
+        for state in ['IGNORING_EVENT', 'CANNOT_HAPPEN']:
+            self.indent(3), self.fd.write('&StateMachine::handler<&' + self.current.class_name + '::ignoreEvent>, // ' + state + '\n')
+        self.indent(2), self.fd.write('};\n')
+        self.indent(2), self.fd.write('handlers(s_handlers);\n')
+
+    ###########################################################################
+    ### Generate the handlers of the state-handler mode: for each state, a
+    ### method switching over the external events it reacts to and doing the
+    ### transition, so reacting to an event is a single indirect call with no
+    ### lookup of the table of transitions keyed on the state.
+    ###########################################################################
+    def generate_handler_methods(self):
+        if not self.handlers_mode():
+            return
+        events = [e for e in self.current.lookup_events if e.name != '']
+        self.fd.write('private: // Handlers of external events by state\n\n')
+        self.indent(1), self.fd.write('//! \\brief Identifier of the external events.\n')
+        self.indent(1), self.fd.write('enum class EventId : uint8_t { ' + ', '.join(e.name for e in events) + ' };\n\n')
+        self.generate_method_comment('Handler of the states not reacting to external events.')
+        self.indent(1), self.fd.write('void ignoreEvent(uint8_t const /*event*/)\n')
+        self.indent(1), self.fd.write('{\n')
+        self.indent(2), self.fd.write('LOGD("[STATE MACHINE] Ignoring external event\\n");\n')
+        self.indent(1), self.fd.write('}\n\n')
+        for state in list(self.current.graph.nodes):
+            handled = self.handled_events(state)
+            if len(handled) == 0:
+                continue
+            self.generate_method_comment('Handler of the external events of the state ' + self.state_name(state) + '.')
+            self.indent(1), self.fd.write('void ' + self.handler_function(state) + '(uint8_t const event)\n')
+            self.indent(1), self.fd.write('{\n')
+            self.indent(2), self.fd.write('switch (EventId(event))\n')
+            self.indent(2), self.fd.write('{\n')
+            for event, arcs in handled:
+                self.indent(2), self.fd.write('case EventId::' + event.name + ':\n')
+                self.indent(2), self.fd.write('{\n')
+                for (origin, chain, guards, offset) in self.range_compiled(arcs):
+                    if origin != state:
+                        continue
+                    self.fd.write('#if !defined(FSM_MOCKED_GUARDS)\n')
+                    self.indent(3), self.fd.write('transition(&' + self.range_rows_function(event) + '()[' + str(offset) + '], ')
+                    self.fd.write(self.range_function(event, origin) + '(' + guards[0].variable + '));\n')
+                    self.indent(3), self.fd.write('return ;\n')
+                    self.fd.write('#endif\n')
+                chain = self.current.guard_chain(state, arcs)
+                self.indent(3), self.fd.write('static const Transition s_rows[] =\n')
+                self.indent(3), self.fd.write('{\n')
+                for tr in chain:
+                    self.generate_transition_row(tr, chain, 4)
+                self.indent(3), self.fd.write('};\n')
+                self.indent(3), self.fd.write('transition(s_rows);\n')
+                self.indent(3), self.fd.write('break;\n')
+                self.indent(2), self.fd.write('}\n')
+            self.indent(2), self.fd.write('default:\n')
+            self.indent(3), self.fd.write('LOGD("[STATE MACHINE] Ignoring external event\\n");\n')
+            self.indent(3), self.fd.write('break;\n')
+            self.indent(2), self.fd.write('}\n')
+            self.indent(1), self.fd.write('}\n\n')
+
+    ###########################################################################
+    ### Return the range guards of the transitions of a state reacting to an
+    ### event when all of them compare the same variable against constants
+    ### (the last transition may have no guard), else return None.
+    ### param[in] chain the transitions of the state reacting to the event.
+    ###########################################################################
+    def range_guards(self, chain):
+        if len(chain) < 2:
+            return None
+        try:
+            guards = [RangeGuard(tr.guard) for tr in chain if tr.guard != '']
+        except ValueError:
+            return None
+        if len(set(g.variable for g in guards)) != 1:
+            return None
+        return guards
+
+    ###########################################################################
+    ### Generate the code of an external event selecting the transition of the
+    ### states whose guards only compare a variable against constants instead
+    ### of calling the guards one by one. Unit tests mock guards and therefore
+    ### define FSM_MOCKED_GUARDS to keep calling them.
+    ### param[in] event the external event.
+    ### param[in] arcs the transitions reacting to the event.
+    ###########################################################################
+    def generate_range_selections(self, event, arcs):
+        compiled = self.range_compiled(arcs)
+        if len(compiled) == 0:
+            return
+        self.fd.write('#if !defined(FSM_MOCKED_GUARDS)\n')
+        self.indent(2), self.fd.write('// Guards only comparing a variable against constants: binary search\n')
+        self.indent(2), self.fd.write('// of the transition among intervals of values\n')
+        for (origin, chain, guards, offset) in compiled:
+            self.indent(2), self.fd.write('if (state() == ' + self.state_enum(origin) + ')\n')
+            self.indent(2), self.fd.write('{\n')
+            self.indent(3), self.fd.write('transition(&' + self.range_rows_function(event) + '()[' + str(offset) + '], ')
+            self.fd.write(self.range_function(event, origin) + '(' + guards[0].variable + '));\n')
+            self.indent(3), self.fd.write('return ;\n')
+            self.indent(2), self.fd.write('}\n')
+        self.fd.write('#endif\n\n')
+
+    ###########################################################################
+    ### Return the states whose transitions reacting to an event are selected
+    ### by range guards as a list of tuples (origin state, transitions, range
+    ### guards, index of the first transition among the ranged transitions).
+    ### param[in] arcs the transitions reacting to the event.
+    ###########################################################################
+    def range_compiled(self, arcs):
+        compiled = []
+        offset = 0
+        for origin in dict.fromkeys(tr.origin for tr in arcs):
+            chain = self.current.guard_chain(origin, arcs)
+            guards = self.range_guards(chain)
+            if guards != None:
+                compiled.append((origin, chain, guards, offset))
+                offset += len(chain)
+        return compiled
+
+    ###########################################################################
+    ### Return the C++ method holding the transitions selected by range guards
+    ### for the given event.
+    ###########################################################################
+    def range_rows_function(self, event):
+        return 'onRangingRows_' + event.name
+
+    ###########################################################################
+    ### Return the C++ method selecting the transition of the given state by
+    ### range guards for the given event.
+    ###########################################################################
+    def range_function(self, event, state):
+        return 'onRanging_' + event.name + '_' + self.state_name(state)
+
+    ###########################################################################
+    ### Generate the methods selecting transitions by range guards: the table of
+    ### transitions without guards of each event and, for each state, the
+    ### binary search returning the index of the transition from the value of
+    ### the compared variable. Selections are static and branch-free so they
+    ### can be inlined and vectorized by batch events.
+    ###########################################################################
+    def generate_range_methods(self):
+        for event, arcs in self.current.lookup_events.items():
+            compiled = self.range_compiled(arcs)
+            if event.name == '' or len(compiled) == 0:
+                continue
+            self.generate_method_comment('Transitions of the event ' + event.name + ' selected by range guards.')
+            self.indent(1), self.fd.write('static Transition const* ' + self.range_rows_function(event) + '()\n')
+            self.indent(1), self.fd.write('{\n')
+            self.indent(2), self.fd.write('static const Transition s_ranges[] =\n')
+            self.indent(2), self.fd.write('{\n')
+            for (origin, chain, guards, offset) in compiled:
+                for tr in chain:
+                    self.generate_transition_row(tr, None)
+            self.indent(2), self.fd.write('};\n\n')
+            self.indent(2), self.fd.write('return s_ranges;\n')
+            self.indent(1), self.fd.write('}\n\n')
+            for (origin, chain, guards, offset) in compiled:
+                self.generate_method_comment('Range guards of the state ' + origin + ' for the event ' + event.name + '.')
+                self.indent(1), self.fd.write('template<class T>\n')
+                self.indent(1), self.fd.write('static inline int ' + self.range_function(event, origin) + '(T const value)\n')
+                self.indent(1), self.fd.write('{\n')
+                self.indent(2), self.fd.write('return ' + self.range_selection(event, origin, chain, guards, 'value') + ';\n')
+                self.indent(1), self.fd.write('}\n\n')
+
+    ###########################################################################
+    ### Generate batch external events: the event reacts for several state
+    ### machines whose parameters are given by columns (one value per state
+    ### machine). Range guards comparing a parameter are evaluated on whole
+    ### columns by branch-free loops the compiler can vectorize, then each
+    ### state machine does its selected transition. Composite states whose
+    ### nested state machines react first to the event (broadcast events) are
+    ### not batched: their state machines call the regular event method.
+    ###########################################################################
+    def generate_batch_event_methods(self):
+        broadcasts = self.current.broadcasted_events()
+        for event, arcs in self.current.lookup_events.items():
+            if event.name == '' or len(event.params) == 0:
+                continue
+            # Filtered events depend on the time of each call
+            if self.filter_type(event) != '':
+                continue
+            owners = [self.machines[sm].owner_state() for sm in broadcasts.get(event, [])]
+            compiled = [c for c in self.range_compiled(arcs) if c[0] not in owners and
+                        c[2][0].variable in [p.strip() for p in event.params]]
+            if len(compiled) == 0:
+                continue
+            fsm = self.current.class_name
+            params = [p.strip() for p in event.params]
+            self.generate_method_comment('Batch external event: parameters are given by columns, one value by state machine.')
+            self.indent(1), self.fd.write('static void ' + event.name + '(' + fsm + '* const fsms[], ')
+            self.fd.write(', '.join(p.upper() + ' const ' + p + '_[]' for p in params) + ', size_t const count)\n')
+            self.indent(1), self.fd.write('{\n')
+            self.fd.write('#if defined(FSM_MOCKED_GUARDS)\n')
+            self.indent(2), self.fd.write('for (size_t i = 0u; i < count; ++i)\n')
+            self.indent(3), self.fd.write('fsms[i]->' + event.name + '(' + ', '.join(p + '_[i]' for p in params) + ');\n')
+            self.fd.write('#else\n')
+            self.indent(2), self.fd.write('constexpr size_t BATCH = 64u;\n')
+            for (origin, chain, guards, offset) in compiled:
+                self.indent(2), self.fd.write('int8_t ranges_' + self.state_name(origin) + '[BATCH];\n')
+            self.indent(2), self.fd.write('for (size_t first = 0u; first < count; first += BATCH)\n')
+            self.indent(2), self.fd.write('{\n')
+            self.indent(3), self.fd.write('size_t const n = (count - first < BATCH) ? (count - first) : BATCH;\n')
+            for (origin, chain, guards, offset) in compiled:
+                self.indent(3), self.fd.write('for (size_t i = 0u; i < n; ++i)\n')
+                self.indent(4), self.fd.write('ranges_' + self.state_name(origin) + '[i] = int8_t(' + self.range_function(event, origin))
+                self.fd.write('(' + guards[0].variable + '_[first + i]));\n')
+            self.indent(3), self.fd.write('for (size_t i = 0u; i < n; ++i)\n')
+            self.indent(3), self.fd.write('{\n')
+            self.indent(4), self.fd.write(fsm + '& fsm = *fsms[first + i];\n')
+            for (origin, chain, guards, offset) in compiled:
+                self.indent(4), self.fd.write('if (fsm.state() == ' + self.state_enum(origin) + ')\n')
+                self.indent(4), self.fd.write('{\n')
+                for p in params:
+                    self.indent(5), self.fd.write('fsm.' + p + ' = ' + p + '_[first + i];\n')
+                self.indent(5), self.fd.write('fsm.transition(&' + self.range_rows_function(event) + '()[' + str(offset) + '], ')
+                self.fd.write('ranges_' + self.state_name(origin) + '[i]);\n')
+                self.indent(5), self.fd.write('continue ;\n')
+                self.indent(4), self.fd.write('}\n')
+            self.indent(4), self.fd.write('fsm.' + event.name + '(' + ', '.join(p + '_[first + i]' for p in params) + ');\n')
+            self.indent(3), self.fd.write('}\n')
+            self.indent(2), self.fd.write('}\n')
+            self.fd.write('#endif\n')
+            self.indent(1), self.fd.write('}\n\n')
+
+    ###########################################################################
+    ### Return the C++ expression selecting the index of the transition (-1
+    ### for none) from the value of the variable compared by the range guards:
+    ### a binary search among intervals of values. Constants split the values
+    ### into elementary intervals ]-inf, c0[, [c0, c0], ]c0, c1[ ... ]cn, +inf[
+    ### on which guards are constant: each interval gets the first transition
+    ### whose guard is true and adjacent intervals with the same transition are
+    ### merged. Overlapping guards and values not reacting to the event are
+    ### reported.
+    ### param[in] event the external event.
+    ### param[in] origin the origin state of the transitions.
+    ### param[in] chain the transitions of the state reacting to the event.
+    ### param[in] guards the range guards of the transitions.
+    ### param[in] name the C++ name of the compared variable.
+    ###########################################################################
+    def range_selection(self, event, origin, chain, guards, name):
+        x = guards[0].variable
+        literals = dict()
+        for g in guards:
+            literals.update(g.constants)
+        values = sorted(literals.keys())
+        # Elementary intervals: (value inside the interval, lower and upper bound texts)
+        segments = [(values[0] - 1.0, ']-inf', literals[values[0]] + '[')]
+        for i, v in enumerate(values):
+            segments.append((v, '[' + literals[v], literals[v] + ']'))
+            if i + 1 < len(values):
+                segments.append(((v + values[i + 1]) / 2.0, ']' + literals[v], literals[values[i + 1]] + '['))
+        segments.append((values[-1] + 1.0, ']' + literals[values[-1]], '+inf['))
+        # First transition whose guard is true on each interval
+        rows = []
+        for (value, lower, upper) in segments:
+            passing = [i for i in range(len(chain)) if i >= len(guards) or guards[i].evaluate(value)]
+            rows.append(passing[0] if len(passing) != 0 else -1)
+            overlap = [chain[i] for i in passing if i < len(guards)]
+            if len(overlap) > 1:
+                self.report(self.current, 'Guards of the transitions ' + ', '.join(tr.origin + ' --> ' +
+                            tr.destination for tr in overlap) + ' on event ' + event.name + ' overlap for ' +
+                            x + ' in ' + lower + ', ' + upper + ': the first one is taken')
+        # Merge adjacent intervals: (transition, first and last elementary intervals)
+        ranges = []
+        for i, row in enumerate(rows):
+            if len(ranges) != 0 and ranges[-1][0] == row:
+                ranges[-1] = (row, ranges[-1][1], i)
+            else:
+                ranges.append((row, i, i))
+        for (row, first, last) in ranges:
+            if row == -1:
+                self.report(self.current, 'The state ' + origin + ' does not react to the event ' + event.name +
+                            ' for ' + x + ' in ' + segments[first][1] + ', ' + segments[last][2])
+        # Binary search: the boundary is 'x < c' after an open interval and
+        # 'x <= c' after a single value
+        def search(lo, hi):
+            if lo == hi:
+                return str(ranges[lo][0])
+            mid = (lo + hi) // 2
+            last = ranges[mid][2]
+            bound = name + (' < ' if last % 2 == 0 else ' <= ') + literals[values[last // 2]]
+            return '(' + bound + ') ? ' + nested(lo, mid) + ' : ' + nested(mid + 1, hi)
+        def nested(lo, hi):
+            return search(lo, hi) if lo == hi else '(' + search(lo, hi) + ')'
+        return search(0, len(ranges) - 1)
+
+    ###########################################################################
+    ### Generate the code forwarding an external event to nested state machines.
+    ### Nested state machines not owned by the current state are inactive: the
+    ### event is rejected with a single comparison instead of letting the nested
+    ### state machine look up its table of transitions.
+    ### param[in] event the external event to forward.
+    ### param[in] machines the list of names of nested state machines.
+    ###########################################################################
+    def generate_broadcast(self, event, machines):
+        for sm in machines:
+            self.indent(2), self.fd.write('if (state() == ' + self.child_machine_owner(sm) + ')\n')
+            self.indent(3), self.fd.write(self.child_machine_instance(sm) + '.' + event.caller('', '_') + ';\n')
+        # Orthogonal regions may have reached their join pseudo-states
+        owners = [self.machines[sm].owner_state() for sm in machines]
+        for join in self.current.pseudo_states('join'):
+            regions = self.current.graph.nodes[join]['data'].regions
+            if len(regions) != 0 and regions[0][0].owner_state() in owners:
+                self.indent(2), self.fd.write(self.joining_function(join, False) + '();\n')
+
+    ###########################################################################
+    ### Generate the entering and leaving actions of composite states: the nested
+    ### state machine is constructed after the entering action of the composite
+    ### state and destroyed before its leaving action.
+    ###########################################################################
+    def generate_composite_methods(self):
+        for sm in self.current.children:
+            if sm.region == 1:
+                self.generate_regions_methods(sm.owner_state())
+            if sm.region != 0:
+                continue
+            state = self.current.graph.nodes[sm.owner_state()]['data']
+            self.generate_method_comment('Construct and enter the nested state machine when entering the state ' + state.name + '.')
+            self.indent(1), self.fd.write('void ' + self.composite_entering_function(state.name, False) + '()\n')
+            self.indent(1), self.fd.write('{\n')
+            if state.entering != '':
+                self.indent(2), self.fd.write(self.state_entering_function(state.name, False) + '();\n')
+            self.indent(2), self.fd.write(sm.class_name + '& nested = m_nested.emplace<' + sm.class_name + '>();\n')
+            if not sm.detached:
+                self.indent(2), self.fd.write('nested.bind(word(), ' + self.child_machine_slot(sm) + ');\n')
+            if self.deferred_mode():
+                self.indent(2), self.fd.write('nested.commands(commands());\n')
+            if self.history == '':
+                self.indent(2), self.fd.write('nested.enter();\n')
+            else:
+                self.indent(2), self.fd.write('if ((m_resuming != StateMachineEngine::History::NONE) && (' + self.child_machine_history(sm) +
+                                              ' != ' + self.history_sentinel() + '))\n')
+                if self.history == 'H*':
+                    self.indent(3), self.fd.write('nested.resume(' + self.child_machine_history(sm) + ', m_resuming == StateMachineEngine::History::DEEP);\n')
+                else:
+                    self.indent(3), self.fd.write('nested.resume(' + sm.enum_name + '(' + self.child_machine_history(sm) + '));\n')
+                self.indent(2), self.fd.write('else\n')
+                self.indent(3), self.fd.write('nested.enter();\n')
+                self.indent(2), self.fd.write('m_resuming = StateMachineEngine::History::NONE;\n')
+            self.indent(1), self.fd.write('}\n\n')
+            self.generate_method_comment('Exit and destroy the nested state machine when leaving the state ' + state.name + '.')
+            self.indent(1), self.fd.write('void ' + self.composite_leaving_function(state.name, False) + '()\n')
+            self.indent(1), self.fd.write('{\n')
+            if self.history == 'H*':
+                self.indent(2), self.fd.write(self.child_machine_history(sm) + ' = ' + self.child_machine_instance(sm) + '.configuration();\n')
+            elif self.history == 'H':
+                self.indent(2), self.fd.write(self.child_machine_history(sm) + ' = uint16_t(' + self.child_machine_instance(sm) + '.state());\n')
+            self.indent(2), self.fd.write(self.child_machine_instance(sm) + '.exit();\n')
+            self.indent(2), self.fd.write('m_nested.reset();\n')
+            if state.leaving != '':
+                self.indent(2), self.fd.write(self.state_leaving_function(state.name, False) + '();\n')
+            self.indent(1), self.fd.write('}\n\n')
+
+    ###########################################################################
+    ### Generate the entering and leaving actions of composite states holding
+    ### orthogonal regions: all nested state machines are constructed together.
+    ### They are entered from their initial state or, when reached by a fork
+    ### pseudo-state, directly in the state targeted by the fork.
+    ### param[in] composite the PlantUML name of the composite state.
+    ###########################################################################
+    def generate_regions_methods(self, composite):
+        state = self.current.graph.nodes[composite]['data']
+        regions = self.current.regions_of(composite)
+        forks = [f for f in self.current.pseudo_states('fork')
+                 if self.current.graph.has_edge(f, composite)]
+        joins = [j for j in self.current.pseudo_states('join')
+                 if self.current.graph.has_edge(composite, j)]
+        synchronized = len([sm for sm in regions if len(sm.join_bits) != 0]) != 0
+        self.generate_method_comment('Construct and enter the orthogonal regions when entering the state ' + composite + '.')
+        self.indent(1), self.fd.write('void ' + self.composite_entering_function(composite, False) + '()\n')
+        self.indent(1), self.fd.write('{\n')
+        if state.entering != '':
+            self.indent(2), self.fd.write(self.state_entering_function(composite, False) + '();\n')
+        if synchronized:
+            self.indent(2), self.fd.write('m_regions &= ~' + self.regions_mask(composite) + ';\n')
+        self.indent(2), self.fd.write(self.regions_type(composite) + '& regions = m_nested.emplace<' +
+                                      self.regions_type(composite) + '>();\n')
+        for sm in regions:
+            region = 'std::get<' + str(sm.region - 1) + '>(regions)'
+            if not sm.detached:
+                self.indent(2), self.fd.write(region + '.bind(word(), ' + self.child_machine_slot(sm) + ');\n')
+            if self.deferred_mode():
+                self.indent(2), self.fd.write(region + '.commands(commands());\n')
+            if len(sm.join_bits) != 0:
+                self.indent(2), self.fd.write(region + '.synchronize(m_regions);\n')
+            cond = 'if'
+            for f in forks:
+                for (r, s) in self.current.graph.nodes[f]['data'].regions:
+                    if r == sm:
+                        self.indent(2), self.fd.write(cond + ' (m_forking == ' + self.state_enum(f) + ')\n')
+                        self.indent(3), self.fd.write(region + '.resume(' + sm.enum_name + '::' + s + ');\n')
+                        cond = 'else if'
+            if cond == 'if':
+                self.indent(2), self.fd.write(region + '.enter();\n')
+            else:
+                self.indent(2), self.fd.write('else\n')
+                self.indent(3), self.fd.write(region + '.enter();\n')
+        if len(self.current.pseudo_states('fork')) != 0:
+            self.indent(2), self.fd.write('m_forking = ' + self.current.enum_name + '::MAX_STATES;\n')
+        for j in joins:
+            self.indent(2), self.fd.write(self.joining_function(j, False) + '();\n')
+        self.indent(1), self.fd.write('}\n\n')
+        self.generate_method_comment('Exit and destroy the orthogonal regions when leaving the state ' + composite + '.')
+        self.indent(1), self.fd.write('void ' + self.composite_leaving_function(composite, False) + '()\n')
+        self.indent(1), self.fd.write('{\n')
+        for sm in regions:
+            self.indent(2), self.fd.write(self.child_machine_instance(sm) + '.exit();\n')
+        self.indent(2), self.fd.write('m_nested.reset();\n')
+        if synchronized:
+            self.indent(2), self.fd.write('m_regions &= ~' + self.regions_mask(composite) + ';\n')
+        if state.leaving != '':
+            self.indent(2), self.fd.write(self.state_leaving_function(composite, False) + '();\n')
+        self.indent(1), self.fd.write('}\n\n')
+
+    ###########################################################################
+    ### Generate the methods of fork and join pseudo-states. A fork memorizes
+    ### itself before entering the composite state. A join leaves the composite
+    ### state when the bits of all its states are set in the word updated by the
+    ### orthogonal regions: a single mask comparison.
+    ###########################################################################
+    def generate_fork_join_methods(self):
+        for f in self.current.pseudo_states('fork'):
+            if len(self.current.graph.nodes[f]['data'].regions) == 0:
+                continue
+            self.generate_method_comment('Enter the orthogonal regions from the fork pseudo-state ' + f + '.')
+            self.indent(1), self.fd.write('void ' + self.forking_function(f, False) + '()\n')
+            self.indent(1), self.fd.write('{\n')
+            self.indent(2), self.fd.write('m_forking = ' + self.state_enum(f) + ';\n')
+            self.indent(1), self.fd.write('}\n\n')
+        for j in self.current.pseudo_states('join'):
+            if len(self.current.graph.nodes[j]['data'].regions) == 0:
+                continue
+            self.generate_method_comment('Leave the orthogonal regions when all of them reached the join pseudo-state ' + j + '.')
+            self.indent(1), self.fd.write('void ' + self.joining_function(j, False) + '()\n')
+            self.indent(1), self.fd.write('{\n')
+            for tr in self.current.pseudo_state_branches(j):
+                self.indent(2), self.fd.write('static const Transition tr =\n')
+                self.indent(2), self.fd.write('{\n')
+                self.indent(3), self.fd.write('.destination = ' + self.state_enum(self.transition_destination(tr)) + ',\n')
+                if tr.guard != '':
+                    self.indent(3), self.fd.write('.guard = ' + self.hook(self.guard_function(tr, True)) + ',\n')
+                if self.transition_action(tr) != '':
+                    self.indent(3), self.fd.write('.action = ' + self.hook(self.transition_action(tr)) + ',\n')
+                self.indent(2), self.fd.write('};\n\n')
+                self.indent(2), self.fd.write('if ((m_regions & ' + self.join_mask(j) + ') == ' + self.join_mask(j) + ')\n')
+                self.indent(3), self.fd.write('transition(&tr);\n')
+                break
+            self.indent(1), self.fd.write('}\n\n')
+
+    ###########################################################################
+    ### Generate the methods of an orthogonal region updating the word of the
+    ### parent state machine when entering or leaving states synchronized by
+    ### join pseudo-states.
+    ###########################################################################
+    def generate_join_methods(self):
+        for state, mask in self.current.join_bits.items():
+            s = self.current.graph.nodes[state]['data']
+            self.generate_method_comment('Synchronize join pseudo-states of the parent when entering the state ' + state + '.')
+            self.indent(1), self.fd.write('void ' + self.join_entering_function(state, False) + '()\n')
+            self.indent(1), self.fd.write('{\n')
+            self.indent(2), self.fd.write('if (m_regions != nullptr)\n')
+            self.indent(3), self.fd.write('*m_regions |= 0x' + format(mask, 'X') + 'u;\n')
+            if s.entering != '':
+                self.indent(2), self.fd.write(self.state_entering_function(state, False) + '();\n')
+            self.indent(1), self.fd.write('}\n\n')
+            self.generate_method_comment('Synchronize join pseudo-states of the parent when leaving the state ' + state + '.')
+            self.indent(1), self.fd.write('void ' + self.join_leaving_function(state, False) + '()\n')
+            self.indent(1), self.fd.write('{\n')
+            if s.leaving != '':
+                self.indent(2), self.fd.write(self.state_leaving_function(state, False) + '();\n')
+            self.indent(2), self.fd.write('if (m_regions != nullptr)\n')
+            self.indent(3), self.fd.write('*m_regions &= ~0x' + format(mask, 'X') + 'u;\n')
+            self.indent(1), self.fd.write('}\n\n')
+
+    ###########################################################################
+    ### Generate the member variables of fork and join pseudo-states and of
+    ### orthogonal regions.
+    ###########################################################################
+    def generate_regions_members(self):
+        if len(self.current.join_bits) != 0:
+            self.indent(1), self.fd.write('//! \\brief Word of the parent state machine synchronizing its orthogonal regions.\n')
+            self.indent(1), self.fd.write('uint64_t* m_regions = nullptr;\n')
+        for f in self.current.pseudo_states('fork'):
+            if len(self.current.graph.nodes[f]['data'].regions) != 0:
+                self.indent(1), self.fd.write('//! \\brief Fork pseudo-state being traversed.\n')
+                self.indent(1), self.fd.write(self.current.enum_name + ' m_forking = ' + self.current.enum_name + '::MAX_STATES;\n')
+                break
+        if self.current.region_bits == 0:
+            return
+        self.indent(1), self.fd.write('//! \\brief States of orthogonal regions synchronized by join pseudo-states (one bit each).\n')
+        self.indent(1), self.fd.write('uint64_t m_regions = 0u;\n')
+        for c in self.current.composite_states():
+            pairs = [(sm, s) for sm in self.current.regions_of(c) for s in sm.join_bits]
+            if len(pairs) != 0:
+                self.indent(1), self.fd.write('//! \\brief Bits of the orthogonal regions of the state ' + c + '.\n')
+                self.indent(1), self.fd.write('static constexpr uint64_t ' + self.regions_mask(c) + ' = ' + self.mask_value(pairs) + ';\n')
+        for j in self.current.pseudo_states('join'):
+            pairs = self.current.graph.nodes[j]['data'].regions
+            if len(pairs) != 0:
+                self.indent(1), self.fd.write('//! \\brief Bits of the states synchronized by the join pseudo-state ' + j + '.\n')
+                self.indent(1), self.fd.write('static constexpr uint64_t ' + self.join_mask(j) + ' = ' + self.mask_value(pairs) + ';\n')
+
+    ###########################################################################
+    ### Generate the member variables memorizing the history of composite states.
+    ### The history of a composite state is kept by its parent since the nested
+    ### state machine is destroyed when leaving the composite state.
+    ###########################################################################
+    def generate_history_members(self):
+        if self.history == '':
+            return
+        self.indent(1), self.fd.write('//! \\brief How the next composite state is entered.\n')
+        self.indent(1), self.fd.write('StateMachineEngine::History m_resuming = StateMachineEngine::History::NONE;\n')
+        for sm in self.current.children:
+            if sm.region != 0:
+                continue
+            if self.history == 'H*':
+                self.indent(1), self.fd.write('//! \\brief Last active configuration of the nested state machine ' + sm.name + '.\n')
+                self.indent(1), self.fd.write('uint64_t ' + self.child_machine_history(sm) + ' = UINT64_MAX;\n')
+            else:
+                self.indent(1), self.fd.write('//! \\brief Last active state of the nested state machine ' + sm.name + '.\n')
+                self.indent(1), self.fd.write('uint16_t ' + self.child_machine_history(sm) + ' = UINT16_MAX;\n')
+
+    ###########################################################################
+    ### Generate the methods needed by parent state machines to restore the deep
+    ### history of the nested state machine. The history is the configuration
+    ### word of the root state machine (one byte by nested state machine)
+    ### therefore the deep history is restored without replaying initial
+    ### transitions of nested state machines.
+    ###########################################################################
+    def generate_history_methods(self):
+        if self.history != 'H*' or self.current.parent == None:
+            return
+        self.generate_method_comment('Re-enter the state machine from its shallow or deep history.')
+        self.indent(1), self.fd.write('using StateMachine::resume;\n')
+        self.indent(1), self.fd.write('void resume(uint64_t const config, bool const deep)\n')
+        self.indent(1), self.fd.write('{\n')
+        state = self.current.enum_name + '((config >> (8u * slot())) & 0x' + format(self.current.slot_mask(), 'X') + 'u)'
+        if len(self.current.children) != 0:
+            self.indent(2), self.fd.write('m_nested.reset();\n')
+            self.indent(2), self.fd.write('if (deep)\n')
+            self.indent(2), self.fd.write('{\n')
+            self.indent(3), self.fd.write('m_resuming = StateMachineEngine::History::DEEP;\n')
+            for sm in self.current.children:
+                # The word of a detached nested state machine is not in config
+                if sm.region == 0 and not sm.detached:
+                    self.indent(3), self.fd.write(self.child_machine_history(sm) + ' = config;\n')
+            self.indent(2), self.fd.write('}\n')
+        else:
+            self.indent(2), self.fd.write('(void) deep;\n')
+        self.indent(2), self.fd.write('StateMachine::resume(' + state + ');\n')
+        self.indent(1), self.fd.write('}\n\n')
+
+    ###########################################################################
+    ### Generate the constant-time checks of the configuration: for each state
+    ### of this state machine and of its nested state machines, the bytes of the
+    ### configuration word on the path to this state are compared with a mask.
+    ### Composite states are checked on their own byte: isIn(X) is true for all
+    ### states nested in X. Masks are relative to the byte of this state machine.
+    ### A shared submachine has one mask by occurrence: isIn() is true when one
+    ### of its occurrences is in the state.
+    ###########################################################################
+    def generate_configuration_methods(self):
+        occurrences = defaultdict(list)
+        for sm in [self.current] + self.current.packed_descendants():
+            occurrences[sm.enum_name].append(sm)
+        for enum, machines in occurrences.items():
+            sm = machines[0]
+            self.generate_method_comment('Constant-time check if the state machine is in the given state of ' +
+                                         ('this' if sm == self.current else 'the nested') + ' state machine ' + sm.name +
+                                         ' (or in one of its nested states).')
+            self.indent(1), self.fd.write('inline bool isIn(' + enum + ' const state) const\n')
+            self.indent(1), self.fd.write('{\n')
+            if len(machines) == 1:
+                self.indent(2), self.fd.write('static const uint64_t s_configurations[][2] =\n')
+            else:
+                self.indent(2), self.fd.write('static const uint64_t s_configurations[][' + str(sm.graph.number_of_nodes() + 3) + '][2] =\n')
+            self.indent(2), self.fd.write('{\n')
+            for sm in machines:
+                if len(machines) != 1:
+                    self.indent(3), self.fd.write('{ // ' + sm.name + '\n')
+                self.generate_configuration_masks(sm, 3 if len(machines) == 1 else 4)
+                if len(machines) != 1:
+                    self.indent(3), self.fd.write('},\n')
+            self.indent(2), self.fd.write('};\n\n')
+            config = 'configuration()' if self.current.parent == None else '(configuration() >> (8u * slot()))'
+            if len(machines) == 1:
+                self.indent(2), self.fd.write('return (' + config + ' & s_configurations[int(state)][0]) ==\n')
+                self.indent(3), self.fd.write('s_configurations[int(state)][1];\n')
+            else:
+                self.indent(2), self.fd.write('uint64_t const config = ' + config + ';\n')
+                self.indent(2), self.fd.write('for (auto const& c: s_configurations)\n')
+                self.indent(2), self.fd.write('{\n')
+                self.indent(3), self.fd.write('if ((config & c[int(state)][0]) == c[int(state)][1])\n')
+                self.indent(4), self.fd.write('return true;\n')
+                self.indent(2), self.fd.write('}\n')
+                self.indent(2), self.fd.write('return false;\n')
+            self.indent(1), self.fd.write('}\n\n')
+
+    ###########################################################################
+    ### Generate the rows (mask, value) of the configuration word for each state
+    ### of the given state machine (this one or one of its descendants).
+    ### param[in] sm the state machine.
+    ### param[in] count the indentation level.
+    ###########################################################################
+    def generate_configuration_masks(self, sm, count):
+        # Bytes of the ancestors on the path from this state machine
+        mask, value = 0, []
+        child = sm
+        while child != self.current:
+            shift = 8 * (child.parent.slot - self.current.slot)
+            mask |= child.parent.slot_mask() << shift
+            value.append('(uint64_t(' + child.parent.enum_name + '::' + child.owner_state() + ') << ' + str(shift) + 'u)')
+            child = child.parent
+        shift = 8 * (sm.slot - self.current.slot)
+        mask |= sm.slot_mask() << shift
+        for state in list(sm.graph.nodes):
+            name = self.state_name(state)
+            self.indent(count)
+            if sm.graph.nodes[state]['data'].pseudo != '':
+                self.fd.write('{ 0u, 1u }, // ' + name + '\n')
+                continue
+            self.fd.write('{ 0x' + format(mask, 'X') + 'u, ')
+            self.fd.write(' | '.join(['(uint64_t(' + sm.enum_name + '::' + name + ') << ' + str(shift) + 'u)'] + value))
+            self.fd.write(' }, // ' + name + '\n')
+        self.indent(count), self.fd.write('{ 0u, 1u }, { 0u, 1u }, { 0u, 1u }, // Internal states\n')
+
+    ###########################################################################
+    ### Generate the table of composite states owning nested state machines.
+    ###########################################################################
+    def generate_owner_states(self):
+        for sm in self.current.children:
+            self.indent(1), self.fd.write('//! \\brief Composite state owning the nested state machine ' + sm.name + '.\n')
+            self.indent(1), self.fd.write('static constexpr ' + self.current.enum_name + ' ' + self.child_machine_owner(sm))
+            self.fd.write(' = ' + self.state_enum(sm.owner_state()) + ';\n')
+
+    ###########################################################################
+    ### Generate the actions of transitions reaching transient states: the chain
+    ### of eventless transitions is collapsed at generation time into a single
+    ### transition landing directly in the last state, whose action calls the
+    ### actions of the traversed states in the order of the runtime.
+    ###########################################################################
+    def generate_chaining_methods(self):
+        for origin, destination, tr in self.current.graph.edges(data='data'):
+            if len(self.current.eventless_chain(tr)) == 0 or len(self.chaining_calls(tr)) == 0:
                 continue
-            self.generate_method_comment('External event.')
-            self.indent(1), self.fd.write(event.header() + '\n')
+            self.generate_method_comment('Do the actions of the transition from state ' + origin + ' to state ' + destination +
+                                         ' and of the eventless transitions up to the state ' + self.transition_destination(tr) + '.')
+            self.indent(1), self.fd.write('void ' + self.chaining_function(tr) + '()\n')
             self.indent(1), self.fd.write('{\n')
-            # Display data event
-            self.indent(2), self.fd.write('LOGD("[' + self.current.class_name.upper() + '][EVENT %s]')
-            if len(event.params) != 0:
-                self.fd.write(' with params XXX') # FIXME a finir
-            self.fd.write('\\n", __func__);\n\n')
-            # Copy data event
-            for arg in event.params:
-                self.indent(2), self.fd.write(arg + ' = ' + arg + '_;\n\n')
-            # Table of transitions
-            self.indent(2), self.fd.write('// State transition and actions\n')
-            self.indent(2), self.fd.write('static const Transitions s_transitions =\n')
-            self.indent(2), self.fd.write('{\n')
-            for origin, destination in arcs:
-                tr = self.current.graph[origin][destination]['data']
-                self.indent(3), self.fd.write('{\n')
-                self.indent(4), self.fd.write(self.state_enum(origin) + ',\n')
-                self.indent(4), self.fd.write('{\n')
-                self.indent(5), self.fd.write('.destination = ' + self.state_enum(destination) + ',\n')
-                if tr.guard != '':
-                    self.indent(5), self.fd.write('.guard = &' + self.guard_function(origin, destination, True) + ',\n')
-                if tr.action != '':
-                    self.indent(5), self.fd.write('.action = &' + self.transition_function(origin, destination, True) + ',\n')
-                self.indent(4), self.fd.write('},\n')
-                self.indent(3), self.fd.write('},\n')
-            self.indent(2), self.fd.write('};\n\n')
-            self.indent(2), self.fd.write('transition(s_transitions);\n')
+            for call in self.chaining_calls(tr):
+                self.indent(2), self.fd.write(call + '();\n')
             self.indent(1), self.fd.write('}\n\n')
 
     ###########################################################################
     ### Generate guards and actions on transitions.
     ###########################################################################
     def generate_transition_methods(self):
-        transitions = list(self.current.graph.edges)
-        for origin, destination in transitions:
-            tr = self.current.graph[origin][destination]['data']
-            if tr.guard != '':
-                self.generate_method_comment('Guard the transition from state ' + origin  + ' to state ' + destination + '.')
-                self.indent(1), self.fd.write('MOCKABLE bool ' + self.guard_function(origin, destination) + '()\n')
+        for origin, destination, tr in self.current.graph.edges(data='data'):
+            if tr.guard != '' and self.current.canonical_transition(tr, 'guard') == tr:
+                edges = self.current.sharing_transitions(tr, 'guard')
+                if len(edges) == 1:
+                    self.generate_method_comment('Guard the transition from state ' + origin  + ' to state ' + destination + '.')
+                else:
+                    self.generate_method_comment('Guard the transitions ' + ', '.join(t.origin + ' --> ' + t.destination for t in edges) + '.')
+                self.indent(1), self.fd.write('MOCKABLE bool ' + self.guard_function(tr) + '()\n')
                 self.indent(1), self.fd.write('{\n')
+                if self.model_check_mode():
+                    self.fd.write('#if defined(FSM_MODEL_CHECK)\n')
+                    self.indent(2), self.fd.write('return ModelOracle::guard();\n')
+                    self.fd.write('#else\n')
                 self.indent(2), self.fd.write('const bool guard = (' + tr.guard + ');\n')
-                self.indent(2), self.fd.write('LOGD("[' + self.current.class_name.upper() + '][GUARD ' + origin + ' --> ' + destination + ': ' + tr.guard + '] result: %s\\n",\n')
+                self.indent(2), self.fd.write('LOGD("[' + self.current.class_name.upper() + '][GUARD ')
+                if len(edges) == 1:
+                    self.fd.write(origin + ' --> ' + destination + ': ')
+                self.fd.write(tr.guard + '] result: %s\\n",\n')
                 self.indent(3), self.fd.write('(guard ? "true" : "false"));\n')
                 self.indent(2), self.fd.write('return guard;\n')
+                if self.model_check_mode():
+                    self.fd.write('#endif\n')
                 self.indent(1), self.fd.write('}\n\n')
-            if tr.action != '':
-                self.generate_method_comment('Do the action when transitioning from state ' + origin + ' to state ' + destination + '.')
-                self.indent(1), self.fd.write('MOCKABLE void ' + self.transition_function(origin, destination) + '()\n')
+            if tr.action != '' and self.current.canonical_transition(tr, 'action') == tr:
+                edges = self.current.sharing_transitions(tr, 'action')
+                if len(edges) == 1:
+                    self.generate_method_comment('Do the action when transitioning from state ' + origin + ' to state ' + destination + '.')
+                else:
+                    self.generate_method_comment('Do the action of the transitions ' + ', '.join(t.origin + ' --> ' + t.destination for t in edges) + '.')
+                self.indent(1), self.fd.write('MOCKABLE void ' + self.transition_function(tr) + '()\n')
                 self.indent(1), self.fd.write('{\n')
-                self.indent(2), self.fd.write('LOGD("[' + self.current.class_name.upper() + '][TRANSITION ' + origin + ' --> ' + destination)
+                self.indent(2), self.fd.write('LOGD("[' + self.current.class_name.upper() + '][TRANSITION')
+                if len(edges) == 1:
+                    self.fd.write(' ' + origin + ' --> ' + destination)
                 if tr.action[0:2] != '//':
                     self.fd.write(': ' + tr.action + ']\\n");\n')
                 else: # Cannot display action since contains comment + warnings
                     self.fd.write(']\\n");\n')
-                self.indent(2), self.fd.write(tr.action + ';\n')
+                self.generate_action_code('        ' + tr.action + ';\n')
+                self.indent(1), self.fd.write('}\n\n')
+            if tr.history != '':
+                self.generate_method_comment('Enter the state ' + destination + ' from its ' +
+                                             ('deep' if tr.history == 'H*' else 'shallow') +
+                                             ' history when transitioning from state ' + origin + '.')
+                self.indent(1), self.fd.write('void ' + self.resuming_function(tr) + '()\n')
+                self.indent(1), self.fd.write('{\n')
+                self.indent(2), self.fd.write('m_resuming = StateMachineEngine::History::' + ('DEEP' if tr.history == 'H*' else 'SHALLOW') + ';\n')
+                if tr.action != '':
+                    self.indent(2), self.fd.write(self.transition_function(tr) + '();\n')
                 self.indent(1), self.fd.write('}\n\n')
 
+    ###########################################################################
+    ### Return True when actions are deferred (option --deferred): their code
+    ### is pushed into the buffer of commands bound to the state machine and
+    ### run after the run-to-completion step instead of inline.
+    ###########################################################################
+    def deferred_mode(self):
+        return '--deferred' in self.options
+
+    ###########################################################################
+    ### Return the identifiers of the given C++ code, string and character
+    ### literals excepted.
+    ###########################################################################
+    def code_identifiers(self, code):
+        text = re.sub(r'"(\\.|[^"\\])*"|\'(\\.|[^\'\\])*\'', '""', code)
+        return list(dict.fromkeys(re.findall(r'\b[A-Za-z_]\w*', text)))
+
+    ###########################################################################
+    ### Return the variables assigned by the given C++ code (=, op=, ++, --),
+    ### array elements and members of structures included, and the variables
+    ### whose address is taken. Variables given by reference to functions are
+    ### not seen: deferred actions copy them as constants, so such calls fail
+    ### to compile instead of updating a copy.
+    ###########################################################################
+    def assigned_variables(self, code):
+        text = re.sub(r'"(\\.|[^"\\])*"|\'(\\.|[^\'\\])*\'', '""', code)
+        names = re.findall(r'\b([A-Za-z_]\w*)\s*(?:\[[^\]]*\]\s*)*(?:\+\+|--|(?:<<|>>|[-+*/%&|^])?=(?!=))', text)
+        names += re.findall(r'(?:\+\+|--)\s*([A-Za-z_]\w*)', text)
+        names += re.findall(r'(?<![\w)\]&])\s*&\s*([A-Za-z_]\w*)', text)
+        return list(dict.fromkeys(names))
+
+    ###########################################################################
+    ### Return the identifiers read by the guards of the current state machine
+    ### (transitions, initial transitions and pseudo-states).
+    ###########################################################################
+    def guard_identifiers(self):
+        names = []
+        for _, _, tr in self.current.graph.edges(data='data'):
+            names += self.code_identifiers(tr.guard)
+        return set(names)
+
+    ###########################################################################
+    ### Generate the user code of an action on a transition or on a state. In
+    ### the deferred mode, the whole action is pushed as a single command so
+    ### its statements (and their local variables) stay together and in order.
+    ### The command copies the event parameters and the variables read by
+    ### guards it reads: it sees the values of the step that fired it even if
+    ### state updates run before the buffer is flushed. Actions assigning
+    ### variables read by guards are state updates: they run immediately, and
+    ### shall have no side effect (call) and read no other member variable
+    ### than event parameters, else the translation fails since the order of
+    ### the program would depend on the buffer.
+    ### param[in] code the lines of code, indented inside the method.
+    ###########################################################################
+    def generate_action_code(self, code):
+        if self.model_check_mode():
+            self.fd.write('#if !defined(FSM_MODEL_CHECK)\n')
+        if not self.deferred_mode():
+            self.fd.write(code)
+        else:
+            variables, _ = self.table_declarations([self.master, self.current])
+            params = [p.strip() for e in self.current.lookup_events for p in e.params]
+            guards = self.guard_identifiers()
+            identifiers = self.code_identifiers(code)
+            assigned = self.assigned_variables(code)
+            updates = [v for v in assigned if v in guards and v in variables and v not in params]
+            if len(updates) != 0:
+                text = re.sub(r'"(\\.|[^"\\])*"', '""', code)
+                keywords = ['if', 'for', 'while', 'switch', 'return', 'sizeof', 'bool', 'char', 'short',
+                            'int', 'long', 'unsigned', 'float', 'double', 'size_t']
+                calls = [c for c in re.findall(r'\b([A-Za-z_]\w*)\s*\(', text)
+                         if c not in keywords and not re.match(r'^u?int\d+_t$', c)]
+                others = [v for v in identifiers if v in variables and v not in guards and v not in params]
+                if len(calls) + len(others) != 0:
+                    self.fatal('With --deferred, the action "' + code.strip() + '" assigns (or takes the address of) ' + ', '.join(updates) +
+                               ' read by guards therefore runs immediately, but also ' +
+                               ('calls ' + ', '.join(calls) if len(calls) != 0 else 'reads ' + ', '.join(others)) +
+                               ': move its side effects to another action')
+                self.fd.write(code)
+            else:
+                captures = ['this'] + [v + ' = ' + v for v in identifiers if v not in assigned and
+                                       (v in params or (v in guards and v in variables))]
+                self.indent(2), self.fd.write('defer([' + ', '.join(captures) + ']()\n')
+                self.indent(2), self.fd.write('{\n')
+                for line in code.strip().splitlines():
+                    self.indent(3), self.fd.write(line.strip() + '\n')
+                self.indent(2), self.fd.write('});\n')
+        if self.model_check_mode():
+            self.fd.write('#endif\n')
+
+    ###########################################################################
+    ### Return True when generating the model checker of the state machine
+    ### (option --model-check): guards and actions are replaced by the oracle
+    ### of include/ModelChecker.hpp when FSM_MODEL_CHECK is defined.
+    ###########################################################################
+    def model_check_mode(self):
+        return '--model-check' in self.options
+
+    ###########################################################################
+    ### Return the scalar member variables of the current state machine saved
+    ### by its snapshot: data of its events and variables declared by '[code]
+    ### outside methods (constants excepted).
+    ###########################################################################
+    def snapshot_variables(self):
+        variables, _ = self.table_declarations([self.master, self.current])
+        code, depth = '', 0
+        for c in self.current.extra_code.code:
+            depth -= (c == '}')
+            code += c if depth == 0 else ''
+            depth += (c == '{')
+        members = [p.strip() for e in self.current.lookup_events for p in e.params]
+        for statement in code.replace('}', ';').split(';'):
+            if not re.search(r'\b(static|const|constexpr|using|typedef)\b|[(&*]', statement):
+                members += re.findall(r'\b([A-Za-z_]\w*)\s*(?==|,|$)', statement.strip())
+        return [v for v in dict.fromkeys(members) if v in variables]
+
+    ###########################################################################
+    ### Generate the methods saving and restoring the state of the state
+    ### machine explored by the model checker (option --model-check): the
+    ### configuration word and, in this order, the histories, the states of
+    ### synchronized orthogonal regions and the scalar variables of the state
+    ### machine then the ones of its alive nested state machines. Nested state
+    ### machines are constructed in the states of the configuration word without
+    ### entering them, so restoring costs the size of the snapshot.
+    ###########################################################################
+    def generate_snapshot_methods(self):
+        if not self.model_check_mode():
+            return
+        members = self.snapshot_members()
+        self.fd.write('#if defined(FSM_MODEL_CHECK)\n')
+        self.generate_method_comment('Save the data of the state machine and of its alive nested state machines not packed in the configuration word (model checker).')
+        self.indent(1), self.fd.write('void snapshot(uint8_t*& data) const\n')
+        self.indent(1), self.fd.write('{\n')
+        for m in members:
+            self.indent(2), self.fd.write('ModelSnapshot::save(data, ' + m + ');\n')
+        for c in self.current.composite_states():
+            regions = self.current.regions_of(c)
+            self.indent(2), self.fd.write('if (state() == ' + self.child_machine_owner(regions[0]) + ')\n')
+            self.indent(2), self.fd.write('{\n')
+            for sm in regions:
+                if sm.detached:
+                    self.indent(3), self.fd.write('ModelSnapshot::save(data, ' + self.child_machine_instance(sm) + '.configuration());\n')
+                self.indent(3), self.fd.write(self.child_machine_instance(sm) + '.snapshot(data);\n')
+            self.indent(2), self.fd.write('}\n')
+        if len(members) + len(self.current.children) == 0:
+            self.indent(2), self.fd.write('(void) data;\n')
+        self.indent(1), self.fd.write('}\n\n')
+        self.generate_method_comment('Restore the state machine in the given configuration and its data saved by snapshot() (model checker).')
+        self.indent(1), self.fd.write('void restore(uint64_t const config, uint8_t const*& data)\n')
+        self.indent(1), self.fd.write('{\n')
+        if len(self.current.children) != 0:
+            self.indent(2), self.fd.write('m_nested.reset();\n')
+        # Including the bytes left by the nested state machines already exited
+        # (unchanged for nested state machines bound to the word of the root)
+        self.indent(2), self.fd.write('*word() = config;\n')
+        self.indent(2), self.fd.write('restart(uint16_t((config >> (8u * slot())) & 0x' + format(self.current.slot_mask(), 'X') + 'u));\n')
+        for m in members:
+            self.indent(2), self.fd.write('ModelSnapshot::load(data, ' + m + ');\n')
+        for c in self.current.composite_states():
+            regions = self.current.regions_of(c)
+            self.indent(2), self.fd.write('if (state() == ' + self.child_machine_owner(regions[0]) + ')\n')
+            self.indent(2), self.fd.write('{\n')
+            if regions[0].region == 0:
+                sm = regions[0]
+                self.indent(3), self.fd.write(sm.class_name + '& nested = m_nested.emplace<' + sm.class_name + '>();\n')
+                self.generate_nested_restore(sm, 'nested')
+            else:
+                self.indent(3), self.fd.write(self.regions_type(c) + '& regions = m_nested.emplace<' + self.regions_type(c) + '>();\n')
+                for sm in regions:
+                    region = 'std::get<' + str(sm.region - 1) + '>(regions)'
+                    if len(sm.join_bits) != 0:
+                        self.indent(3), self.fd.write(region + '.synchronize(m_regions);\n')
+                    self.generate_nested_restore(sm, region)
+            self.indent(2), self.fd.write('}\n')
+        if len(members) + len(self.current.children) == 0:
+            self.indent(2), self.fd.write('(void) data;\n')
+        self.indent(1), self.fd.write('}\n')
+        self.fd.write('#endif\n\n')
+
+    ###########################################################################
+    ### Generate the restoration of a nested state machine just constructed: it
+    ### is bound to the configuration word or, when detached, restored from its
+    ### own word saved in the snapshot.
+    ### param[in] sm the nested state machine.
+    ### param[in] instance the C++ expression of its instance.
+    ###########################################################################
+    def generate_nested_restore(self, sm, instance):
+        if not sm.detached:
+            self.indent(3), self.fd.write(instance + '.bind(word(), ' + self.child_machine_slot(sm) + ');\n')
+            self.indent(3), self.fd.write(instance + '.restore(config, data);\n')
+            return
+        word = 'config_' + self.child_machine_suffix(sm)
+        self.indent(3), self.fd.write('uint64_t ' + word + ';\n')
+        self.indent(3), self.fd.write('ModelSnapshot::load(data, ' + word + ');\n')
+        self.indent(3), self.fd.write(instance + '.restore(' + word + ', data);\n')
+
+    ###########################################################################
+    ### Return the member variables saved by the snapshot of the current state
+    ### machine: histories of its nested state machines, states of its
+    ### synchronized orthogonal regions and scalar variables.
+    ###########################################################################
+    def snapshot_members(self):
+        members = [self.child_machine_history(sm) for sm in self.current.children
+                   if sm.region == 0 and self.history != '']
+        if self.current.region_bits != 0:
+            members.append('m_regions')
+        return members + self.snapshot_variables()
+
+    ###########################################################################
+    ### Generate the size of the snapshot of the current state machine: its
+    ### members and the biggest snapshot of its nested state machines (or of
+    ### its orthogonal regions). Generated after the client code declaring the
+    ### variables.
+    ###########################################################################
+    def generate_snapshot_size(self):
+        if not self.model_check_mode():
+            return
+        groups = []
+        for c in self.current.composite_states():
+            groups.append(' + '.join(('sizeof(uint64_t) + ' if sm.detached else '') + sm.class_name + '::SNAPSHOT'
+                                     for sm in self.current.regions_of(c)))
+        size = ['sizeof(' + m + ')' for m in self.snapshot_members()]
+        if len(groups) != 0:
+            size.append('std::max({ size_t(0u), ' + ', '.join(groups) + ' })')
+        self.fd.write('\npublic: // Model checker\n\n')
+        self.fd.write('#if defined(FSM_MODEL_CHECK)\n')
+        self.indent(1), self.fd.write('//! \\brief Size of the data saved by snapshot().\n')
+        self.indent(1), self.fd.write('static constexpr size_t SNAPSHOT = ' + (' + '.join(size) if len(size) != 0 else '0u') + ';\n')
+        self.fd.write('#endif\n')
+
+    ###########################################################################
+    ### Generate the program checking the main state machine: it explores the
+    ### configurations reachable by any sequence of external events and any
+    ### outcome of the guards, and reports the fatal errors with the events
+    ### leading to them. Usage: <program> [max configurations] [threads].
+    ### param[in] cxxfile the path of the generated header.
+    ###########################################################################
+    def generate_model_checker(self, cxxfile):
+        fsm = self.current.class_name
+        if self.current.extra_code.argvs != '':
+            self.report(self.current, 'No model checker generated: the constructor of ' + fsm + ' has parameters')
+            return
+        events = dict()
+        for e in list(self.current.broadcasted_events()) + list(self.current.lookup_events):
+            if e.name != '' and e.name not in events:
+                events[e.name] = e
+        events = list(events.values())
+        filename = os.path.join(os.path.dirname(cxxfile), fsm + 'ModelCheck.cpp')
+        self.fd = open(filename, 'w')
+        self.generate_common_header()
+        self.fd.write('// Model checker of the state machine: compile with -pthread and run\n')
+        self.fd.write('// ./' + fsm + 'ModelCheck [max configurations] [threads]\n\n')
+        self.fd.write('#define MOCKABLE\n')
+        self.fd.write('#include "ModelChecker.hpp"\n')
+        self.fd.write('#include "' + fsm + '.hpp"\n\n')
+        self.generate_function_comment('React to the event of the given index (0: enter the state machine).')
+        self.fd.write('static void step(' + fsm + '& fsm, size_t const event)\n')
+        self.fd.write('{\n')
+        self.indent(1), self.fd.write('switch (event)\n')
+        self.indent(1), self.fd.write('{\n')
+        self.indent(1), self.fd.write('case 0u: fsm.enter(); break;\n')
+        for i, e in enumerate(events):
+            self.indent(1), self.fd.write('case ' + str(i + 1) + 'u: fsm.' + e.name + '(')
+            self.fd.write(', '.join(p.strip().upper() + '()' for p in e.params) + '); break;\n')
+        self.indent(1), self.fd.write('default: break;\n')
+        self.indent(1), self.fd.write('}\n')
+        self.fd.write('}\n\n')
+        self.generate_function_comment('Explore the configurations of the state machine.')
+        self.fd.write('int main(int argc, char* argv[])\n')
+        self.fd.write('{\n')
+        self.indent(1), self.fd.write('static const char* const s_events[] =\n')
+        self.indent(1), self.fd.write('{\n')
+        self.indent(2), self.fd.write('"enter",\n')
+        for e in events:
+            self.indent(2), self.fd.write('"' + e.name + '",\n')
+        self.indent(1), self.fd.write('};\n\n')
+        self.indent(1), self.fd.write('size_t const limit = (argc > 1) ? size_t(atol(argv[1])) : size_t(1u << 24u);\n')
+        self.indent(1), self.fd.write('size_t const threads = (argc > 2) ? size_t(atol(argv[2])) : 0u;\n')
+        self.indent(1), self.fd.write('ModelChecker<' + fsm + '> checker(s_events, ' + str(len(events) + 1) + 'u, step);\n')
+        self.indent(1), self.fd.write('return checker.run("' + fsm + '", limit, threads) ? EXIT_SUCCESS : EXIT_FAILURE;\n')
+        self.fd.write('}\n')
+        self.fd.close()
+
+    ###########################################################################
+    ### Generate the decision trees of choice and junction pseudo-states: guards
+    ### of outgoing transitions are evaluated in a chain of if statements and the
+    ### selected transition is returned to the base class which continues the
+    ### transition step without entering the pseudo-state.
+    ###########################################################################
+    def generate_choice_methods(self):
+        for state in list(self.current.graph.nodes):
+            if not self.current.is_pseudo_state(state):
+                continue
+            # Join pseudo-states are reached by orthogonal regions
+            if self.current.graph.nodes[state]['data'].pseudo == 'join':
+                continue
+            branches = self.current.pseudo_state_branches(state)
+            self.generate_method_comment('Select the outgoing transition of the ' +
+                                         self.current.graph.nodes[state]['data'].pseudo +
+                                         ' pseudo-state ' + state + '.')
+            self.indent(1), self.fd.write('Transition const* ' + self.choice_function(state, False) + '()\n')
+            self.indent(1), self.fd.write('{\n')
+            self.indent(2), self.fd.write('static const Transition s_branches[] =\n')
+            self.indent(2), self.fd.write('{\n')
+            for tr in branches:
+                self.indent(3), self.fd.write('{\n')
+                self.indent(4), self.fd.write('.destination = ' + self.state_enum(self.transition_destination(tr)) + ',\n')
+                if self.transition_action(tr) != '':
+                    self.indent(4), self.fd.write('.action = ' + self.hook(self.transition_action(tr)) + ',\n')
+                self.indent(3), self.fd.write('},\n')
+            self.indent(2), self.fd.write('};\n\n')
+            default = False
+            for i in range(len(branches)):
+                tr = branches[i]
+                if tr.guard != '':
+                    self.indent(2), self.fd.write('if (' + self.guard_function(tr) + '())\n')
+                    self.indent(3), self.fd.write('return &s_branches[' + str(i) + '];\n')
+                else:
+                    self.indent(2), self.fd.write('return &s_branches[' + str(i) + '];\n')
+                    default = True
+                    break
+            if not default:
+                self.indent(2), self.fd.write('return nullptr;\n')
+            self.indent(1), self.fd.write('}\n\n')
+
     ###########################################################################
     ### Generate leaving and entering actions associated to states.
     ###########################################################################
@@ -961,14 +3153,14 @@ class Parser(object):
                 self.indent(1), self.fd.write('MOCKABLE void ' + self.state_entering_function(node, False) + '()\n')
                 self.indent(1), self.fd.write('{\n')
                 self.indent(2), self.fd.write('LOGD("[' + self.current.class_name.upper() + '][ENTERING STATE ' + state.name + ']\\n");\n')
-                self.fd.write(state.entering)
+                self.generate_action_code(state.entering)
                 self.indent(1), self.fd.write('}\n\n')
             if state.leaving != '':
                 self.generate_method_comment('Do the action when leaving the state ' + state.name + '.')
                 self.indent(1), self.fd.write('MOCKABLE void ' + self.state_leaving_function(node, False) + '()\n')
                 self.indent(1), self.fd.write('{\n')
                 self.indent(2), self.fd.write('LOGD("[' + self.current.class_name.upper() + '][LEAVING STATE ' + state.name + ']\\n");\n')
-                self.fd.write(state.leaving)
+                self.generate_action_code(state.leaving)
                 self.indent(1), self.fd.write('}\n\n')
             if state.internal != '':
                 # Initial node is already generated in the ::enter() method (this save generating one method)
@@ -981,37 +3173,87 @@ class Parser(object):
                 self.fd.write(state.internal)
                 self.indent(1), self.fd.write('}\n\n')
 
+    ###########################################################################
+    ### Return the class template the generated class derives from: only the
+    ### state machines generated with --handlers hold a table of handlers and
+    ### only the ones generated with --deferred hold a buffer of commands.
+    ### param[in] arguments if True append the template arguments.
+    ###########################################################################
+    def base_class(self, arguments=False):
+        name = 'HandlerStateMachine' if self.handlers_mode() else 'StateMachine'
+        args = '<' + self.current.class_name + ', ' + self.current.enum_name + '>'
+        if self.deferred_mode():
+            base = (', ' + name + args) if self.handlers_mode() else ''
+            name = 'DeferredStateMachine'
+            args = '<' + self.current.class_name + ', ' + self.current.enum_name + base + '>'
+        return name + (args if arguments else '')
+
     ###########################################################################
     ### Entry point to generate the whole state machine class and all its methods.
     ###########################################################################
     def generate_state_machine_class(self):
         self.generate_class_comment()
-        self.fd.write('class ' + self.current.class_name + ' : public StateMachine<')
-        self.fd.write(self.current.class_name + ', ' + self.current.enum_name + '>\n')
+        self.fd.write('class ' + self.current.class_name + ' : public ' + self.base_class(True) + '\n')
         self.fd.write('{\n')
         self.fd.write('public: // Constructor and destructor\n\n')
         self.generate_constructor_method()
         self.generate_destructor_method()
         self.generate_enter_method()
         self.generate_exit_method()
+        self.generate_history_methods()
+        self.generate_configuration_methods()
+        self.generate_snapshot_methods()
+        if len(self.current.join_bits) != 0:
+            self.generate_method_comment('Share the word of the parent state machine synchronizing its orthogonal regions.')
+            self.indent(1), self.fd.write('void synchronize(uint64_t& regions)\n')
+            self.indent(1), self.fd.write('{\n')
+            self.indent(2), self.fd.write('m_regions = &regions;\n')
+            self.indent(1), self.fd.write('}\n\n')
         self.fd.write('public: // External events\n\n')
         self.generate_event_methods()
+        self.generate_batch_event_methods()
+        self.generate_data_declarations()
+        self.generate_handler_methods()
         self.fd.write('private: // Guards and actions on transitions\n\n')
         self.generate_transition_methods()
+        self.generate_chaining_methods()
+        self.generate_choice_methods()
+        self.generate_range_methods()
+        self.generate_fork_join_methods()
         self.fd.write('private: // Actions on states\n\n')
         self.generate_state_methods()
+        self.generate_join_methods()
         self.fd.write('private: // Nested state machines\n\n')
-        for sm in self.current.children:
-            self.indent(1), self.fd.write(sm.class_name + ' ')
-            self.fd.write(self.child_machine_instance(sm) + ';\n')
+        self.generate_composite_methods()
+        self.generate_owner_states()
+        nested = []
+        for c in self.current.composite_states():
+            regions = self.current.regions_of(c)
+            if regions[0].region == 0:
+                nested.append(regions[0].class_name)
+                continue
+            nested.append(self.regions_type(c))
+            self.indent(1), self.fd.write('//! \\brief Orthogonal regions of the state ' + c + '.\n')
+            self.indent(1), self.fd.write('using ' + self.regions_type(c) + ' = std::tuple<')
+            self.fd.write(', '.join(sm.class_name for sm in regions) + '>;\n')
+        if len(nested) != 0:
+            self.indent(1), self.fd.write('//! \\brief Nested state machines sharing the same memory.\n')
+            self.indent(1), self.fd.write('NestedOverlay<' + ', '.join(dict.fromkeys(nested)) + '> m_nested;\n')
+            self.generate_history_members()
+        self.generate_regions_members()
         self.fd.write('private: // Data events\n\n')
         for event, arcs in self.current.lookup_events.items():
             for arg in event.params:
                 self.indent(1), self.fd.write('//! \\brief Data for event ' + event.name + '\n')
-                self.indent(1), self.fd.write(arg.upper() + ' ' + arg + ';\n')
+                # Value-initialized for the model checker: they are part of the snapshot
+                self.indent(1), self.fd.write(arg.upper() + ' ' + arg + ('{};\n' if self.model_check_mode() else ';\n'))
+        self.generate_filter_members()
         self.fd.write('\nprivate: // Client code\n\n')
         self.fd.write(self.current.extra_code.code)
+        self.generate_snapshot_size()
+        self.generate_footprint_constants()
         self.fd.write('};\n\n')
+        self.generate_budget_asserts()
 
     ###########################################################################
     ### Generate the header part of the unit test file.
@@ -1019,6 +3261,7 @@ class Parser(object):
     def generate_unit_tests_header(self):
         self.generate_common_header()
         self.fd.write('#define MOCKABLE virtual\n')
+        self.fd.write('#define FSM_MOCKED_GUARDS\n')
         self.fd.write('#include "' + self.current.class_name + '.hpp"\n')
         self.fd.write('#include <gmock/gmock.h>\n')
         self.fd.write('#include <gtest/gtest.h>\n')
@@ -1038,18 +3281,16 @@ class Parser(object):
         self.generate_function_comment('Mocked state machine')
         self.fd.write('class Mock' + self.current.class_name + ' : public ' + self.current.class_name)
         self.fd.write('\n{\npublic:\n')
-        transitions = list(self.current.graph.edges)
-        for origin, destination in transitions:
-            tr = self.current.graph[origin][destination]['data']
-            if tr.guard != '':
+        for tr in self.current.transitions():
+            if tr.guard != '' and self.current.canonical_transition(tr, 'guard') == tr:
                 self.indent(1)
                 self.fd.write('MOCK_METHOD(bool, ')
-                self.fd.write(self.guard_function(origin, destination))
+                self.fd.write(self.guard_function(tr))
                 self.fd.write(', (), (override));\n')
-            if tr.action != '':
+            if tr.action != '' and self.current.canonical_transition(tr, 'action') == tr:
                 self.indent(1)
                 self.fd.write('MOCK_METHOD(void, ')
-                self.fd.write(self.transition_function(origin, destination))
+                self.fd.write(self.transition_function(tr))
                 self.fd.write(', (), (override));\n')
         for node in list(self.current.graph.nodes):
             state = self.current.graph.nodes[node]['data']
@@ -1067,17 +3308,40 @@ class Parser(object):
             for arg in event.params:
                 self.indent(1), self.fd.write('// Data for event ' + event.name + '\n')
                 self.indent(1), self.fd.write(arg.upper() + ' ' + arg + '{};\n')
-        self.fd.write(self.current.extra_code.unit_tests)
-        if self.current.extra_code.unit_tests != '':
+        members = self.unit_tests_code()[0]
+        self.fd.write(members)
+        if members != '':
             self.fd.write('\n')
         self.fd.write('};\n\n')
 
+    ###########################################################################
+    ### Split the '[test] code into the members of the mocked class and the
+    ### test cases written by the designer: the code from the first line
+    ### starting with 'TEST(' is placed after the mocked class.
+    ### return the tuple (members, test cases).
+    ###########################################################################
+    def unit_tests_code(self):
+        code = self.current.extra_code.unit_tests
+        m = re.search(r'^TEST\(', code, re.MULTILINE)
+        if m == None:
+            return (code, '')
+        return (code[:m.start()], code[m.start():])
+
+    ###########################################################################
+    ### Generate the test cases given by '[test] annotations.
+    ###########################################################################
+    def generate_unit_tests_scenarios(self):
+        scenarios = self.unit_tests_code()[1]
+        if scenarios == '':
+            return
+        self.generate_line_separator(0, ' ', 80, '-')
+        self.fd.write(scenarios + '\n')
+
     ###########################################################################
     ### Reset mock counters.
     ###########################################################################
     def reset_mock_counters(self):
-        for origin, destination in list(self.current.graph.edges):
-            tr = self.current.graph[origin][destination]['data']
+        for tr in self.current.transitions():
             tr.count_guard = 0
             tr.count_action = 0
         for node in list(self.current.graph.nodes):
@@ -1091,7 +3355,7 @@ class Parser(object):
     def count_mocked_guards(self, cycle):
         self.reset_mock_counters()
         for i in range(len(cycle) - 1):
-            tr = self.current.graph[cycle[i]][cycle[i+1]]['data'];
+            tr = self.current.transition(cycle[i], cycle[i+1])
             if tr.guard != '':
                 tr.count_guard += 1
             if tr.action != '':
@@ -1114,25 +3378,34 @@ class Parser(object):
     ###########################################################################
     def generate_mocked_guards(self, cycle):
         self.count_mocked_guards(cycle)
-        transitions = list(self.current.graph.edges)
-        for origin, destination in transitions:
-            tr = self.current.graph[origin][destination]['data']
-            if tr.guard != '':
+        for tr in self.current.transitions():
+            # Shared methods: a single expectation summing the calls of all transitions
+            count_guard = sum(t.count_guard for t in self.current.sharing_transitions(tr, 'guard'))
+            count_action = sum(t.count_action for t in self.current.sharing_transitions(tr, 'action'))
+            if tr.guard != '' and self.current.canonical_transition(tr, 'guard') == tr:
                 self.indent(1)
                 self.fd.write('EXPECT_CALL(fsm, ')
-                self.fd.write(self.guard_function(origin, destination))
+                self.fd.write(self.guard_function(tr))
                 self.fd.write('())')
-                if tr.count_guard == 0:
+                # Shared guard only passing for some transitions: the guard is
+                # evaluated before leaving the origin state of the transition
+                origins = [t.origin for t in self.current.sharing_transitions(tr, 'guard')
+                           if t.count_guard != 0]
+                if count_guard == 0:
                     self.fd.write('.WillRepeatedly(Return(false));\n')
+                elif len(origins) != len(self.current.sharing_transitions(tr, 'guard')):
+                    self.fd.write('.WillRepeatedly(Invoke([&fsm](){')
+                    self.fd.write(' LOGD("' + self.cleaning_code(tr.guard) + '\\n");')
+                    self.fd.write(' return ' + ' || '.join('(fsm.state() == ' + self.state_enum(o) + ')' for o in dict.fromkeys(origins)) + '; }));\n')
                 else:
                     self.fd.write('.WillRepeatedly(Invoke([](){')
                     self.fd.write(' LOGD("' + self.cleaning_code(tr.guard) + '\\n");')
                     self.fd.write(' return true; }));\n')
-            if tr.action != '':
+            if tr.action != '' and self.current.canonical_transition(tr, 'action') == tr:
                 self.indent(1)
-                self.fd.write('EXPECT_CALL(fsm, ' + self.transition_function(origin, destination, False) + '())')
-                self.fd.write('.Times(' + str(tr.count_action) + ')')
-                if tr.count_action >= 1:
+                self.fd.write('EXPECT_CALL(fsm, ' + self.transition_function(tr, False) + '())')
+                self.fd.write('.Times(' + str(count_action) + ')')
+                if count_action >= 1:
                     self.fd.write('.WillRepeatedly(Invoke([](){')
                     self.fd.write(' LOGD("' + self.cleaning_code(tr.action) + '\\n");')
                     self.fd.write(' }))')
@@ -1164,7 +3437,7 @@ class Parser(object):
     ###########################################################################
     def generate_mocked_actions(self, cycle):
         for i in range(len(cycle) - 1):
-            tr = self.current.graph[cycle[i]][cycle[i+1]]['data'];
+            tr = self.current.transition(cycle[i], cycle[i+1])
             if tr.guard != '':
                 tr.count_guard += 1
             if tr.action != '':
@@ -1197,6 +3470,9 @@ class Parser(object):
         count = 0
         cycles = self.current.graph_cycles()
         for cycle in cycles:
+            # Join pseudo-states depend on orthogonal regions: not driven from here
+            if self.current.has_join_edge(cycle):
+                continue
             self.generate_line_separator(0, ' ', 80, '-')
             self.fd.write('TEST(' + self.current.class_name + 'Tests, TestCycle' + str(count) + ')\n{\n')
             count += 1
@@ -1212,17 +3488,18 @@ class Parser(object):
             self.indent(1), self.fd.write('Mock' + self.current.class_name + ' ' + 'fsm;\n')
             self.generate_mocked_guards(['[*]'] + cycle)
             self.fd.write('\n'), self.indent(1), self.fd.write('fsm.enter();\n')
-            guard = self.current.graph[self.current.initial_state][cycle[0]]['data'].guard
-            self.indent(1), self.fd.write('LOGD("[UNIT TEST] Current state: %s\\n", fsm.c_str());\n')
-            self.indent(1), self.fd.write('ASSERT_EQ(fsm.state(), ' + self.state_enum(cycle[0]) + ');\n')
-            self.indent(1), self.fd.write('ASSERT_STREQ(fsm.c_str(), "' + cycle[0] + '");\n')
+            guard = self.current.transition(self.current.initial_state, cycle[0]).guard
+            if not self.current.is_pseudo_state(cycle[0]):
+                self.indent(1), self.fd.write('LOGD("[UNIT TEST] Current state: %s\\n", fsm.c_str());\n')
+                self.indent(1), self.fd.write('ASSERT_EQ(fsm.state(), ' + self.state_enum(cycle[0]) + ');\n')
+                self.indent(1), self.fd.write('ASSERT_STREQ(fsm.c_str(), "' + cycle[0] + '");\n')
 
             # Iterate on all nodes of the cycle
             for i in range(len(cycle) - 1):
 # FIXME
 #                # External event not leaving the current state
 #                if self.current.graph.has_edge(cycle[i], cycle[i]) and (cycle[i] != cycle[i+1]):
-#                    tr = self.current.graph[cycle[i]][cycle[i]]['data']
+#                    tr = self.current.transition(cycle[i], cycle[i])
 #                    if tr.event.name != '':
 #                        self.indent(1), self.fd.write('LOGD("[' + self.current.class_name.upper() + ']// Event ' + tr.event.name + ' [' + tr.guard + ']: ' + cycle[i] + ' <--> ' + cycle[i] + '\\n");\n')
 #                        self.indent(1), self.fd.write('fsm.' + tr.event.caller('fsm') + ';')
@@ -1234,7 +3511,7 @@ class Parser(object):
 #                        self.indent(1), self.fd.write('ASSERT_STREQ(fsm.c_str(), "' + cycle[i] + '");\n')
 
                 # External event: print the name of the event + its guard
-                tr = self.current.graph[cycle[i]][cycle[i+1]]['data']
+                tr = self.current.transition(cycle[i], cycle[i+1])
                 if tr.event.name != '':
                     self.fd.write('\n'), self.indent(1)
                     self.fd.write('LOGD("\\n[' + self.current.class_name.upper() + '] Triggering event ' + tr.event.name + ' [' + tr.guard + ']: ' + cycle[i] + ' ==> ' + cycle[i + 1] + '\\n");\n')
@@ -1243,7 +3520,7 @@ class Parser(object):
                 if (i == len(cycle) - 2):
                     # Cycle of non external evants => malformed state machine
                     # I think this case is not good
-                    if self.current.graph[cycle[i+1]][cycle[1]]['data'].event.name == '':
+                    if self.current.transition(cycle[i+1], cycle[1]).event.name == '':
                         self.indent(1), self.fd.write('\n#warning "Malformed state machine: unreachable destination state"\n')
                     else:
                         # No explicit event => direct internal transition to the state if an explicit event can occures.
@@ -1253,7 +3530,7 @@ class Parser(object):
 
                 # No explicit event => direct internal transition to the state if an explicit event can occures.
                 # Else skip test for the destination state since we cannot test its internal state
-                elif self.current.graph[cycle[i+1]][cycle[i+2]]['data'].event.name != '':
+                elif self.current.transition(cycle[i+1], cycle[i+2]).event.name != '':
                     self.indent(1), self.fd.write('LOGD("[UNIT TEST] Current state: %s\\n", fsm.c_str());\n')
                     self.indent(1), self.fd.write('ASSERT_EQ(fsm.state(), ' + self.state_enum(cycle[i+1]) + ');\n')
                     self.indent(1), self.fd.write('ASSERT_STREQ(fsm.c_str(), "' + cycle[i+1] + '");\n')
@@ -1266,6 +3543,9 @@ class Parser(object):
         count = 0
         pathes = self.current.graph_all_paths_to_sinks()
         for path in pathes:
+            # Join pseudo-states depend on orthogonal regions: not driven from here
+            if self.current.has_join_edge(path):
+                continue
             self.generate_line_separator(0, ' ', 80, '-')
             self.fd.write('TEST(' + self.current.class_name + 'Tests, TestPath' + str(count) + ')\n{\n')
             count += 1
@@ -1284,17 +3564,17 @@ class Parser(object):
 
             # Iterate on all nodes of the path
             for i in range(len(path) - 1):
-                event = self.current.graph[path[i]][path[i+1]]['data'].event
+                event = self.current.transition(path[i], path[i+1]).event
                 if event.name != '':
-                    guard = self.current.graph[path[i]][path[i+1]]['data'].guard
+                    guard = self.current.transition(path[i], path[i+1]).guard
                     self.fd.write('\n'), self.indent(1)
                     self.fd.write('LOGD("[' + self.current.class_name.upper() + '] Event ' + event.name + ' [' + guard + ']: ' + path[i] + ' ==> ' + path[i + 1] + '\\n");\n')
                     self.fd.write('\n'), self.indent(1), self.fd.write('fsm.' + event.caller() + ';\n')
-                if (i == len(path) - 2):
+                if (i == len(path) - 2) and not self.current.is_pseudo_state(path[i+1]):
                     self.indent(1), self.fd.write('LOGD("[UNIT TEST] Current state: %s\\n", fsm.c_str());\n')
                     self.indent(1), self.fd.write('ASSERT_EQ(fsm.state(), ' + self.state_enum(path[i+1]) + ');\n')
                     self.indent(1), self.fd.write('ASSERT_STREQ(fsm.c_str(), "' + path[i+1] + '");\n')
-                elif self.current.graph[path[i+1]][path[i+2]]['data'].event.name != '':
+                elif self.current.transition(path[i+1], path[i+2]).event.name != '':
                     self.indent(1), self.fd.write('LOGD("[UNIT TEST] Current state: %s\\n", fsm.c_str());\n')
                     self.indent(1), self.fd.write('ASSERT_EQ(fsm.state(), ' + self.state_enum(path[i+1]) + ');\n')
                     self.indent(1), self.fd.write('ASSERT_STREQ(fsm.c_str(), "' + path[i+1] + '");\n')
@@ -1343,6 +3623,7 @@ class Parser(object):
         self.generate_unit_tests_mocked_class()
         self.generate_unit_tests_check_cycles()
         self.generate_unit_tests_pathes_to_sinks()
+        self.generate_unit_tests_scenarios()
         if not separated:
             self.generate_unit_tests_main_function(filename, files)
         self.generate_unit_tests_footer()
@@ -1369,17 +3650,365 @@ class Parser(object):
     ###########################################################################
     def generate_cxx_code(self, cxxfile, separated):
         files = []
+        if self.data_files() != 0 and not self.is_hpp_file('_.' + cxxfile):
+            self.report(self.master, 'Option --data-only ignored: it needs a C++ header file (hpp)')
+            self.options = [o for o in self.options if not o.startswith('--data-only')]
+        if self.handlers_mode() and self.data_files() != 0:
+            self.report(self.master, 'Option --handlers ignored: it cannot be combined with --data-only')
+            self.options.remove('--handlers')
         for self.current in self.machines.values():
+            if self.current.shared != None:
+                continue
             f = self.current.class_name + 'Tests.cpp'
             files.append(f)
             f = self.current.class_name + '.' +  cxxfile
             self.generate_state_machine(f)
+            if self.data_files() != 0 and self.is_hpp_file(f):
+                self.generate_data_tables(f)
+            if self.model_check_mode() and self.current == self.master and self.is_hpp_file(f):
+                self.generate_model_checker(f)
             self.generate_unit_tests(f, files, separated)
         if separated:
             mainfile = self.master.class_name + 'MainTests.cpp'
             mainfile = os.path.join(os.path.dirname(cxxfile), mainfile)
             self.generate_unit_tests_main_file(mainfile, files)
 
+    ###########################################################################
+    ### Return the index of the given string inside the pool of strings of the
+    ### binary tables, appending it when missing (option '--tables').
+    ### param[in] strings the dictionnary "string => offset in the pool".
+    ### param[in] s the string.
+    ###########################################################################
+    def table_string(self, strings, s):
+        if s not in strings:
+            strings[s] = sum(len(k.encode()) + 1 for k in strings)
+        return strings[s]
+
+    ###########################################################################
+    ### Return the index of the hook (guard or action method) inside the binary
+    ### tables, appending it when missing. Hooks are referred by the name of
+    ### their generated C++ method and bound to callbacks when tables are loaded,
+    ### unless their code can be compiled into bytecode. The bytecode computes on
+    ### 64-bit signed integers and wraps them to the width of their variable
+    ### when storing them: hooks using unsigned variables of 32 or 64 bits
+    ### (modular arithmetic, unsigned comparisons) keep their callback.
+    ### param[in] hooks the dictionnary "method name => (index, kind, bytecode)"
+    ###   where bytecode is None for hooks needing a callback.
+    ### param[in] name the C++ method name or '' when there is no hook.
+    ### param[in] kind 0 for guards, 1 for actions.
+    ### param[in] code the C++ code of the hook.
+    ### param[in] declarations the tuple (variables, defines) of the variables
+    ###   and of the literal macros given to the bytecode compiler.
+    ###########################################################################
+    def table_hook(self, hooks, name, kind, code, declarations):
+        if name == '':
+            return 0xFFFF
+        if name not in hooks:
+            try:
+                bytecode = Bytecode(code, kind == 0, declarations[0], declarations[1])
+            except ValueError:
+                bytecode = None
+            if bytecode != None:
+                names = [k for op, _, _, _, k in bytecode.code if op in ['LOAD', 'STORE']]
+                widths = [declarations[0][v][2] for v in names if v in declarations[0]]
+                if any(w[0] >= 4 and not w[1] for w in widths):
+                    bytecode = None
+            hooks[name] = (len(hooks), kind, bytecode)
+        return hooks[name][0]
+
+    ###########################################################################
+    ### Return the value of the C++ literal converted to the given type or None
+    ### if the text is not a literal.
+    ### param[in] text the C++ literal (i.e. 'true', '42', '0.5f').
+    ### param[in] kind 'int', 'bool' or 'real'.
+    ###########################################################################
+    def table_literal(self, text, kind):
+        text = text.strip()
+        if text in ['true', 'false']:
+            value = 1 if text == 'true' else 0
+        elif re.match(r'[-+]?\d+[uUlL]*$', text):
+            value = int(text.rstrip('uUlL'))
+        elif re.match(r'[-+]?(\d+\.\d*|\.\d+)([eE][-+]?\d+)?[fF]?$', text):
+            value = float(text.rstrip('fF'))
+        else:
+            return None
+        return float(value) if kind == 'real' else int(value != 0) if kind == 'bool' else int(value)
+
+    ###########################################################################
+    ### Return the variables and literal macros known by the bytecode compiler:
+    ### the dictionnary "name => (type, initial value, (bytes, signed))" of the
+    ### scalar member variables declared by '[code] and of the parameters of
+    ### data events, and the dictionnary "name => (type, value)" of the
+    ### '[header] macros defining a literal. Macros defining a scalar type (i.e.
+    ### '#define REFSPEED int') are type aliases. Types are 'int', 'bool' or
+    ### 'real'; integers also have the width and the signedness of their C++
+    ### type (LP64 data model).
+    ### param[in] machines the state machine and its nested state machines.
+    ###########################################################################
+    def table_declarations(self, machines):
+        types = { 'bool': 'bool', 'float': 'real', 'double': 'real' }
+        widths = { 'bool': (1, False), 'float': (8, True), 'double': (8, True),
+                   'char': (1, True), 'short': (2, True), 'int': (4, True), 'long': (8, True),
+                   'unsigned': (4, False), 'size_t': (8, False) }
+        for bits in [8, 16, 32, 64]:
+            widths['int' + str(bits) + '_t'] = (bits // 8, True)
+            widths['uint' + str(bits) + '_t'] = (bits // 8, False)
+        for t in widths:
+            types.setdefault(t, 'int')
+        variables, defines = dict(), dict()
+        for sm in machines:
+            for name, value in re.findall(r'#\s*define\s+(\w+)[ \t]+([^\n]+)', sm.extra_code.header):
+                value = value.strip()
+                if value in types:
+                    types[name], widths[name] = types[value], widths[value]
+                elif value in ['true', 'false']:
+                    defines[name] = ('bool', self.table_literal(value, 'bool'))
+                elif self.table_literal(value, 'int') != None:
+                    kind = 'int' if re.match(r'[-+]?\d+[uUlL]*$', value) else 'real'
+                    defines[name] = (kind, self.table_literal(value, kind))
+        declarator = r'[A-Za-z_]\w*(?:\s*=\s*[^;,]+)?'
+        for sm in machines:
+            for t, names in re.findall(r'\b(\w+)\s+(' + declarator + r'(?:\s*,\s*' + declarator + r')*)\s*;',
+                                       sm.extra_code.code):
+                if t not in types:
+                    continue
+                for d in names.split(','):
+                    name, _, value = d.partition('=')
+                    value = self.table_literal(value, types[t])
+                    variables[name.strip()] = (types[t], 0 if value == None else value, widths[t])
+            for tr in sm.transitions():
+                for p in tr.event.params:
+                    t = p.strip().upper()
+                    if t in types:
+                        variables.setdefault(p.strip(), (types[t], 0, widths[t]))
+        return variables, defines
+
+    ###########################################################################
+    ### Return the records of the slots, of the constants and of the
+    ### instructions of the hooks compiled into bytecode, and set the index of
+    ### their first instruction. Slots are the variables used by the bytecode.
+    ### param[in] hooks the dictionnary "method name => (index, kind, bytecode)".
+    ### param[in] variables the dictionnary "name => (type, initial value)".
+    ### param[in] strings the pool of strings.
+    ###########################################################################
+    def table_bytecode(self, hooks, variables, strings):
+        slots, constants, instructions, undeclared = dict(), dict(), [], []
+        kinds = { 'int': 0, 'real': 1, 'bool': 2 }
+        for name, (index, kind, bytecode) in hooks.items():
+            if bytecode == None:
+                continue
+            first = len(instructions)
+            hooks[name] = (index, kind, bytecode, first)
+            undeclared += [v for v in bytecode.undeclared if v not in undeclared]
+            for op, dst, a, b, k in bytecode.code:
+                if op in ['LOAD', 'STORE']:
+                    k = slots.setdefault(k, len(slots))
+                elif op == 'CONST':
+                    k = constants.setdefault(('real' if k[0] == 'real' else 'int', k[1]), len(constants))
+                elif op in ['JZ', 'JNZ']:
+                    k += first
+                instructions.append(struct.pack('<BBBBI', Bytecode.OPCODES.index(op), dst, a, b, k))
+        if len(undeclared) != 0:
+            self.report(self.master, 'Variables ' + ', '.join(undeclared) + ' are not declared: interpreted as int')
+        srecords = []
+        for name in slots:
+            kind, value, (width, signed) = variables.get(name, ('int', 0, (4, True)))
+            srecords.append(struct.pack('<IHBBd' if kind == 'real' else '<IHBBq', self.table_string(strings, name),
+                                        kinds[kind], width if kind == 'int' else 0, int(signed), value))
+        crecords = [struct.pack('<d' if kind == 'real' else '<q', value) for (kind, value) in constants]
+        return srecords, crecords, instructions
+
+    ###########################################################################
+    ### Return the list of features of the state machine and of its nested state
+    ### machines the interpreter does not execute.
+    ###########################################################################
+    def table_unsupported_features(self):
+        features = []
+        for sm in [self.master] + self.master.descendants():
+            if sm.region != 0:
+                features.append('orthogonal regions')
+            if len(sm.pseudo_states('fork') + sm.pseudo_states('join')) != 0:
+                features.append('fork and join pseudo-states')
+            if any(tr.history != '' for tr in sm.transitions()):
+                features.append('history pseudo-states')
+            if len(sm.filters) != 0:
+                features.append('filters of noisy events (debounce, throttle)')
+        return list(dict.fromkeys(features))
+
+    ###########################################################################
+    ### Generate the binary file of tables of the state machine and of its
+    ### nested state machines (option '--tables'). This file is executed by the
+    ### interpreter of include/Interpreter.hpp instead of compiling the C++
+    ### class: changing the diagram does not need to recompile the application.
+    ### The file holds, in this order, a header and the arrays of constants,
+    ### slots, machines, states, events, transitions, hooks and instructions,
+    ### then a pool of strings. Integers are little endian and records are
+    ### aligned on their size (up to 8 bytes), so the file can be mapped in
+    ### memory and shared by processes. Transitions of a state are contiguous
+    ### and grouped by event in the order of their guard chain. Transient states
+    ### are not collapsed: the interpreter traverses them. Simple guards and
+    ### actions are compiled into bytecode over slots of the instance (see the
+    ### class Bytecode), the others are reported as needing a callback.
+    ###########################################################################
+    def generate_tables(self):
+        if '--tables' not in self.options:
+            return
+        features = self.table_unsupported_features()
+        if len(features) != 0:
+            self.report(self.master, 'Tables not generated: the interpreter does not manage ' + ', '.join(features))
+            return
+        NONE = 0xFFFF
+        machines = [self.master] + self.master.descendants()
+        strings, hooks, events = dict(), dict(), dict()
+        declarations = self.table_declarations(machines)
+        # Global index of states: states of each machine are contiguous
+        first, ids = [], dict()
+        for sm in machines:
+            first.append(len(ids))
+            for state in sm.graph.nodes:
+                ids[(sm.name, state)] = len(ids)
+        mrecords, srecords, trecords = [], [], []
+        for m, sm in enumerate(machines):
+            self.current = sm
+            parent = NONE if sm.parent == None else machines.index(sm.parent)
+            owner = NONE if sm.parent == None else ids[(sm.parent.name, sm.owner_state())]
+            mrecords.append(struct.pack('<IHHHHHH', self.table_string(strings, sm.class_name),
+                                        ids[(sm.name, '[*]')], parent, owner, first[m],
+                                        sm.graph.number_of_nodes(), 0))
+            for state in sm.graph.nodes:
+                data = sm.graph.nodes[state]['data']
+                entering = self.state_entering_function(state) if data.entering != '' else ''
+                leaving = self.state_leaving_function(state) if data.leaving != '' else ''
+                child = sm.nested_machine(state)
+                # Transitions grouped by event, eventless transitions included
+                transitions = sm.transitions_from(state)
+                chains = []
+                for event in dict.fromkeys(tr.event for tr in transitions):
+                    chains += sm.guard_chain(state, [tr for tr in transitions if tr.event == event])
+                srecords.append(struct.pack('<IHHHHHHHH', self.table_string(strings, self.state_name(state)), m,
+                                            self.table_hook(hooks, entering, 1, data.entering, declarations),
+                                            self.table_hook(hooks, leaving, 1, data.leaving, declarations),
+                                            len(trecords), len(chains), NONE if child == None else machines.index(child),
+                                            1 if data.pseudo != '' else 0, 0))
+                for tr in chains:
+                    event = NONE
+                    if tr.event.name != '':
+                        event = events.setdefault(tr.event.name, len(events))
+                    guard = self.guard_function(tr, True) if tr.guard != '' else ''
+                    action = self.transition_function(tr, True) if tr.action != '' else ''
+                    trecords.append(struct.pack('<HHHHHH', event, ids[(sm.name, state)], ids[(sm.name, tr.destination)],
+                                                self.table_hook(hooks, guard, 0, tr.guard, declarations),
+                                                self.table_hook(hooks, action, 1, tr.action, declarations), 0))
+        self.current = self.master
+        if max(len(ids), len(trecords), len(hooks), len(events)) >= NONE:
+            self.report(self.master, 'Tables not generated: too many states, transitions, events or hooks')
+            return
+        erecords = [struct.pack('<I', self.table_string(strings, e)) for e in events]
+        slots, constants, instructions = self.table_bytecode(hooks, declarations[0], strings)
+        if max(len(slots), len(constants), len(instructions)) >= NONE:
+            self.report(self.master, 'Tables not generated: too many slots, constants or instructions')
+            return
+        hrecords = [struct.pack('<IHH', self.table_string(strings, name), hook[1], NONE if hook[2] == None else hook[3])
+                    for name, hook in hooks.items()]
+        callbacks = [name for name, hook in hooks.items() if hook[2] == None]
+        if len(callbacks) != 0:
+            self.report(self.master, 'Hooks needing a C++ callback: ' + ', '.join(callbacks))
+        pool = b''.join(s.encode() + b'\0' for s in strings)
+        pool += b'\0' * (-len(pool) % 8)
+        body = b''.join(constants + slots + mrecords + srecords + erecords + trecords + hrecords + instructions) + pool
+        header = struct.pack('<4sHHHHHHIIHHHH', b'FSMT', 2, len(mrecords), len(srecords), len(erecords),
+                             len(trecords), len(hrecords), len(pool), 32 + len(body),
+                             len(slots), len(constants), len(instructions), 0)
+        with open(self.master.class_name + '.table', 'wb') as f:
+            f.write(header + body)
+        self.generate_migration(header + body)
+
+    ###########################################################################
+    ### Read back the states and slots of binary tables.
+    ### param[in] data the content of a file generated with --tables.
+    ### return None if the tables are not readable, else the tuple:
+    ###   - the list of (state machine path, state name) of states,
+    ###   - the list of (slot name, type) of slots,
+    ###   - the dictionary state machine path -> index of its initial state.
+    ### The path of a nested state machine is the path of its composite state
+    ### (i.e. 'ON/ACTIVE'), the one of the root state machine is ''.
+    ###########################################################################
+    def table_index(self, data):
+        if len(data) < 32 or data[0:4] != b'FSMT':
+            return None
+        (version, nmachines, nstates, _, _, _, nstrings, size, nslots, nconstants, _, _) = \
+            struct.unpack_from('<HHHHHHIIHHHH', data, 4)
+        if version != 2 or size > len(data):
+            return None
+        def string(offset):
+            start = size - nstrings + offset
+            return data[start:data.index(b'\0', start)].decode()
+        offset = 32 + 8 * nconstants
+        slots = [struct.unpack_from('<IH', data, offset + 16 * i) for i in range(nslots)]
+        offset += 16 * nslots
+        machines = [struct.unpack_from('<IHHH', data, offset + 16 * i) for i in range(nmachines)]
+        offset += 16 * nmachines
+        states = [struct.unpack_from('<IH', data, offset + 20 * i) for i in range(nstates)]
+        paths = []
+        for (_, _, parent, owner) in machines: # Parents are listed first
+            name = '' if parent == 0xFFFF else string(states[owner][0])
+            paths.append(name if parent == 0xFFFF or paths[parent] == '' else paths[parent] + '/' + name)
+        return ([(paths[machine], string(name)) for (name, machine) in states],
+                [(string(name), kind) for (name, kind) in slots],
+                { paths[m]: initial for m, (_, initial, _, _) in enumerate(machines) })
+
+    ###########################################################################
+    ### Generate the migration of instances running older tables (given by the
+    ### option --migrate-from=<file>) to the new tables: the new index of each
+    ### old state and of each old slot (see MachineMigration in
+    ### include/Interpreter.hpp). States are matched by name inside the same
+    ### state machine or by '[migrate] annotations, removed states are mapped to
+    ### the initial pseudo-state of their state machine (restarting it).
+    ### param[in] data the content of the new tables.
+    ###########################################################################
+    def generate_migration(self, data):
+        NONE = 0xFFFF
+        path = next((o[len('--migrate-from='):] for o in self.options if o.startswith('--migrate-from=')), None)
+        if path == None:
+            return
+        try:
+            with open(path, 'rb') as f:
+                old = f.read()
+        except OSError:
+            self.report(self.master, 'Migration not generated: cannot read ' + path)
+            return
+        old_index, new_index = self.table_index(old), self.table_index(data)
+        if old_index == None:
+            self.report(self.master, 'Migration not generated: ' + path + ' is not a file of tables of this version')
+            return
+        ids = { state: i for i, state in enumerate(new_index[0]) }
+        for (machine, old_state), new_state in self.migrations.items():
+            if (machine, new_state) not in ids:
+                self.report(self.master, 'Unknown state ' + new_state + ' in the annotation [migrate] ' + old_state + ' ' + new_state)
+        states, removed = [], []
+        for (machine, name) in old_index[0]:
+            state = ids.get((machine, self.migrations.get((machine, name), name)))
+            if state == None:
+                state = new_index[2].get(machine, NONE)
+                removed.append(name if machine == '' else machine + '/' + name)
+            states.append(state)
+        slots = dict((name, i) for i, (name, _) in enumerate(new_index[1]))
+        slots = [slots.get(name, NONE) for (name, _) in old_index[1]]
+        if len(removed) != 0:
+            self.report(self.master, 'Migration restarts the state machines of the removed states: ' + ', '.join(removed))
+        dropped = [name for i, (name, _) in enumerate(old_index[1]) if slots[i] == NONE]
+        if len(dropped) != 0:
+            self.report(self.master, 'Migration drops the removed slots: ' + ', '.join(dropped))
+        def fnv(data):
+            h = 2166136261
+            for b in data:
+                h = ((h ^ b) * 16777619) & 0xFFFFFFFF
+            return h
+        size = struct.unpack_from('<I', old, 20)[0]
+        header = struct.pack('<4sHHHHII', b'FSMM', 1, len(states), len(slots), 0, fnv(old[:size]), fnv(data))
+        with open(self.master.class_name + '.migration', 'wb') as f:
+            f.write(header + struct.pack('<' + str(len(states) + len(slots)) + 'H', *(states + slots)))
+
     ###########################################################################
     ### Manage transitions without events: we name them internal event and the
     ### transition to the next state is made. Since we cannot offer a public
@@ -1393,8 +4022,12 @@ class Parser(object):
         # output edges
         states = []
         for state in list(self.current.graph.nodes()):
-            for dest in list(self.current.graph.neighbors(state)):
-                tr = self.current.graph[state][dest]['data']
+            # Outgoing transitions of pseudo-states are decision trees
+            if self.current.is_pseudo_state(state):
+                continue
+            for tr in self.current.transitions_from(state):
+                if self.current.is_join_edge(state, tr.destination):
+                    continue
                 if (tr.event.name == '') and (state not in states):
                     states.append(state)
 
@@ -1402,16 +4035,16 @@ class Parser(object):
         for state in states:
             count = 0 # count number of ways
             code = ''
-            for dest in list(self.current.graph.neighbors(state)):
-                tr = self.current.graph[state][dest]['data']
-                if tr.event.name != '':
+            for tr in self.current.transitions_from(state):
+                dest = tr.destination
+                if tr.event.name != '' or self.current.is_join_edge(state, dest):
                    continue
                 if tr.guard != '':
                     if code == '':
                         code += '        if '
                     else :
                         code += '        else if '
-                    code += '(' + self.guard_function(state, dest) + '())\n'
+                    code += '(' + self.guard_function(tr) + '())\n'
                 elif tr.event.name == '': # Dummy event and dummy guard
                     if count == 1:
                         code += '\n#warning "Missformed state machine: missing guard from state ' + state + ' to state ' + dest + '"\n'
@@ -1423,22 +4056,568 @@ class Parser(object):
                     code += '            LOGD("[' + self.current.class_name.upper() + '][STATE ' + state +  '] Candidate for internal transitioning to state ' + dest + '\\n");\n'
                     code += '            static const Transition tr =\n'
                     code += '            {\n'
-                    code += '                .destination = ' + self.state_enum(dest) + ',\n'
-                    if tr.action != '':
-                        code += '                .action = &' + self.transition_function(state, dest, True) + ',\n'
+                    code += '                .destination = ' + self.state_enum(self.transition_destination(tr)) + ',\n'
+                    if self.transition_action(tr) != '':
+                        code += '                .action = ' + self.hook(self.transition_action(tr)) + ',\n'
                     code += '            };\n'
                     code += '            transition(&tr);\n'
                     code += '        }\n'
                     count += 1
             self.current.graph.nodes[state]['data'].internal += code
 
+    ###########################################################################
+    ### Fork and join pseudo-states are placed in the state machine holding the
+    ### composite state while their transitions reach states of its orthogonal
+    ### regions. Replace these transitions by a transition from the fork to the
+    ### composite state (or from the composite state to the join) and memorize
+    ### the states of the regions. Each state of the regions synchronized by a
+    ### join gets a bit in the word of this state machine.
+    ###########################################################################
+    def manage_forks_and_joins(self):
+        for state in self.current.pseudo_states('fork') + self.current.pseudo_states('join'):
+            pseudo = self.current.graph.nodes[state]['data']
+            fork = (pseudo.pseudo == 'fork')
+            ends = self.current.graph.successors(state) if fork else self.current.graph.predecessors(state)
+            composite = ''
+            for s in list(ends):
+                region = self.current.region_holding(s)
+                tr = self.current.transition(state, s) if fork else self.current.transition(s, state)
+                if region == None or tr.event.name != '':
+                    continue
+                if composite not in ['', region.owner_state()]:
+                    self.current.warning('The ' + pseudo.pseudo + ' pseudo-state ' + state +
+                                         ' shall reach the orthogonal regions of a single composite state')
+                    continue
+                composite = region.owner_state()
+                pseudo.regions.append((region, s))
+                if fork:
+                    self.current.graph.remove_edge(state, s)
+                else:
+                    self.current.graph.remove_edge(s, state)
+                    if s not in region.join_bits:
+                        region.join_bits[s] = 1 << self.current.region_bits
+                        self.current.region_bits += 1
+                self.current.sharing.clear()
+                if self.current.graph.degree(s) == 0:
+                    self.current.graph.remove_node(s)
+            if composite == '':
+                self.current.warning('The ' + pseudo.pseudo + ' pseudo-state ' + state +
+                                     ' shall be connected to states of orthogonal regions')
+                continue
+            tr = Transition()
+            tr.arrow = '->'
+            tr.origin, tr.destination = (state, composite) if fork else (composite, state)
+            self.current.add_transition(tr)
+        if self.current.region_bits > 64:
+            self.fatal('Too many states synchronized by join pseudo-states to be packed in a word')
+
+    ###########################################################################
+    ### Search history pseudo-states used by the diagram and check that states
+    ### and nesting levels can be packed inside the history word (the
+    ### configuration word).
+    ###########################################################################
+    def verify_histories(self):
+        for self.current in self.machines.values():
+            for tr in self.current.transitions():
+                if tr.history == 'H*' or (tr.history == 'H' and self.history == ''):
+                    self.history = tr.history
+        if self.history == '':
+            return
+        for self.current in self.machines.values():
+            if self.current.region != 0:
+                self.current.warning('The history of orthogonal regions is not memorized')
+
+    ###########################################################################
+    ### Search states that cannot be reached from the initial state following
+    ### transitions (with or without events) and fork pseudo-states. Since
+    ### PlantUML state names are global, a state reached in a state machine is
+    ### reached in all the state machines where it appears, and a nested state
+    ### machine having a reached state makes its composite state reached. The
+    ### search is iterated until no more state is reached. Unreachable states,
+    ### their transitions and the nested state machines of their composite
+    ### states are removed from the generated code, or only reported when the
+    ### option '--report-dead-states' is given.
+    ###########################################################################
+    def prune_dead_states(self):
+        prune = '--report-dead-states' not in self.options
+        machines = list(self.machines.values())
+        alive = {sm.name: set() for sm in machines}
+        changed = True
+        while changed:
+            changed = False
+            names = set(s for sm in machines for s in alive[sm.name] if s not in ['[*]', '*'])
+            for sm in machines:
+                roots = set(s for s in sm.graph.nodes if s in names)
+                roots |= set(c.owner_state() for c in sm.children if len(alive[c.name] - set(['[*]', '*'])) != 0)
+                if sm.parent == None or sm.owner_state() in alive[sm.parent.name]:
+                    forks = [f for f in sm.parent.pseudo_states('fork') if f in alive[sm.parent.name]] if sm.parent != None else []
+                    entries = [s for f in forks for (r, s) in sm.parent.graph.nodes[f]['data'].regions if r == sm]
+                    if sm.initial_state != '':
+                        roots.add(sm.initial_state)
+                    elif len(entries) == 0:
+                        # Nested state machine without initial state: unknown entries
+                        roots |= set(sm.graph.nodes)
+                    roots |= set(entries + list(sm.join_bits))
+                reached = set(roots)
+                for state in roots:
+                    reached |= nx.descendants(sm.graph, state)
+                if reached != alive[sm.name]:
+                    alive[sm.name], changed = reached, True
+        # Report and remove unreachable states
+        dead_machines = set()
+        for sm in machines:
+            if sm.parent != None and (sm.parent.name in dead_machines or sm.owner_state() not in alive[sm.parent.name]):
+                self.report(sm, ('Removing' if prune else 'Found') + ' the nested state machine of the unreachable state ' + sm.owner_state())
+                dead_machines.add(sm.name)
+                continue
+            dead = [s for s in sm.graph.nodes if s not in alive[sm.name]]
+            for state in dead:
+                self.report(sm, ('Removing' if prune else 'Found') + ' the unreachable state ' + state)
+                for destination in sm.graph.neighbors(state):
+                    self.report(sm, ('Removing' if prune else 'Found') + ' the unreachable transition ' + state + ' --> ' + destination)
+            if not prune:
+                continue
+            sm.graph.remove_nodes_from(dead)
+            sm.sharing.clear()
+            for event, arcs in sm.lookup_events.items():
+                sm.lookup_events[event] = [tr for tr in arcs if tr.origin not in dead]
+        if not prune:
+            return
+        for sm in machines:
+            if sm.name in dead_machines:
+                del self.machines[sm.name]
+                continue
+            sm.children = [c for c in sm.children if c.name not in dead_machines]
+            sm.broadcasts = [(c, e) for (c, e) in sm.broadcasts if c not in dead_machines]
+
+    ###########################################################################
+    ### Partition the states of the state machine into blocks of equivalent
+    ### states (bisimulation): same entering, leaving and activity actions and,
+    ### for each outgoing transition, same event, guard, action and history
+    ### reaching equivalent states. Blocks are refined until stable. States that
+    ### cannot be merged (composite states, pseudo-states, states known by other
+    ### state machines, sources and targets of fork and join pseudo-states,
+    ### targets of histories ...) are kept in their own block. A block whose merge
+    ### would turn a transition into a self-transition is split and the
+    ### refinement is restarted.
+    ### param[in] fsm the state machine.
+    ### return the list of blocks (list of states in the graph order).
+    ###########################################################################
+    def equivalent_states(self, fsm):
+        others = set(s for sm in self.machines.values() if sm != fsm for s in sm.graph.nodes)
+        alone = set(s for s in fsm.graph.nodes if s in ['[*]', '*'] or s in others or s in fsm.join_bits or
+                    fsm.is_pseudo_state(s) or fsm.nested_machine(s) != None)
+        for f in fsm.pseudo_states('fork') + fsm.pseudo_states('join'):
+            alone |= set(fsm.graph.predecessors(f)) | set(fsm.graph.neighbors(f))
+        if fsm.parent != None:
+            for f in fsm.parent.pseudo_states('fork') + fsm.parent.pseudo_states('join'):
+                alone |= set(s for (sm, s) in fsm.parent.graph.nodes[f]['data'].regions if sm == fsm)
+        alone |= set(tr.destination for tr in fsm.transitions() if tr.history != '')
+        while True:
+            block = dict()
+            for s in fsm.graph.nodes:
+                data = fsm.graph.nodes[s]['data']
+                block[s] = (s,) if s in alone else (data.entering, data.leaving, data.activity)
+            # Refine blocks by the labels of outgoing transitions
+            while True:
+                labels = dict()
+                for s in fsm.graph.nodes:
+                    out = []
+                    for tr in fsm.transitions_from(s):
+                        d = tr.destination
+                        out.append((tr.event.header(), tr.guard, tr.action, tr.history, 'self' if d == s else block[d]))
+                    labels[s] = (block[s], tuple(sorted(out, key=str)))
+                ids = dict()
+                refined = {s: ids.setdefault(labels[s], len(ids)) for s in fsm.graph.nodes}
+                stable = len(ids) == len(set(block.values()))
+                block = refined
+                if stable:
+                    break
+            blocks = defaultdict(list)
+            for s in fsm.graph.nodes:
+                blocks[block[s]].append(s)
+            # Check that merging does not create new self-transitions
+            split = set()
+            for members in blocks.values():
+                if len(members) == 1:
+                    continue
+                for (o, d) in fsm.graph.edges():
+                    if o != d and o in members and d in members:
+                        split |= set(members)
+            if len(split) == 0:
+                return list(blocks.values())
+            alone |= split
+
+    ###########################################################################
+    ### Merge equivalent states of each state machine (option '--minimize-states')
+    ### to reduce the number of enumerates, table entries and generated methods.
+    ### The first state of each block is kept and transitions reaching the
+    ### other states of the block are redirected to it.
+    ###########################################################################
+    def minimize_states(self):
+        if '--minimize-states' not in self.options:
+            return
+        for fsm in self.machines.values():
+            merged = dict()
+            for members in self.equivalent_states(fsm):
+                for s in members[1:]:
+                    merged[s] = members[0]
+                if len(members) > 1:
+                    self.report(fsm, 'Merging the equivalent states ' + ', '.join(members) + ' into ' + members[0])
+            if len(merged) == 0:
+                continue
+            for (o, d, k, tr) in list(fsm.graph.edges(keys=True, data='data')):
+                if o not in merged and d in merged:
+                    fsm.graph.remove_edge(o, d, k)
+                    tr.destination = merged[d]
+                    fsm.add_transition(tr)
+            fsm.graph.remove_nodes_from(merged.keys())
+            fsm.sharing.clear()
+            for event, arcs in fsm.lookup_events.items():
+                fsm.lookup_events[event] = [tr for tr in arcs if tr.origin not in merged]
+
+    ###########################################################################
+    ### Return the cost of calling the given C++ method of the current state
+    ### machine: its '[cost] annotation, qualified by the class name or not, or
+    ### the default one.
+    ### param[in] name the C++ method name (without class name).
+    ### param[in] guard True for a guard, False for an action.
+    ###########################################################################
+    def hook_cost(self, name, guard=False):
+        ns = 0
+        for key in [self.current.class_name + '::' + name, name, 'default']:
+            if key in self.costs:
+                ns = self.costs[key]
+                break
+        return Cost(guards=1, ns=ns) if guard else Cost(hooks=1, ns=ns)
+
+    ###########################################################################
+    ### Return the worst-case cost of the guards of the given transitions, all
+    ### evaluated when none of them is true.
+    ### param[in] transitions the list of transitions.
+    ###########################################################################
+    def guards_cost(self, transitions):
+        cost = Cost()
+        for tr in transitions:
+            if tr.guard != '':
+                cost += self.hook_cost(self.guard_function(tr), True)
+        return cost
+
+    ###########################################################################
+    ### Return the worst-case cost of taking the given transition once its guard
+    ### is true: leaving the origin state, actions of the transition and of the
+    ### collapsed eventless chain, branches of pseudo-states then entering the
+    ### destination state.
+    ### param[in] tr the transition.
+    ### param[in] visited the states already entered by eventless transitions.
+    ###########################################################################
+    def transition_cost(self, tr, visited):
+        cost = Cost()
+        destination = self.transition_destination(tr)
+        pseudo = self.current.is_pseudo_state(destination)
+        external = (destination != tr.origin) or pseudo
+        origin = self.current.graph.nodes[tr.origin]['data']
+        if external and origin.leaving != '':
+            cost += self.hook_cost(self.state_leaving_function(tr.origin, False))
+        for call in self.chaining_calls(tr):
+            cost += self.hook_cost(call)
+        if pseudo:
+            return cost + self.pseudo_state_cost(destination, visited)
+        return cost + self.arrival_cost(destination, external, visited)
+
+    ###########################################################################
+    ### Return the worst-case cost of passing through a choice or junction
+    ### pseudo-state: guards of its branches, action of the branch taken then
+    ### entering its destination.
+    ### param[in] state the PlantUML name of the pseudo-state.
+    ### param[in] visited the states already entered by eventless transitions.
+    ###########################################################################
+    def pseudo_state_cost(self, state, visited):
+        branches = self.current.pseudo_state_branches(state)
+        worst = Cost()
+        for tr in branches:
+            cost = Cost()
+            for call in self.chaining_calls(tr):
+                cost += self.hook_cost(call)
+            destination = self.transition_destination(tr)
+            if self.current.is_pseudo_state(destination):
+                cost += self.pseudo_state_cost(destination, visited)
+            else:
+                cost += self.arrival_cost(destination, True, visited)
+            worst = worst.max(cost)
+        return self.guards_cost(branches) + worst
+
+    ###########################################################################
+    ### Return the worst-case cost of entering a state: its entering action, the
+    ### initial transitions of its nested state machines and its eventless
+    ### transitions, each one being a hop through the nesting queue. Cycles of
+    ### eventless transitions are unbounded.
+    ### param[in] state the PlantUML name of the state.
+    ### param[in] external False for a self-transition not re-entering the state.
+    ### param[in] visited the states already entered by eventless transitions.
+    ###########################################################################
+    def arrival_cost(self, state, external, visited):
+        cost = Cost()
+        if not external:
+            return cost
+        if self.current.graph.nodes[state]['data'].entering != '':
+            cost += self.hook_cost(self.state_entering_function(state, False))
+        for sm in self.current.regions_of(state):
+            cost += Cost(forwards=1) + self.initial_cost(sm)
+        eventless = [tr for tr in self.current.transitions_from(state)
+                     if tr.event.name == '' and not self.current.is_join_edge(state, tr.destination)]
+        if len(eventless) == 0:
+            return cost
+        if state in visited:
+            return cost + Cost(hops=float('inf'), ns=float('inf'))
+        worst = Cost()
+        for tr in eventless:
+            worst = worst.max(Cost(hops=1) + self.transition_cost(tr, visited | { state }))
+        return cost + self.guards_cost(eventless) + worst
+
+    ###########################################################################
+    ### Return the worst-case cost of entering a nested state machine by its
+    ### initial transitions.
+    ### param[in] sm the nested state machine.
+    ###########################################################################
+    def initial_cost(self, sm):
+        backup, self.current = self.current, sm
+        worst = Cost()
+        if sm.initial_state != '':
+            for tr in sm.transitions_from(sm.initial_state):
+                worst = worst.max(self.transition_cost(tr, set()))
+        self.current = backup
+        return worst
+
+    ###########################################################################
+    ### Return the worst-case cost of the reaction of the current state machine
+    ### to an external event from the given state: forwarding the event to the
+    ### nested state machines of the state, evaluating the guards of its
+    ### transitions (none when they are compiled into range lookups) and taking
+    ### the most expensive one.
+    ### param[in] event the external event.
+    ### param[in] state the PlantUML name of the state.
+    ###########################################################################
+    def event_cost(self, event, state):
+        cost = Cost()
+        for (name, e) in self.current.broadcasts:
+            sm = self.machines[name]
+            if e != event or sm.owner_state() != state:
+                continue
+            backup, self.current = self.current, sm
+            worst = Cost()
+            for s in sm.graph.nodes:
+                worst = worst.max(self.event_cost(event, s))
+            self.current = backup
+            cost += Cost(forwards=1) + worst
+        chain = self.current.guard_chain(state, self.current.lookup_events.get(event, []))
+        if len(chain) == 0:
+            return cost
+        if self.range_guards(chain) == None:
+            cost += self.guards_cost(chain)
+        worst = Cost()
+        for tr in chain:
+            worst = worst.max(self.transition_cost(tr, set()))
+        return cost + worst
+
+    ###########################################################################
+    ### Report the worst-case cost of each external event from each state of
+    ### each state machine (option '--report-costs'). Durations come from the
+    ### '[cost] annotations of the diagram.
+    ###########################################################################
+    def report_costs(self):
+        if '--report-costs' not in self.options:
+            return
+        for self.current in self.machines.values():
+            if self.current.shared != None:
+                continue
+            events = list(dict.fromkeys([e for e in self.current.lookup_events if e.name != ''] +
+                                        [e for (_, e) in self.current.broadcasts]))
+            for event in events:
+                for state in self.current.graph.nodes:
+                    if self.current.is_pseudo_state(state) or state in ['[*]', '*']:
+                        continue
+                    cost = self.event_cost(event, state)
+                    if cost.guards + cost.hooks + cost.forwards != 0:
+                        self.report(self.current, 'Worst case of the event ' + event.name + ' from the state ' +
+                                    state + ': ' + str(cost))
+
+    ###########################################################################
+    ### Return the number of rows of the static tables of transitions of the
+    ### current state machine: tables of external events, range lookups,
+    ### branches of pseudo-states and eventless transitions.
+    ###########################################################################
+    def table_rows(self):
+        rows = 0
+        for event, arcs in self.current.lookup_events.items():
+            if event.name != '':
+                rows += len(arcs) + sum(len(c[1]) for c in self.range_compiled(arcs))
+        for state in self.current.graph.nodes:
+            if self.current.graph.nodes[state]['data'].pseudo in ['choice', 'junction']:
+                rows += len(self.current.pseudo_state_branches(state))
+            elif not self.current.is_pseudo_state(state):
+                rows += len([tr for tr in self.current.transitions_from(state)
+                             if tr.event.name == '' and not self.current.is_join_edge(state, tr.destination)])
+        return rows
+
+    ###########################################################################
+    ### Return the number of entries indexing the rows of the static tables of
+    ### transitions of the current state machine by origin state: nodes of the
+    ### std::map of each external event, or Lookup with the option --data-only.
+    ### State handlers (option --handlers) select their rows without entries.
+    ###########################################################################
+    def table_entries(self):
+        if self.handlers_mode():
+            return 0
+        return sum(len(set(tr.origin for tr in arcs))
+                   for event, arcs in self.current.lookup_events.items() if event.name != '')
+
+    ###########################################################################
+    ### Return the number of rows and of entries of the static tables of the
+    ### current state machine and of its nested state machines, the tables of
+    ### a class shared by several submachines being counted once.
+    ###########################################################################
+    def footprint_tables(self):
+        master, rows, entries = self.current, 0, 0
+        for self.current in [master] + master.descendants():
+            if self.current.shared == None:
+                rows += self.table_rows()
+                entries += self.table_entries()
+        self.current = master
+        return (rows, entries)
+
+    ###########################################################################
+    ### Return the worst-case number of transitions going through the nesting
+    ### queue of the current state machine for a single event: the transition
+    ### of the event plus one per eventless transition taken in the same step
+    ### (infinite for cycles of eventless transitions).
+    ###########################################################################
+    def nesting_depth(self):
+        worst = self.initial_cost(self.current)
+        for event in [e for e in self.current.lookup_events if e.name != '']:
+            for state in self.current.graph.nodes:
+                worst = worst.max(self.event_cost(event, state))
+        return 1 + worst.hops
+
+    ###########################################################################
+    ### Generate the constants describing the footprint of the main state
+    ### machine when the diagram declares a memory budget.
+    ###########################################################################
+    def generate_footprint_constants(self):
+        if len(self.budgets) == 0 or self.current != self.master:
+            return
+        depth = self.nesting_depth()
+        members = sum(len(e.params) for e in self.current.lookup_events)
+        (rows, entries) = self.footprint_tables()
+        self.report(self.current, 'Footprint: ' + str(self.current.graph.number_of_nodes()) + ' states, ' +
+                    str(rows) + ' rows of transitions and ' + str(entries) + ' entries in static tables, ' +
+                    str(len(self.current.descendants())) + ' nested state machines, ' +
+                    str(members) + ' data event members, ' +
+                    ('unbounded' if depth == float('inf') else str(depth)) + ' transitions by event')
+        self.fd.write('\npublic: // Footprint\n\n')
+        self.indent(1), self.fd.write('//! \\brief Number of rows of the static tables of transitions of the state\n')
+        self.indent(1), self.fd.write('//! machine and of its nested state machines.\n')
+        self.indent(1), self.fd.write('static constexpr size_t TABLE_ROWS = ' + str(rows) + 'u;\n')
+        self.indent(1), self.fd.write('//! \\brief Number of entries indexing these rows by origin state.\n')
+        self.indent(1), self.fd.write('static constexpr size_t TABLE_ENTRIES = ' + str(entries) + 'u;\n')
+        self.indent(1), self.fd.write('//! \\brief Bytes of the static tables of transitions: their rows and their\n')
+        if self.data_files() != 0:
+            self.indent(1), self.fd.write('//! Lookup entries. Masks of isIn() and names of states are left out.\n')
+            entry = 'sizeof(Lookup)'
+        else:
+            self.indent(1), self.fd.write('//! entries, std::map nodes allocated on the heap (the pair plus a color\n')
+            self.indent(1), self.fd.write('//! and three pointers). Allocator overhead, masks of isIn() and names of\n')
+            self.indent(1), self.fd.write('//! states are left out.\n')
+            entry = '(sizeof(Transitions::value_type) + 4u * sizeof(void*))'
+        self.indent(1), self.fd.write('static constexpr size_t TABLE_BYTES = TABLE_ROWS * sizeof(Transition) +\n')
+        self.indent(2), self.fd.write('TABLE_ENTRIES * ' + entry + ';\n')
+        self.indent(1), self.fd.write('//! \\brief Worst-case number of transitions done by an event')
+        if depth == float('inf'):
+            self.fd.write(' (unbounded: cycle of eventless transitions).\n')
+            self.indent(1), self.fd.write('static constexpr size_t MAX_NESTING_DEPTH = ~size_t(0);\n')
+        else:
+            self.fd.write('.\n')
+            self.indent(1), self.fd.write('static constexpr size_t MAX_NESTING_DEPTH = ' + str(depth) + 'u;\n')
+
+    ###########################################################################
+    ### Generate the static assertions checking the memory budget of the main
+    ### state machine given by the '[budget] annotations: the size of an
+    ### instance (nested state machines included), the size of the static
+    ### tables of transitions (nested state machines included) and the depth
+    ### of the nesting queue.
+    ###########################################################################
+    def generate_budget_asserts(self):
+        if len(self.budgets) == 0 or self.current != self.master:
+            return
+        name = self.current.class_name
+        self.fd.write('// Memory budget of the state machine\n')
+        if 'instance' in self.budgets:
+            limit = str(self.budgets['instance'])
+            self.fd.write('static_assert(sizeof(' + name + ') <= ' + limit + 'u, "' + name +
+                          ' exceeds its budget of ' + limit + ' bytes by instance");\n')
+        if 'tables' in self.budgets:
+            limit = str(self.budgets['tables'])
+            self.fd.write('static_assert(' + name + '::TABLE_BYTES <= ' + limit +
+                          'u, "Tables of transitions of ' + name + ' exceed their budget of ' + limit + ' bytes");\n')
+        if 'queue' in self.budgets:
+            limit = str(self.budgets['queue'])
+            self.fd.write('static_assert(' + name + '::MAX_NESTING_DEPTH <= ' + limit + 'u, "Nesting queue of ' +
+                          name + ' exceeds its budget of ' + limit + ' transitions");\n')
+        self.fd.write('\n')
+
+    ###########################################################################
+    ### Give to each state machine a byte of the configuration word of the root
+    ### state machine. Nested state machines of mutually exclusive composite
+    ### states share the same bytes while orthogonal regions, alive at the same
+    ### time, get their own bytes. State machines of more than 253 states take
+    ### two bytes. A nested state machine finding no room left in the 8 bytes
+    ### of the word is detached: it packs its state and the states of its own
+    ### nested state machines in its own word. isIn() of its ancestors does not
+    ### see its states and their deep histories enter it from its initial state
+    ### (reported).
+    ### param[in] fsm the state machine.
+    ### param[in] slot the first free byte.
+    ### return the first free byte after the nested state machines.
+    ###########################################################################
+    def allocate_slots(self, fsm, slot):
+        fsm.slot = slot
+        end = slot + fsm.slot_width()
+        for composite in fsm.composite_states():
+            free = slot + fsm.slot_width()
+            for sm in fsm.regions_of(composite):
+                sm.detached = False
+                start, free = free, self.allocate_slots(sm, free)
+                if free > 8:
+                    sm.detached = True
+                    self.allocate_slots(sm, 0)
+                    free = start
+            end = max(end, free)
+        return end
+
+    ###########################################################################
+    ### Detect structurally identical nested state machines (same hash of their
+    ### subgraph) in order to generate their class once and instantiate it
+    ### wherever the submachine is used.
+    ###########################################################################
+    def share_nested_machines(self):
+        classes = dict()
+        for sm in self.master.descendants():
+            signature = sm.signature()
+            if signature not in classes:
+                classes[signature] = sm
+                continue
+            sm.shared = classes[signature]
+            sm.class_name = sm.shared.class_name
+            sm.enum_name = sm.shared.enum_name
+
     ###########################################################################
     ### Check if the method name is not conflicting with a class method.
     ###########################################################################
     def check_valid_method_name(self, name):
         s = name.split('(')[0]
-        if s in ['start', 'stop', 'state', 'c_str', 'transition' ]:
-            self.warning('The C++ method name ' + name + ' is already used by the base class StateMachine')
+        if s in ['start', 'stop', 'state', 'c_str', 'transition', 'enter', 'exit',
+                 'resume', 'configuration', 'isIn', 'bind', 'word', 'hook' ]:
+            self.current.warning('The C++ method name ' + name + ' is already used by the base class StateMachine')
 
     ###########################################################################
     ### Parse the following plantUML code and store information of the analyse:
@@ -1457,6 +4636,19 @@ class Parser(object):
             # Analyse the following plantUML code: "destination state <- origin state ..."
             tr.origin, tr.destination = self.tokens[2].upper(), self.tokens[0].upper()
 
+        # History pseudo-states: "Composite[H]", "Composite[H*]" or, inside the
+        # composite state, "[H]" and "[H*]". In the latter case the origin state
+        # belongs to the parent state machine.
+        backup_fsm = self.current
+        history = re.match(r'^(.*)\[(H\*?)\]$', tr.destination)
+        if history != None:
+            tr.destination, tr.history = history.group(1), history.group(2)
+            if tr.destination == '':
+                if self.current.parent == None:
+                    self.fatal('History pseudo-state ' + tr.history + ' shall be placed inside a composite state')
+                tr.destination = self.current.owner_state()
+                self.current = self.current.parent
+
         # Initial/final states
         if tr.origin == '[*]':
             self.current.initial_state = '[*]'
@@ -1474,15 +4666,20 @@ class Parser(object):
                 N = int(self.tokens[i+1])
                 tr.event.parse(self.tokens[i+2:i+2+N])
                 self.check_valid_method_name(tr.event.name)
-                # Make the main state machine broadcast external events to nested state machine
-                if self.current.parent != None:
-                    self.master.broadcasts.append((self.current.name, tr.event))
+                # Make parent state machines broadcast external events to nested state machine
+                self.current.add_broadcast(tr.event)
                 # Events are optional. If not given, we use them as anonymous internal event.
                 # Store them in a dictionary: "event => (origin, destination) states" to create
                 # the state transition for each event.
-                self.current.lookup_events[tr.event].append((tr.origin, tr.destination))
+                self.current.lookup_events[tr.event].append(tr)
+            elif self.tokens[i] == '#filter':
+                tr.filter = ' '.join(self.tokens[i + 1].split())
+                self.parse_filter(tr)
             elif self.tokens[i] == '#guard':
                 tr.guard = self.tokens[i + 1][1:-1].strip() # Remove [ and ]
+                # [else] is the outgoing transition of pseudo-states without guard
+                if tr.guard == 'else':
+                    tr.guard = ''
                 self.check_valid_method_name(tr.guard)
             elif self.tokens[i] == '#uml_action':
                 tr.action = self.tokens[i + 1][1:].strip() # Remove /
@@ -1501,8 +4698,28 @@ class Parser(object):
 
         # Store parsed information as edge of the graph
         self.current.add_transition(tr)
+        self.current = backup_fsm
         self.tokens = []
 
+    ###########################################################################
+    ### Register the filter of noisy events annotating a transition. The filter
+    ### applies to the event as a whole (it is checked before looking for the
+    ### transition of the current state) therefore all transitions of the event
+    ### share the first filter given.
+    ### param[in] tr the transition annotated with 'debounce(N ms)' or
+    ###   'throttle(N/s)'.
+    ###########################################################################
+    def parse_filter(self, tr):
+        if tr.event.name == '':
+            self.current.warning('Filter ' + tr.filter + ' ignored on the transition ' + tr.origin +
+                                 ' --> ' + tr.destination + ' without event')
+            tr.filter = ''
+            return
+        previous = self.current.filters.setdefault(tr.event, tr.filter)
+        if previous != tr.filter:
+            self.current.warning('Event ' + tr.event.name + ' already filtered by ' + previous +
+                                 ': filter ' + tr.filter + ' ignored')
+
     ###########################################################################
     ### Parse the following plantUML code and store information of the analyse.
     ### param[in] inst: node of the AST.
@@ -1559,6 +4776,17 @@ class Parser(object):
         else:
             self.fatal('Bad syntax describing a state. Unkown token "' + inst.data + '"')
 
+    ###########################################################################
+    ### Parse the following plantUML code declaring a pseudo-state:
+    ###    state Foo <<choice>>
+    ###    state Foo <<junction>>
+    ### param[in] inst: node of the AST.
+    ###########################################################################
+    def parse_pseudo_state(self, inst):
+        name = inst.children[0].upper()
+        self.current.add_state(name)
+        self.current.graph.nodes[name]['data'].pseudo = str(inst.children[1])[2:-2]
+
     ###########################################################################
     ### Extend the PlantUML single-line comments to add extra commands to help
     ### generating C++ code.
@@ -1585,6 +4813,20 @@ class Parser(object):
     ###   '[init] bar.x = 42;
     ### Unit tests:
     ###   '[test] MockMotorController() : MotorController(42) {}
+    ### Estimated duration of guards and actions (for the report of costs):
+    ###   '[cost] onEntering_IDLE 200ns
+    ###   '[cost] default 50ns
+    ### Memory budget checked at compile time: size of an instance (bytes),
+    ### size of the tables of transitions (bytes) and depth of the nesting queue
+    ### (transitions):
+    ###   '[budget] instance 512
+    ###   '[budget] tables 2KiB
+    ###   '[budget] queue 4
+    ### State replacing a renamed or removed state when migrating instances to
+    ### new tables (nested states are prefixed by the path of their composite
+    ### state):
+    ###   '[migrate] STOPPED IDLE
+    ###   '[migrate] ON/BLINK ON/STEADY
     ###########################################################################
     def parse_extra_code(self, token, code):
         if token == '[brief]':
@@ -1616,9 +4858,52 @@ class Parser(object):
         elif token == '[test]':
             self.current.extra_code.unit_tests += code
             self.current.extra_code.unit_tests += '\n'
+        elif token == '[cost]':
+            m = re.fullmatch(r'\s*(\S+)\s+(\d+\.?\d*)\s*(ns|us|ms|s)\s*', code)
+            if m == None:
+                self.fatal('Malformed cost annotation ' + code + ' (expected: method duration[ns|us|ms|s])')
+            self.costs[m.group(1)] = float(m.group(2)) * { 'ns': 1, 'us': 1e3, 'ms': 1e6, 's': 1e9 }[m.group(3)]
+        elif token == '[budget]':
+            m = re.fullmatch(r'\s*(instance|tables|queue)\s+(\d+)\s*(B|KiB)?\s*', code)
+            if m == None:
+                self.fatal('Malformed budget annotation ' + code + ' (expected: instance|tables|queue limit)')
+            self.budgets[m.group(1)] = int(m.group(2)) * (1024 if m.group(3) == 'KiB' else 1)
+        elif token == '[migrate]':
+            m = re.fullmatch(r'\s*((?:\S+/)*)(\S+)\s+((?:\S+/)*)(\S+)\s*', code)
+            if m == None or m.group(1) != m.group(3):
+                self.fatal('Malformed migrate annotation ' + code + ' (expected: old_state new_state of the same state machine)')
+            self.migrations[(m.group(1)[:-1], m.group(2))] = m.group(4)
         else:
             self.fatal('Token ' + token + ' not yet managed')
 
+    ###########################################################################
+    ### Create the nested state machine of a composite state (or of one of its
+    ### orthogonal regions).
+    ### param[in] parent the state machine holding the composite state.
+    ### param[in] name the PlantUML name of the composite state.
+    ### param[in] region the index of the orthogonal region (starting from 1) or
+    ### 0 if the composite state has a single region.
+    ###########################################################################
+    def add_nested_machine(self, parent, name, region):
+        sm = StateMachine()
+        # Set the new name (composite states of different state machines may
+        # have the same name)
+        sm.name = name if region == 0 else name + 'Region' + str(region)
+        stem, i = sm.name, 1
+        while sm.name in self.machines:
+            i += 1
+            sm.name = stem + str(i)
+        sm.class_name = 'Nested' + sm.name
+        sm.enum_name = sm.class_name + 'States'
+        sm.owner = name.upper()
+        sm.region = region
+        # Make the parser knows the list of state machine (one generated file by state machine)
+        self.machines[sm.name] = sm
+        # Create links parent and sibling
+        sm.parent = parent
+        parent.children.append(sm)
+        return sm
+
     ###########################################################################
     ### Traverse the Abstract Syntax Tree (AST) of the PlantUML file.
     ### param[in] inst: node of the AST.
@@ -1626,7 +4911,11 @@ class Parser(object):
     def visit_ast(self, inst):
         # Parse markers for collecting lines of C++ code
         if inst.data == 'cpp':
-            self.parse_extra_code(str(inst.children[0]), inst.children[1].strip())
+            # Unit tests keep their indentation (after the separator)
+            if str(inst.children[0]) == '[test]':
+                self.parse_extra_code('[test]', inst.children[1][1:].rstrip())
+            else:
+                self.parse_extra_code(str(inst.children[0]), inst.children[1].strip())
         # Parse a statechart transition
         elif inst.data == 'transition':
             # Note: we have to convert into a list of tokens since parse_state()
@@ -1648,23 +4937,26 @@ class Parser(object):
         # Composite and orthogonal states. Thanks to the iteration we can create a new
         # file holding the nesting state.
         elif inst.data == 'state_block':
-            # Begin of the recursive operation: save the current state machine
+            # Begin of the recursive operation: save the current state machine
             backup_fsm = self.current
-            # Make the parser knows the list of state machine (one generated file by state machine)
-            self.current = StateMachine()
-            # Set the new name
-            self.current.name = str(inst.children[0])
-            self.current.class_name = 'Nested' + self.current.name
-            self.current.enum_name = self.current.class_name + 'States'
-            self.machines[self.current.name] = self.current
-            # Create links parent and sibling
-            self.current.parent = backup_fsm
-            backup_fsm.children.append(self.current)
-            # Recursive operation: iterate on the AST
+            # Orthogonal regions are separated by "--" or "||". Each region is
+            # a nested state machine.
+            name = str(inst.children[0])
+            regions = len([c for c in inst.children[1:] if c.data == 'ortho_block'])
+            self.current = self.add_nested_machine(backup_fsm, name, 0 if regions == 0 else 1)
+            # The composite state is a state of its parent state machine
+            backup_fsm.add_state(self.current.owner_state())
+            # Recursive operation: iterate on the AST
             for c in inst.children[1:]:
-                self.visit_ast(c)
-            # Begin of the recursive operation: restore the current state machine
+                if c.data == 'ortho_block':
+                    self.current = self.add_nested_machine(backup_fsm, name, self.current.region + 1)
+                else:
+                    self.visit_ast(c)
+            # Begin of the recursive operation: restore the current state machine
             self.current = backup_fsm
+        # Parse a choice or junction pseudo-state
+        elif inst.data == 'pseudo_state':
+            self.parse_pseudo_state(inst)
         # Parse a statechart state
         elif inst.data[0:6] == 'state_':
             self.parse_state(inst)
@@ -1680,7 +4972,8 @@ class Parser(object):
     ### param[in] cpp_or_hpp: generated a C++ source file ('cpp') or a C++ header file ('hpp').
     ### param[in] postfix: postfix name for the state machine name.
     ###########################################################################
-    def translate(self, uml_file, cpp_or_hpp, postfix):
+    def translate(self, uml_file, cpp_or_hpp, postfix, options=[]):
+        self.options = options
         # Make the parser understand the plantUML grammar
         if self.parser == None:
             grammar_file = os.path.join(os.getcwd(), 'statecharts.ebnf')
@@ -1711,11 +5004,27 @@ class Parser(object):
         for inst in self.ast.children:
             self.visit_ast(inst)
         # Do some operation on the state machine
+        for self.current in self.machines.values():
+            self.manage_forks_and_joins()
+        self.prune_dead_states()
+        self.minimize_states()
+        self.verify_histories()
+        self.allocate_slots(self.master, 0)
+        for sm in self.master.descendants():
+            if sm.detached:
+                self.report(sm.parent, 'No room left in the 64-bit configuration word for the nested state machine ' +
+                            sm.name + ': it packs its states in its own word, not seen by isIn() of ' +
+                            sm.parent.name + ' and of its ancestors, and deep histories of its ancestors enter it ' +
+                            'from its initial state')
+        self.share_nested_machines()
         for self.current in self.machines.values():
             self.current.is_determinist()
             self.manage_noevents()
+        self.report_costs()
         # Generate the C++ code
         self.generate_cxx_code(cpp_or_hpp, False)
+        # Generate the tables executed by the interpreter
+        self.generate_tables()
         # Generate the interpreted plantuml code
         self.generate_plantuml_file()
 
@@ -1723,11 +5032,21 @@ class Parser(object):
 ### Display command line usage
 ###############################################################################
 def usage():
-    print('Command line: ' + sys.argv[0] + ' <plantuml file> cpp|hpp [postfix]')
+    print('Command line: ' + sys.argv[0] + ' <plantuml file> cpp|hpp [postfix] [options]')
     print('Where:')
     print('   <plantuml file>: the path of a plantuml statechart')
     print('   "cpp" or "hpp": to choose between generating a C++ source file or a C++ header file')
     print('   [postfix]: is an optional postfix to extend the name of the state machine class')
+    print('   [options]:')
+    print('      --report-dead-states: report unreachable states instead of removing them')
+    print('      --minimize-states: merge equivalent states')
+    print('      --report-costs: report the worst-case cost of each event from each state')
+    print('      --tables: generate the binary tables executed by include/Interpreter.hpp')
+    print('      --migrate-from=<file>: with --tables, also generate the migration of instances running the given older tables')
+    print('      --data-only[=N]: define the tables of transitions as constant data in N separated files <class>Tables[i].cpp (hpp only)')
+    print('      --handlers: store the current state as a pointer to its handler of external events (switch over events)')
+    print('      --deferred: actions push their code into the CommandBuffer bound to the state machine, run after the step')
+    print('      --model-check: also generate the program <class>ModelCheck.cpp exploring the reachable configurations (hpp only)')
     print('Example:')
     print('   sys.argv[1] foo.plantuml cpp Bar')
     print('Will create a FooBar.cpp file with a state machine name FooBar')
@@ -1738,17 +5057,20 @@ def usage():
 ### argv[1] Mandatory: path of the state machine in plantUML format.
 ### argv[2] Mandatory: path of the C++ file to create.
 ### argv[3] Optional: Postfix name for the state machine class.
+### Options starting with '--' can be placed after mandatory arguments.
 ###############################################################################
 def main():
-    argc = len(sys.argv)
+    argv = [a for a in sys.argv if a[0:2] != '--']
+    options = [a for a in sys.argv if a[0:2] == '--']
+    argc = len(argv)
     if argc < 3:
         usage()
-    if sys.argv[2] not in ['cpp', 'hpp']:
-        print('Invalid ' + sys.argv[2] + '. Please set instead "cpp" (for generating a C++ source file) or "hpp" (for generating a C++ header file)')
+    if argv[2] not in ['cpp', 'hpp']:
+        print('Invalid ' + argv[2] + '. Please set instead "cpp" (for generating a C++ source file) or "hpp" (for generating a C++ header file)')
         usage()
 
     p = Parser()
-    p.translate(sys.argv[1], sys.argv[2], '' if argc == 3 else sys.argv[3])
+    p.translate(argv[1], argv[2], '' if argc == 3 else argv[3], options)
 
 if __name__ == '__main__':
     main()
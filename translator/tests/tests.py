@@ -1,7 +1,7 @@
 #!/usr/bin/env python3
 
 from lark import Lark, Transformer
-import os, sys
+import os, subprocess, sys, tempfile
 
 def check(exp):
     if not exp:
@@ -268,14 +268,200 @@ def check_AST(root):
 #    check(c0.children[1] == '->')
 #    check(c0.children[2] == 'NumLockOff')
 
-def main():
-    f = open('../statecharts.ebnf')
-    parser = Lark(f.read())
-    f = open('grammar.plantuml')
-    ast = parser.parse(f.read())
+def check_grammar(ast):
     print("AST:", ast.pretty())
     check(len(ast.children) == 1)
     check_AST(ast.children[0])
 
+# Check a transition: origin, arrow, destination and the names of the rules
+# of its optional event, filter, guard and action.
+def check_transition(node, origin, arrow, destination, rules=[]):
+    check(node.data == 'transition')
+    check(len(node.children) == 3 + len(rules))
+    check(node.children[0] == origin)
+    check(node.children[1] == arrow)
+    check(node.children[2] == destination)
+    for i in range(len(rules)):
+        check(node.children[3 + i].data == rules[i])
+
+# Check a line of C++ code or annotation: its command and its text.
+def check_cpp(node, command, code):
+    check(node.data == 'cpp')
+    check(node.children[0] == command)
+    check(node.children[1].strip() == code)
+
+# History pseudo-states: "[H]" and "[H*]" inside the composite state,
+# "Composite[H]" and "Composite[H*]" outside.
+def check_history(ast):
+    check(len(ast.children) == 4)
+    c = ast.children[0]
+    check(c.data == 'state_block')
+    check(c.children[0] == 'Running')
+    check_transition(c.children[1], '[*]', '->', 'Slow')
+    check_transition(c.children[2], 'Slow', '->', '[H]', ['event'])
+    check_transition(c.children[3], 'Slow', '->', '[H*]', ['event'])
+    check(c.children[3].children[3].children == ['deep', 'back'])
+    check_transition(ast.children[1], 'Running', '->', 'Paused', ['event'])
+    check_transition(ast.children[2], 'Paused', '->', 'Running[H]', ['event'])
+    check_transition(ast.children[3], 'Standby', '->', 'Running[H*]', ['event'])
+
+# Choice and junction pseudo-states and their [else] guard.
+def check_choice(ast):
+    check(len(ast.children) == 6)
+    check(ast.children[0].data == 'pseudo_state')
+    check(ast.children[0].children == ['Grading', '<<choice>>'])
+    check(ast.children[1].data == 'pseudo_state')
+    check(ast.children[1].children == ['Honors', '<<junction>>'])
+    check_transition(ast.children[2], 'Waiting', '-->', 'Grading', ['event'])
+    check_transition(ast.children[3], 'Grading', '-->', 'Failed', ['guard'])
+    check(ast.children[3].children[3].children[0] == '[ score < 10 ]')
+    check_transition(ast.children[4], 'Grading', '-->', 'Honors', ['guard'])
+    check(ast.children[4].children[3].children[0] == '[else]')
+    check_transition(ast.children[5], 'Honors', '-->', 'Excellent', ['guard', 'uml_action'])
+
+# Orthogonal regions separated by "--" or "||", fork and join pseudo-states.
+def check_fork(ast):
+    check(len(ast.children) == 7)
+    check(ast.children[0].data == 'pseudo_state')
+    check(ast.children[0].children == ['Fork1', '<<fork>>'])
+    check(ast.children[1].data == 'pseudo_state')
+    check(ast.children[1].children == ['Join1', '<<join>>'])
+    c = ast.children[2]
+    check(c.data == 'state_block')
+    check(len(c.children) == 6)
+    check(c.children[0] == 'Preparing')
+    check_transition(c.children[1], '[*]', '-->', 'Cold')
+    check(c.children[2].data == 'ortho_block')
+    check_transition(c.children[3], '[*]', '-->', 'Empty')
+    check(c.children[4].data == 'ortho_block')
+    check_transition(c.children[5], '[*]', '-->', 'Off')
+    check_transition(ast.children[3], 'Idle', '-->', 'Fork1', ['event'])
+    check_transition(ast.children[4], 'Fork1', '-->', 'Heating')
+    check_transition(ast.children[5], 'Filled', '-->', 'Join1')
+    check_transition(ast.children[6], 'Join1', '-->', 'Ready')
+
+# Cost annotations: method (qualified or not, or "default") and duration with
+# its unit, separated by spaces or tabulations.
+def check_cost(ast):
+    check(len(ast.children) == 5)
+    check_cpp(ast.children[0], '[cost]', 'onEntering_IDLE 2us')
+    check_cpp(ast.children[1], '[cost]', 'MotorController::onGuarding_IDLE_START 1.5 us')
+    check_cpp(ast.children[2], '[cost]', 'default 50ns')
+    check_transition(ast.children[3], '[*]', '-->', 'Idle')
+    check_transition(ast.children[4], 'Idle', '-->', 'Start', ['event', 'guard'])
+
+# Budget annotations: instance, tables and queue limits, with or without unit.
+def check_budget(ast):
+    check(len(ast.children) == 4)
+    check_cpp(ast.children[0], '[budget]', 'instance 512')
+    check_cpp(ast.children[1], '[budget]', 'tables 1KiB')
+    check_cpp(ast.children[2], '[budget]', 'queue 4 B')
+    check_transition(ast.children[3], '[*]', '-->', 'Idle')
+
+# Filters of noisy events: debounce with a duration and its unit, throttle with
+# a count by second or minute, spaced or not, followed by guards and actions, on
+# transitions and internal transitions.
+def check_filters(ast):
+    check(len(ast.children) == 6)
+    check_transition(ast.children[0], '[*]', '-->', 'Idle')
+    check_transition(ast.children[1], 'Idle', '-->', 'Pressed', ['event', 'filter'])
+    check(ast.children[1].children[4].children[0] == 'debounce(50 ms)')
+    check_transition(ast.children[2], 'Pressed', '-->', 'Idle', ['event', 'filter', 'guard', 'uml_action'])
+    check(ast.children[2].children[4].children[0] == 'debounce( 200us )')
+    check_transition(ast.children[3], 'Idle', '-->', 'Idle', ['event', 'filter'])
+    check(ast.children[3].children[4].children[0] == 'throttle(10/s)')
+    check_transition(ast.children[4], 'Pressed', '-->', 'Idle', ['event', 'filter', 'uml_action'])
+    check(ast.children[4].children[4].children[0] == 'throttle( 3 / min )')
+    c = ast.children[5]
+    check(c.data == 'state_event')
+    check(c.children[0] == 'Pressed')
+    check(c.children[2].data == 'filter')
+    check(c.children[2].children[0] == 'debounce(1 s)')
+
+# Migration annotations: old state and new state, the states of nested state
+# machines being prefixed by the path of their composite state.
+def check_migrate(ast):
+    check(len(ast.children) == 5)
+    check_cpp(ast.children[0], '[migrate]', 'Stop Halted')
+    check_cpp(ast.children[1], '[migrate]', 'Running/Slow Running/Idle')
+    check_transition(ast.children[2], '[*]', '-->', 'Halted')
+    check(ast.children[3].data == 'state_block')
+    check_transition(ast.children[4], 'Halted', '-->', 'Running', ['event'])
+
+# Translate the diagram with the given options, then compile and run the unit
+# tests generated for its root state machine.
+def check_translation(filename, options):
+    name = os.path.splitext(os.path.basename(filename))[0] + 'Controller'
+    flags = subprocess.run(['pkg-config', '--cflags', '--libs', 'gtest', 'gmock'],
+                           capture_output=True, text=True, check=True).stdout.split()
+    with tempfile.TemporaryDirectory() as tmp:
+        os.symlink(os.path.abspath('../statecharts.ebnf'), os.path.join(tmp, 'statecharts.ebnf'))
+        subprocess.run([sys.executable, os.path.abspath('../statecharts.py'), os.path.abspath(filename),
+                        'hpp', 'Controller'] + options, cwd=tmp, check=True, stdout=subprocess.DEVNULL)
+        subprocess.run(['g++', '--std=c++14', '-I' + os.path.abspath('../../include'), '-I.',
+                        name + 'Tests.cpp', '-o', 'tests'] + flags, cwd=tmp, check=True)
+        subprocess.run(['./tests'], cwd=tmp, check=True, stdout=subprocess.DEVNULL)
+
+def main():
+    f = open('../statecharts.ebnf')
+    parser = Lark(f.read())
+    failures = 0
+    for (filename, checker) in [('grammar.plantuml', check_grammar),
+                                ('history.plantuml', check_history),
+                                ('choice.plantuml', check_choice),
+                                ('fork.plantuml', check_fork),
+                                ('cost.plantuml', check_cost),
+                                ('budget.plantuml', check_budget),
+                                ('migrate.plantuml', check_migrate),
+                                ('filters.plantuml', check_filters)]:
+        try:
+            f = open(filename)
+            checker(parser.parse(f.read()))
+            print('PASSED', filename)
+        except Exception:
+            print('FAILED', filename)
+            failures += 1
+    # Minimized states shall keep the sources and targets of fork and join
+    # pseudo-states.
+    for filename in ['../../examples/Fork.plantuml', 'Minimize.plantuml']:
+        try:
+            check_translation(filename, ['--minimize-states'])
+            print('PASSED', filename, '--minimize-states')
+        except Exception:
+            print('FAILED', filename, '--minimize-states')
+            failures += 1
+    # Configurations not fitting in a 64-bit word are translated: the nested
+    # state machine finding no room left keeps its own word.
+    try:
+        check_translation('Deep.plantuml', [])
+        print('PASSED', 'Deep.plantuml')
+    except Exception:
+        print('FAILED', 'Deep.plantuml')
+        failures += 1
+    # States with an entering action are not collapsed with the eventless
+    # transitions leaving them: their action sees the state machine in them.
+    try:
+        check_translation('Transient.plantuml', [])
+        print('PASSED', 'Transient.plantuml')
+    except Exception:
+        print('FAILED', 'Transient.plantuml')
+        failures += 1
+    # Deferred actions keep the order of their statements and their local
+    # variables, while state updates read by guards run immediately.
+    try:
+        check_translation('Deferred.plantuml', ['--deferred'])
+        print('PASSED', 'Deferred.plantuml', '--deferred')
+    except Exception:
+        print('FAILED', 'Deferred.plantuml', '--deferred')
+        failures += 1
+    # Deferred actions cannot update by reference the variables read by guards.
+    try:
+        check_translation('../../examples/RichMan.plantuml', ['--deferred'])
+        print('FAILED', 'RichMan.plantuml', '--deferred')
+        failures += 1
+    except Exception:
+        print('PASSED', 'RichMan.plantuml', '--deferred')
+    sys.exit(1 if failures != 0 else 0)
+
 if __name__ == '__main__':
     main()